@@ -0,0 +1,242 @@
+/*
+ * macro_budget - pace a scan so it can run next to other work, see macro_budget.h
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "macro_budget.h"
+
+/* the longest single sleep, so an interruption is noticed soon */
+#define MAX_SLEEP 0.25
+
+static volatile sig_atomic_t _interrupted = 0;
+
+static void   bucket_init(MACRO_BUDGET_BUCKET * bucket, double rate, double now);
+static double bucket_take(MACRO_BUDGET_BUCKET * bucket, double amount, double now);
+static void   wait_for(MACRO_BUDGET * budget, double wait);
+static void   report(MACRO_BUDGET * budget, const char * what, double now);
+static double now_seconds(void);
+static double cpu_seconds(void);
+static void   on_signal(int signo);
+
+void macro_budget_init(MACRO_BUDGET * budget, double read_rate, double open_rate, double cpu_share, FILE * progress, double progress_every)
+{
+    double now = now_seconds();
+
+    assert(budget != NULL);
+
+    memset(budget, 0, sizeof(MACRO_BUDGET));
+    pthread_mutex_init(&budget->lock, NULL);
+
+    bucket_init(&budget->bytes, read_rate, now);
+    bucket_init(&budget->opens, open_rate, now);
+    bucket_init(&budget->cpu,   cpu_share, now);
+    budget->cpu_mark = cpu_seconds();
+
+    budget->progress       = progress;
+    budget->progress_every = progress_every > 0 ? progress_every : MACRO_BUDGET_PROGRESS_EVERY;
+    budget->progress_last  = now;
+    budget->phase_start    = now;
+}
+
+void macro_budget_free(MACRO_BUDGET * budget)
+{
+    if (budget == NULL) {
+        return;
+    }
+
+    pthread_mutex_destroy(&budget->lock);
+}
+
+void macro_budget_phase(MACRO_BUDGET * budget, const char * phase)
+{
+    double now = now_seconds();
+
+    pthread_mutex_lock(&budget->lock);
+
+    if (budget->phase != NULL) {
+        report(budget, macro_budget_interrupted() && !budget->was_interrupted ? "interrupted" : "done", now);
+    }
+
+    budget->phase         = phase;
+    budget->phase_start   = now;
+    budget->progress_last = now;
+    budget->files         = 0;
+    budget->bytes_read    = 0;
+    budget->throttled     = 0;
+    budget->was_interrupted = macro_budget_interrupted();
+
+    pthread_mutex_unlock(&budget->lock);
+}
+
+void macro_budget_open(MACRO_BUDGET * budget)
+{
+    double wait;
+
+    pthread_mutex_lock(&budget->lock);
+    wait = bucket_take(&budget->opens, 1, now_seconds());
+    pthread_mutex_unlock(&budget->lock);
+
+    wait_for(budget, wait);
+}
+
+void macro_budget_read(MACRO_BUDGET * budget, unsigned long long len)
+{
+    double wait;
+
+    pthread_mutex_lock(&budget->lock);
+    wait = bucket_take(&budget->bytes, (double)len, now_seconds());
+    pthread_mutex_unlock(&budget->lock);
+
+    wait_for(budget, wait);
+}
+
+void macro_budget_drop_cache(int fd)
+{
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#else
+    (void)fd;
+#endif
+}
+
+void macro_budget_file_done(MACRO_BUDGET * budget, unsigned long long len)
+{
+    double cpu = cpu_seconds();
+    double now = now_seconds();
+    double wait;
+
+    pthread_mutex_lock(&budget->lock);
+
+    budget->files++;
+    budget->bytes_read += len;
+
+    wait = bucket_take(&budget->cpu, cpu - budget->cpu_mark, now);
+    budget->cpu_mark = cpu;
+
+    if (budget->phase != NULL && now - budget->progress_last >= budget->progress_every) {
+        report(budget, NULL, now);
+        budget->progress_last = now;
+    }
+
+    pthread_mutex_unlock(&budget->lock);
+
+    wait_for(budget, wait);
+}
+
+void macro_budget_catch_signals(void)
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sa.sa_flags   = SA_RESETHAND;     /* the second one is not caught */
+    sigemptyset(&sa.sa_mask);
+
+    sigaction(SIGINT,  &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+int macro_budget_interrupted(void)
+{
+    return _interrupted != 0;
+}
+
+static void bucket_init(MACRO_BUDGET_BUCKET * bucket, double rate, double now)
+{
+    bucket->rate   = rate > 0 ? rate : 0;
+    bucket->burst  = bucket->rate / 10;
+    bucket->tokens = bucket->burst;
+    bucket->last   = now;
+}
+
+/* refill, then take 'amount'. returns how long to wait for the debt to be paid, 0 if none */
+static double bucket_take(MACRO_BUDGET_BUCKET * bucket, double amount, double now)
+{
+    if (bucket->rate == 0) {
+        return 0;
+    }
+
+    bucket->tokens += (now - bucket->last) * bucket->rate;
+    if (bucket->tokens > bucket->burst) {
+        bucket->tokens = bucket->burst;
+    }
+    bucket->last = now;
+
+    bucket->tokens -= amount;
+
+    return bucket->tokens < 0 ? -bucket->tokens / bucket->rate : 0;
+}
+
+/* sleep for 'wait' seconds, less if interrupted */
+static void wait_for(MACRO_BUDGET * budget, double wait)
+{
+    struct timespec ts;
+    double slept = 0;
+    double step;
+
+    while (slept < wait && !macro_budget_interrupted()) {
+        step = wait - slept < MAX_SLEEP ? wait - slept : MAX_SLEEP;
+
+        ts.tv_sec  = (time_t)step;
+        ts.tv_nsec = (long)((step - (double)ts.tv_sec) * 1e9);
+        nanosleep(&ts, NULL);
+
+        slept += step;
+    }
+
+    if (slept > 0) {
+        pthread_mutex_lock(&budget->lock);
+        budget->throttled += slept;
+        pthread_mutex_unlock(&budget->lock);
+    }
+}
+
+/* one progress line for the current phase, 'what' is NULL while it runs. Called with the lock held */
+static void report(MACRO_BUDGET * budget, const char * what, double now)
+{
+    if (budget->progress == NULL) {
+        return;
+    }
+
+    fprintf(budget->progress, "[%s]%s%s files:%lu read:%.1fMB elapsed:%.1fs throttled:%.1fs\n",
+            budget->phase, what != NULL ? " " : "", what != NULL ? what : "",
+            budget->files, (double)budget->bytes_read / (1024 * 1024),
+            now - budget->phase_start, budget->throttled);
+    fflush(budget->progress);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static double cpu_seconds(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) {
+        return (double)clock() / CLOCKS_PER_SEC;
+    }
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void on_signal(int signo)
+{
+    (void)signo;
+
+    _interrupted = 1;
+}
@@ -0,0 +1,88 @@
+/*
+ * macro_budget - pace a scan so it can run next to other work
+ *
+ * Each limit is a token bucket: tokens come back at 'rate' per second, up to a tenth of a
+ * second worth of them while nothing is taken. Taking more than there is leaves the bucket
+ * in debt and the taker sleeps until the debt is paid, so one big file costs as much
+ * waiting as many small ones of the same size.
+ *
+ *   - read bandwidth: the bytes of every file are taken before they are read, the raw bytes
+ *     of a tar archive as its members are unpacked,
+ *   - file opens: one token before each file is opened,
+ *   - CPU share: after each file the CPU time the process used since the last file is
+ *     taken, a share of 0.25 lets it use a quarter of one CPU over time.
+ *
+ * Pages read are dropped from the page cache(posix_fadvise(POSIX_FADV_DONTNEED)) after each
+ * file, so a scan of a big tree does not push out what the other processes need.
+ *
+ * Progress goes to 'progress' every 'progress_every' seconds and when a phase ends. After
+ * macro_budget_catch_signals() the first SIGINT or SIGTERM makes macro_budget_interrupted()
+ * true: the scan stops before its next file and the results so far are still written. A
+ * second one ends the process.
+ */
+
+#ifndef MACRO_BUDGET_H
+#define MACRO_BUDGET_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+/* seconds between progress lines unless set */
+#define MACRO_BUDGET_PROGRESS_EVERY 5.0
+
+typedef struct MACRO_BUDGET_BUCKET {
+
+   double             rate;           /* tokens per second, 0 for no limit */
+   double             burst;          /* most tokens saved up */
+   double             tokens;         /* below 0 while in debt */
+   double             last;           /* when tokens were last refilled */
+
+}MACRO_BUDGET_BUCKET;
+
+typedef struct MACRO_BUDGET {
+
+   pthread_mutex_t      lock;         /* the buckets and counts are also used by the tar reader thread */
+
+   MACRO_BUDGET_BUCKET  bytes;        /* read bandwidth, bytes per second */
+   MACRO_BUDGET_BUCKET  opens;        /* files opened per second */
+   MACRO_BUDGET_BUCKET  cpu;          /* CPU seconds per second */
+   double               cpu_mark;     /* process CPU time when the cpu bucket was last charged */
+
+   FILE               * progress;     /* NULL for no progress */
+   double               progress_every;
+   double               progress_last;
+
+   /* the current phase */
+   const char         * phase;
+   double               phase_start;
+   unsigned long        files;
+   unsigned long long   bytes_read;
+   double               throttled;    /* seconds slept */
+   int                  was_interrupted;  /* already when the phase started */
+
+}MACRO_BUDGET;
+
+/*
+ * no limits until they are set, 'read_rate' bytes and 'open_rate' files per second,
+ * 'cpu_share' of one CPU, 0 for no limit. 'progress' may be NULL.
+ */
+void macro_budget_init(MACRO_BUDGET * budget, double read_rate, double open_rate, double cpu_share, FILE * progress, double progress_every);
+void macro_budget_free(MACRO_BUDGET * budget);
+
+/* end the current phase(printing its totals) and start 'phase', NULL only ends it */
+void macro_budget_phase(MACRO_BUDGET * budget, const char * phase);
+
+/* wait for a file open and for 'len' bytes of reading, see the top of this file */
+void macro_budget_open(MACRO_BUDGET * budget);
+void macro_budget_read(MACRO_BUDGET * budget, unsigned long long len);
+
+/* drop what was read of 'fd' from the page cache */
+void macro_budget_drop_cache(int fd);
+
+/* a file of 'len' bytes has been scanned: charge its CPU time, report progress if due */
+void macro_budget_file_done(MACRO_BUDGET * budget, unsigned long long len);
+
+void macro_budget_catch_signals(void);
+int  macro_budget_interrupted(void);
+
+#endif /* MACRO_BUDGET_H */
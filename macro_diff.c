@@ -0,0 +1,547 @@
+/*
+ * macro_diff - what changed between two snapshots, see macro_diff.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "macro_diff.h"
+#include "macro_snapshot.h"
+
+/* how many sites of one macro are in one file */
+typedef struct FILE_RUN {
+
+   unsigned int     file;       /* file id in the merged path list */
+   unsigned int     count;
+
+}FILE_RUN;
+
+/* a snapshot path below its scan root */
+typedef struct REL_PATH {
+
+   const char     * path;
+   unsigned int     file;       /* file id in the snapshot */
+
+}REL_PATH;
+
+/* one of the two snapshots being merged */
+typedef struct DIFF_SIDE {
+
+   MACRO_SNAPSHOT   snap;
+   int              opened;
+   int              more;           /* 1 while snap holds a macro not merged yet */
+   unsigned int   * to_merged;      /* snapshot file id -> file id in the merged path list */
+   int              unordered;      /* 1 if to_merged does not keep the file id order, the runs are sorted then */
+   unsigned int   * value_seen;     /* value id + 1 -> macro_pos of the macro it was last added for */
+
+   /* the current macro, decoded */
+   FILE_RUN       * di_runs;
+   unsigned int     di_run_nums;
+   FILE_RUN       * fi_runs;
+   unsigned int     fi_run_nums;
+   unsigned int     run_cap;
+   const char    ** values;         /* distinct define values sorted, NULL for a define without value */
+   unsigned int     value_nums;
+   unsigned int     value_cap;
+
+}DIFF_SIDE;
+
+/* what macro_diff_snapshots() counts for its summary */
+typedef struct DIFF_SUMMARY {
+
+   unsigned int     added;
+   unsigned int     removed;
+   unsigned int     redefined;
+   unsigned int     changed;        /* in both snapshots with other define or found-from files */
+
+}DIFF_SUMMARY;
+
+static int  merge_paths(DIFF_SIDE * old_side, DIFF_SIDE * new_side, const char *** merged_paths);
+static REL_PATH * relative_paths(const MACRO_SNAPSHOT * snap);
+static const char * below_root(const MACRO_SNAPSHOT * snap, const char * path);
+static void sort_runs(FILE_RUN * runs, unsigned int * run_nums);
+static void print_roots(const MACRO_SNAPSHOT * snap, FILE * out);
+static int  decode_macro(DIFF_SIDE * side);
+static int  decode_runs(DIFF_SIDE * side, const unsigned char * data, unsigned int len, unsigned int with_value, FILE_RUN ** runs, unsigned int * run_nums);
+static int  add_value(DIFF_SIDE * side, unsigned int value);
+static int  diff_runs(const char * name, const FILE_RUN * old_runs, unsigned int old_nums, const FILE_RUN * new_runs, unsigned int new_nums,
+                      const char * const * merged_paths, int counted, const char * plus, const char * minus, FILE * out);
+static int  same_values(const DIFF_SIDE * old_side, const DIFF_SIDE * new_side);
+static void print_values(const DIFF_SIDE * side, FILE * out);
+static int  compare_value(const void * a, const void * b);
+static int  compare_rel_path(const void * a, const void * b);
+static int  compare_run(const void * a, const void * b);
+
+int macro_diff_snapshots(FILE * old_in, FILE * new_in, FILE * out)
+{
+    DIFF_SIDE old_side;
+    DIFF_SIDE new_side;
+    DIFF_SUMMARY summary;
+    const char ** merged_paths = NULL;
+    int cmp;
+    int changed;
+    int ret = -1;
+
+    assert(old_in != NULL);
+    assert(new_in != NULL);
+    assert(out    != NULL);
+
+    memset(&old_side, 0, sizeof(DIFF_SIDE));
+    memset(&new_side, 0, sizeof(DIFF_SIDE));
+    memset(&summary,  0, sizeof(DIFF_SUMMARY));
+
+    if (macro_snapshot_open(&old_side.snap, old_in) != 0) {
+        goto DONE;
+    }
+    old_side.opened = 1;
+
+    if (macro_snapshot_open(&new_side.snap, new_in) != 0) {
+        goto DONE;
+    }
+    new_side.opened = 1;
+
+    /* Step 1. match the files of both snapshots */
+    if (merge_paths(&old_side, &new_side, &merged_paths) != 0) {
+        goto DONE;
+    }
+
+    /* Step 2. merge the macros by name */
+    if ((old_side.more = macro_snapshot_next(&old_side.snap)) < 0 ||
+        (new_side.more = macro_snapshot_next(&new_side.snap)) < 0) {
+        goto DONE;
+    }
+
+    while (old_side.more || new_side.more) {
+
+        if (!old_side.more) {
+            cmp = 1;
+        } else if (!new_side.more) {
+            cmp = -1;
+        } else {
+            cmp = strcmp(old_side.snap.name, new_side.snap.name);
+        }
+
+        if (cmp < 0) {
+            fprintf(out, "removed\t%s\tdefines:%u uses:%u\n", old_side.snap.name, old_side.snap.di_nums, old_side.snap.fi_nums);
+            summary.removed++;
+        } else if (cmp > 0) {
+            fprintf(out, "added\t%s\tdefines:%u uses:%u\n", new_side.snap.name, new_side.snap.di_nums, new_side.snap.fi_nums);
+            summary.added++;
+        } else {
+            if (decode_macro(&old_side) != 0 || decode_macro(&new_side) != 0) {
+                goto DONE;
+            }
+
+            if (old_side.value_nums > 0 && new_side.value_nums > 0 && !same_values(&old_side, &new_side)) {
+                fprintf(out, "redefined\t%s\t", old_side.snap.name);
+                print_values(&old_side, out);
+                fprintf(out, " -> ");
+                print_values(&new_side, out);
+                fprintf(out, "\n");
+                summary.redefined++;
+            }
+
+            changed  = diff_runs(old_side.snap.name, old_side.di_runs, old_side.di_run_nums, new_side.di_runs, new_side.di_run_nums,
+                                 merged_paths, 0, "+define", "-define", out);
+            changed |= diff_runs(old_side.snap.name, old_side.fi_runs, old_side.fi_run_nums, new_side.fi_runs, new_side.fi_run_nums,
+                                 merged_paths, 1, "+use", "-use", out);
+            if (changed) {
+                summary.changed++;
+            }
+        }
+
+        if (cmp <= 0 && (old_side.more = macro_snapshot_next(&old_side.snap)) < 0) {
+            goto DONE;
+        }
+        if (cmp >= 0 && (new_side.more = macro_snapshot_next(&new_side.snap)) < 0) {
+            goto DONE;
+        }
+    }
+
+    /* output summary information */
+    fprintf(out,"\n------------------------------------------\n");
+    fprintf(out,"old root:");
+    print_roots(&old_side.snap, out);
+    fprintf(out,"\nnew root:");
+    print_roots(&new_side.snap, out);
+    fprintf(out,"\n");
+    fprintf(out,"old macro:%u\nnew macro:%u\nadded macro:%u\nremoved macro:%u\nredefined macro:%u\nchanged macro:%u\n",
+            old_side.snap.macro_nums, new_side.snap.macro_nums,
+            summary.added, summary.removed, summary.redefined, summary.changed);
+
+    ret = fflush(out) == 0 ? 0 : -1;
+
+DONE:
+    free(merged_paths);
+    free(old_side.to_merged);
+    free(old_side.value_seen);
+    free(old_side.di_runs);
+    free(old_side.fi_runs);
+    free(old_side.values);
+    free(new_side.to_merged);
+    free(new_side.value_seen);
+    free(new_side.di_runs);
+    free(new_side.fi_runs);
+    free(new_side.values);
+    if (old_side.opened) {
+        macro_snapshot_close(&old_side.snap);
+    }
+    if (new_side.opened) {
+        macro_snapshot_close(&new_side.snap);
+    }
+
+    return ret;
+}
+
+/*
+ * give every path a file id in the merged list of both snapshots, so their postings can be
+ * compared file id by file id. Paths are matched below the scan roots kept in their snapshot,
+ * so two checkouts of the same tree in different directories match file by file; the merged
+ * list holds these relative paths. Both sides are sorted by relative path and merged once.
+ */
+static int merge_paths(DIFF_SIDE * old_side, DIFF_SIDE * new_side, const char *** merged_paths)
+{
+    unsigned int old_nums = str_pool_nums(&old_side->snap.paths);
+    unsigned int new_nums = str_pool_nums(&new_side->snap.paths);
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int k;
+    unsigned int nums = 0;
+    REL_PATH * old_paths;
+    REL_PATH * new_paths;
+    const char * path;
+    int ret = -1;
+
+    old_paths            = relative_paths(&old_side->snap);
+    new_paths            = relative_paths(&new_side->snap);
+    old_side->to_merged  = malloc((old_nums + 1) * sizeof(unsigned int));
+    new_side->to_merged  = malloc((new_nums + 1) * sizeof(unsigned int));
+    old_side->value_seen = calloc(str_pool_nums(&old_side->snap.values) + 1, sizeof(unsigned int));
+    new_side->value_seen = calloc(str_pool_nums(&new_side->snap.values) + 1, sizeof(unsigned int));
+    *merged_paths        = malloc((old_nums + new_nums + 1) * sizeof(char *));
+    if (old_paths == NULL || new_paths == NULL || old_side->to_merged == NULL || new_side->to_merged == NULL ||
+        old_side->value_seen == NULL || new_side->value_seen == NULL || *merged_paths == NULL) {
+        errno = ENOMEM;
+        goto DONE;
+    }
+
+    /* the same relative path can come from two roots of one snapshot, they share a file id */
+    while (i < old_nums || j < new_nums) {
+        if (j == new_nums || (i < old_nums && strcmp(old_paths[i].path, new_paths[j].path) <= 0)) {
+            path = old_paths[i].path;
+        } else {
+            path = new_paths[j].path;
+        }
+
+        while (i < old_nums && strcmp(old_paths[i].path, path) == 0) {
+            old_side->to_merged[old_paths[i++].file] = nums;
+        }
+        while (j < new_nums && strcmp(new_paths[j].path, path) == 0) {
+            new_side->to_merged[new_paths[j++].file] = nums;
+        }
+
+        (*merged_paths)[nums++] = path;
+    }
+
+    /* with one root the paths keep their order, the postings then give the runs sorted */
+    for (k = 1; k < old_nums; k++) {
+        if (old_side->to_merged[k] < old_side->to_merged[k - 1]) {
+            old_side->unordered = 1;
+        }
+    }
+    for (k = 1; k < new_nums; k++) {
+        if (new_side->to_merged[k] < new_side->to_merged[k - 1]) {
+            new_side->unordered = 1;
+        }
+    }
+
+    ret = 0;
+
+DONE:
+    free(old_paths);
+    free(new_paths);
+
+    return ret;
+}
+
+/* the paths of a snapshot below its roots, sorted. returns NULL if out of memory */
+static REL_PATH * relative_paths(const MACRO_SNAPSHOT * snap)
+{
+    unsigned int nums = str_pool_nums(&snap->paths);
+    unsigned int file;
+    REL_PATH * paths;
+
+    if ((paths = malloc((nums + 1) * sizeof(REL_PATH))) == NULL) {
+        return NULL;
+    }
+
+    for (file = 0; file < nums; file++) {
+        paths[file].path = below_root(snap, str_pool_get(&snap->paths, file));
+        paths[file].file = file;
+    }
+
+    qsort(paths, nums, sizeof(REL_PATH), compare_rel_path);
+
+    return paths;
+}
+
+/* 'path' without the deepest root of the snapshot it is below, the whole path if there is none */
+static const char * below_root(const MACRO_SNAPSHOT * snap, const char * path)
+{
+    unsigned int nums = str_pool_nums(&snap->roots);
+    unsigned int id;
+    const char * root;
+    size_t len;
+    size_t best = 0;
+
+    for (id = 0; id < nums; id++) {
+        root = str_pool_get(&snap->roots, id);
+        len  = strlen(root);
+
+        if (len > best && strncmp(path, root, len) == 0 && (path[len] == '/' || root[len - 1] == '/')) {
+            best = len;
+        }
+    }
+
+    while (best > 0 && path[best] == '/') {
+        best++;
+    }
+
+    return path + best;
+}
+
+static void print_roots(const MACRO_SNAPSHOT * snap, FILE * out)
+{
+    unsigned int id;
+
+    for (id = 0; id < str_pool_nums(&snap->roots); id++) {
+        fprintf(out, "%s%s", id > 0 ? ", " : "", str_pool_get(&snap->roots, id));
+    }
+}
+
+/* the current macro of a snapshot as per file counts and its distinct values */
+static int decode_macro(DIFF_SIDE * side)
+{
+    side->value_nums = 0;
+
+    if (decode_runs(side, side->snap.di, side->snap.di_len, 1, &side->di_runs, &side->di_run_nums) != 0 ||
+        decode_runs(side, side->snap.fi, side->snap.fi_len, 0, &side->fi_runs, &side->fi_run_nums) != 0) {
+        return -1;
+    }
+
+    if (side->unordered) {
+        sort_runs(side->di_runs, &side->di_run_nums);
+        sort_runs(side->fi_runs, &side->fi_run_nums);
+    }
+
+    if (side->value_nums > 1) {
+        qsort(side->values, side->value_nums, sizeof(char *), compare_value);
+    }
+
+    return 0;
+}
+
+static int decode_runs(DIFF_SIDE * side, const unsigned char * data, unsigned int len, unsigned int with_value, FILE_RUN ** runs, unsigned int * run_nums)
+{
+    MACRO_POSTINGS_ITER it;
+    const MACRO_SITE * site;
+    unsigned int file;
+    unsigned int cap;
+    void * p;
+
+    *run_nums = 0;
+
+    macro_postings_iter_init(&it, data, len, with_value);
+    while ((site = macro_postings_iter_next(&it)) != NULL) {
+
+        if (site->file >= str_pool_nums(&side->snap.paths) ||
+            site->value > str_pool_nums(&side->snap.values)) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        if (with_value && add_value(side, site->value) != 0) {
+            return -1;
+        }
+
+        file = side->to_merged[site->file];
+        if (*run_nums > 0 && (*runs)[*run_nums - 1].file == file) {
+            (*runs)[*run_nums - 1].count++;
+            continue;
+        }
+
+        /* both run arrays grow together so they share run_cap */
+        if (*run_nums == side->run_cap) {
+            cap = side->run_cap > 0 ? side->run_cap * 2 : 64;
+
+            if ((p = realloc(side->di_runs, cap * sizeof(FILE_RUN))) == NULL) {
+                errno = ENOMEM;
+                return -1;
+            }
+            side->di_runs = p;
+
+            if ((p = realloc(side->fi_runs, cap * sizeof(FILE_RUN))) == NULL) {
+                errno = ENOMEM;
+                return -1;
+            }
+            side->fi_runs = p;
+
+            side->run_cap = cap;
+        }
+
+        (*runs)[*run_nums].file  = file;
+        (*runs)[*run_nums].count = 1;
+        (*run_nums)++;
+    }
+
+    return 0;
+}
+
+/* sort the runs by merged file id and add up the runs of the same file */
+static void sort_runs(FILE_RUN * runs, unsigned int * run_nums)
+{
+    unsigned int k;
+    unsigned int nums = 0;
+
+    if (*run_nums < 2) {
+        return;
+    }
+
+    qsort(runs, *run_nums, sizeof(FILE_RUN), compare_run);
+
+    for (k = 1; k < *run_nums; k++) {
+        if (runs[k].file == runs[nums].file) {
+            runs[nums].count += runs[k].count;
+        } else {
+            runs[++nums] = runs[k];
+        }
+    }
+
+    *run_nums = nums + 1;
+}
+
+/*
+ * keep value id + 1 'value' once for the current macro. Values are interned in the snapshot,
+ * so equal values have the same id, and value_seen tells in constant time if it is kept already.
+ */
+static int add_value(DIFF_SIDE * side, unsigned int value)
+{
+    void * p;
+
+    if (side->value_seen[value] == side->snap.macro_pos) {
+        return 0;
+    }
+    side->value_seen[value] = side->snap.macro_pos;
+
+    if (side->value_nums == side->value_cap) {
+        side->value_cap = side->value_cap > 0 ? side->value_cap * 2 : 8;
+        if ((p = realloc(side->values, side->value_cap * sizeof(char *))) == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        side->values = p;
+    }
+
+    side->values[side->value_nums++] = value == 0 ? NULL : str_pool_get(&side->snap.values, value - 1);
+
+    return 0;
+}
+
+/*
+ * walk two per file lists of one macro side by side and print the files that differ.
+ * 'counted' also reports files whose number of sites changed. returns 1 if anything differs.
+ */
+static int diff_runs(const char * name, const FILE_RUN * old_runs, unsigned int old_nums, const FILE_RUN * new_runs, unsigned int new_nums,
+                     const char * const * merged_paths, int counted, const char * plus, const char * minus, FILE * out)
+{
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int file;
+    unsigned int old_count;
+    unsigned int new_count;
+    int changed = 0;
+
+    while (i < old_nums || j < new_nums) {
+        if (j == new_nums || (i < old_nums && old_runs[i].file < new_runs[j].file)) {
+            file      = old_runs[i].file;
+            old_count = old_runs[i++].count;
+            new_count = 0;
+        } else if (i == old_nums || new_runs[j].file < old_runs[i].file) {
+            file      = new_runs[j].file;
+            old_count = 0;
+            new_count = new_runs[j++].count;
+        } else {
+            file      = old_runs[i].file;
+            old_count = old_runs[i++].count;
+            new_count = new_runs[j++].count;
+        }
+
+        if (old_count == new_count || (!counted && old_count > 0 && new_count > 0)) {
+            continue;
+        }
+
+        if (counted) {
+            fprintf(out, "%s\t%s\t%s\t%u->%u\n", new_count > old_count ? plus : minus, name, merged_paths[file], old_count, new_count);
+        } else {
+            fprintf(out, "%s\t%s\t%s\n", new_count > old_count ? plus : minus, name, merged_paths[file]);
+        }
+        changed = 1;
+    }
+
+    return changed;
+}
+
+static int same_values(const DIFF_SIDE * old_side, const DIFF_SIDE * new_side)
+{
+    unsigned int k;
+
+    if (old_side->value_nums != new_side->value_nums) {
+        return 0;
+    }
+
+    for (k = 0; k < old_side->value_nums; k++) {
+        if (compare_value(&old_side->values[k], &new_side->values[k]) != 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void print_values(const DIFF_SIDE * side, FILE * out)
+{
+    unsigned int k;
+
+    for (k = 0; k < side->value_nums; k++) {
+        fprintf(out, "%s%s", k > 0 ? ", " : "", side->values[k] != NULL ? side->values[k] : "(none)");
+    }
+}
+
+/* NULL(no value) first, then by bytes */
+static int compare_value(const void * a, const void * b)
+{
+    const char * va = *(const char * const *)a;
+    const char * vb = *(const char * const *)b;
+
+    if (va == NULL || vb == NULL) {
+        return (va != NULL) - (vb != NULL);
+    }
+
+    return strcmp(va, vb);
+}
+
+static int compare_rel_path(const void * a, const void * b)
+{
+    return strcmp(((const REL_PATH *)a)->path, ((const REL_PATH *)b)->path);
+}
+
+static int compare_run(const void * a, const void * b)
+{
+    unsigned int fa = ((const FILE_RUN *)a)->file;
+    unsigned int fb = ((const FILE_RUN *)b)->file;
+
+    return (fa > fb) - (fa < fb);
+}
@@ -0,0 +1,38 @@
+/*
+ * macro_diff - what changed between two snapshots
+ *
+ * Both snapshots keep their macros in name order and their paths sorted, so the two are
+ * merged in one pass like two sorted lists: the path tables once up front to match files
+ * across the snapshots, then the macros one pair at a time. Only the current macro of each
+ * snapshot is held in memory besides the path and value tables, which are loaded in full, so
+ * memory grows with the number of files and distinct values, not with the number of sites.
+ *
+ * Paths are compared below the scan roots the snapshot was saved with(the directories given
+ * to --save's scan), so a tree scanned in /tmp/r1 and its copy in /tmp/r2 only differ where
+ * the files do. The paths printed are the relative ones, the roots are listed in the summary.
+ * Paths of a snapshot without roots("LMSNAP01") are compared in full.
+ *
+ * Line numbers are not compared, they move with every edit; a macro's define and found-from
+ * sites are compared per file instead. One record per line, fields separated by a tab:
+ *
+ *     added      NAME   defines:N uses:M          only in the new snapshot
+ *     removed    NAME   defines:N uses:M          only in the old snapshot
+ *     redefined  NAME   old values -> new values  the set of define values changed
+ *     +define    NAME   path                      a file started defining it
+ *     -define    NAME   path                      a file stopped defining it
+ *     +use       NAME   path   old->new           more found-from sites in a file
+ *     -use       NAME   path   old->new           fewer found-from sites in a file
+ */
+
+#ifndef MACRO_DIFF_H
+#define MACRO_DIFF_H
+
+#include <stdio.h>
+
+/*
+ * compare the snapshots read from 'old_in' and 'new_in' and write the delta to 'out'.
+ * returns 0 on success, -1 with errno set on read error, bad snapshot(EINVAL) or out of memory.
+ */
+int macro_diff_snapshots(FILE * old_in, FILE * new_in, FILE * out);
+
+#endif /* MACRO_DIFF_H */
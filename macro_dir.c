@@ -0,0 +1,236 @@
+/*
+ * macro_dir - define and found-from counts per directory, see macro_dir.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "macro_dir.h"
+
+static int find_or_add_dir(MACRO_DIR_TREE * tree, const char * path, size_t len, unsigned int * id);
+static int compare_dir(const void * a, const void * b);
+
+/* for sorting the report, see macro_dir_report() */
+typedef struct RANKED_DIR {
+
+   unsigned long       count;
+   const char        * path;
+   const MACRO_DIR   * dir;
+
+}RANKED_DIR;
+
+void macro_dir_tree_init(MACRO_DIR_TREE * tree)
+{
+    memset(tree, 0, sizeof(MACRO_DIR_TREE));
+    str_pool_init(&tree->paths);
+}
+
+void macro_dir_tree_free(MACRO_DIR_TREE * tree)
+{
+    if (tree == NULL) {
+        return;
+    }
+
+    str_pool_free(&tree->paths);
+    free(tree->dirs);
+    tree->dirs = NULL;
+}
+
+int macro_dir_add_file(MACRO_DIR_TREE * tree, const char * path, unsigned long defines, unsigned long uses)
+{
+    const char * slash = strrchr(path, '/');
+    unsigned int id;
+
+    assert(tree != NULL);
+    assert(path != NULL);
+
+    /* a file without directory belongs to ".", "/x.c" to "/" */
+    if (slash == NULL) {
+        path  = ".";
+        slash = path + 1;
+    } else if (slash == path) {
+        slash++;
+    }
+
+    if (find_or_add_dir(tree, path, slash - path, &id) != 0) {
+        return -1;
+    }
+
+    tree->dirs[id].files++;
+    tree->dirs[id].defines += defines;
+    tree->dirs[id].uses    += uses;
+
+    return 0;
+}
+
+void macro_dir_rollup(MACRO_DIR_TREE * tree)
+{
+    unsigned int nums = macro_dir_nums(tree);
+    unsigned int tops = 0;
+    unsigned int id;
+    MACRO_DIR * dir;
+    MACRO_DIR * parent;
+
+    for (id = 0; id < nums; id++) {
+        dir = &tree->dirs[id];
+        dir->total_files   = dir->files;
+        dir->total_defines = dir->defines;
+        dir->total_uses    = dir->uses;
+        if (dir->parent == 0) {
+            tree->top = id;
+            tops++;
+        }
+    }
+
+    /* children have bigger ids than their parent, so this is post-order */
+    for (id = nums; id-- > 0; ) {
+        dir = &tree->dirs[id];
+        if (dir->parent != 0) {
+            parent = &tree->dirs[dir->parent - 1];
+            parent->total_files   += dir->total_files;
+            parent->total_defines += dir->total_defines;
+            parent->total_uses    += dir->total_uses;
+        }
+    }
+
+    /* go down from the single top while nothing branches off, several tops(absolute and relative paths mixed) stay at depth 0 */
+    if (tops == 1) {
+        while (tree->dirs[tree->top].files == 0 && tree->dirs[tree->top].child_nums == 1) {
+            for (id = tree->top + 1; tree->dirs[id].parent != tree->top + 1; id++) {
+            }
+            tree->top = id;
+        }
+    }
+
+    /* parents first, so each depth comes from an already set one */
+    for (id = 0; id < nums; id++) {
+        dir = &tree->dirs[id];
+        if (dir->parent == 0 || (tops == 1 && id == tree->top)) {
+            dir->depth = tops == 1 && id != tree->top ? -1 : 0;
+        } else {
+            parent = &tree->dirs[dir->parent - 1];
+            dir->depth = parent->depth < 0 ? -1 : parent->depth + 1;
+        }
+    }
+}
+
+int macro_dir_report(MACRO_DIR_TREE * tree, int depth, int by, FILE * out)
+{
+    unsigned int nums = macro_dir_nums(tree);
+    unsigned int ranked_nums = 0;
+    unsigned int id;
+    unsigned int k;
+    RANKED_DIR * ranked;
+    const MACRO_DIR * dir;
+
+    static const char * by_names[] = { "uses", "defines", "files" };
+
+    macro_dir_rollup(tree);
+
+    if ((ranked = malloc((nums + 1) * sizeof(RANKED_DIR))) == NULL) {
+        return -1;
+    }
+
+    for (id = 0; id < nums; id++) {
+        dir = &tree->dirs[id];
+
+        /* above the common top, or not at the depth asked for */
+        if (dir->depth < 0 || (depth != MACRO_DIR_ALL_DEPTHS && dir->depth != depth)) {
+            continue;
+        }
+
+        ranked[ranked_nums].dir  = dir;
+        ranked[ranked_nums].path = macro_dir_path(tree, id);
+        ranked[ranked_nums].count = by == MACRO_DIR_BY_DEFINES ? dir->total_defines :
+                                    by == MACRO_DIR_BY_FILES   ? dir->total_files : dir->total_uses;
+        ranked_nums++;
+    }
+
+    qsort(ranked, ranked_nums, sizeof(RANKED_DIR), compare_dir);
+
+    if (depth == MACRO_DIR_ALL_DEPTHS) {
+        fprintf(out, "Directories by %s:\n", by_names[by]);
+    } else {
+        fprintf(out, "Directories by %s(depth %d):\n", by_names[by], depth);
+    }
+    for (k = 0; k < ranked_nums; k++) {
+        dir = ranked[k].dir;
+        fprintf(out, "  %-60s files:%lu defines:%lu uses:%lu\n", ranked[k].path, dir->total_files, dir->total_defines, dir->total_uses);
+    }
+    fprintf(out, "-------------------------------------------\n");
+
+    /* output summary information */
+    fprintf(out,"\n------------------------------------------\n");
+    fprintf(out,"directories:%u\nlisted directories:%u\n", nums, ranked_nums);
+
+    free(ranked);
+
+    return 0;
+}
+
+/* 'len' bytes of 'path' is a directory, added after its parent if it is new */
+static int find_or_add_dir(MACRO_DIR_TREE * tree, const char * path, size_t len, unsigned int * id)
+{
+    char dir_path[4096];
+    unsigned int nums = macro_dir_nums(tree);
+    unsigned int parent = 0;
+    const char * slash;
+    unsigned int cap;
+    void * p;
+
+    if (len >= sizeof(dir_path)) {
+        len = sizeof(dir_path) - 1;
+    }
+    memcpy(dir_path, path, len);
+    dir_path[len] = '\0';
+
+    if (str_pool_lookup(&tree->paths, dir_path, id) == 0) {
+        return 0;
+    }
+
+    /* the parent first: "a/b" needs "a", "/a" needs "/", "/" and "a" have none */
+    for (slash = dir_path + len; slash > dir_path && slash[-1] != '/'; slash--) {
+    }
+    if (slash > dir_path && strcmp(dir_path, "/") != 0) {
+        if (find_or_add_dir(tree, dir_path, slash - 1 > dir_path ? (size_t)(slash - 1 - dir_path) : 1, &parent) != 0) {
+            return -1;
+        }
+        parent++;
+    }
+
+    nums = macro_dir_nums(tree);
+    if (nums == tree->dir_cap) {
+        cap = tree->dir_cap > 0 ? tree->dir_cap * 2 : 256;
+        if ((p = realloc(tree->dirs, cap * sizeof(MACRO_DIR))) == NULL) {
+            return -1;
+        }
+        tree->dirs    = p;
+        tree->dir_cap = cap;
+    }
+
+    if (str_pool_intern(&tree->paths, dir_path, len, id) != 0) {
+        return -1;
+    }
+
+    memset(&tree->dirs[*id], 0, sizeof(MACRO_DIR));
+    tree->dirs[*id].parent = parent;
+    if (parent != 0) {
+        tree->dirs[parent - 1].child_nums++;
+    }
+
+    return 0;
+}
+
+static int compare_dir(const void * a, const void * b)
+{
+    const RANKED_DIR * ra = a;
+    const RANKED_DIR * rb = b;
+
+    if (ra->count != rb->count) {
+        return ra->count > rb->count ? -1 : 1;
+    }
+
+    return strcmp(ra->path, rb->path);
+}
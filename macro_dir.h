@@ -0,0 +1,73 @@
+/*
+ * macro_dir - define and found-from counts per directory
+ *
+ * A scan with MACRO_SCAN_DIRS adds the counts of each file to its directory as soon as the
+ * file is done, so nothing is kept per site. A directory is always added after its parent,
+ * which makes every parent id smaller than the ids of its children: one walk from the last
+ * id down to the first adds each directory into its parent after all of its own children
+ * have been added into it, a post-order pass without any recursion.
+ *
+ * Depth 0 is the deepest directory holding every scanned file, so the depths do not depend
+ * on how the scanned paths were spelled.
+ */
+
+#ifndef MACRO_DIR_H
+#define MACRO_DIR_H
+
+#include <stdio.h>
+
+#include "str_pool.h"
+
+/* what macro_dir_report() sorts by */
+#define MACRO_DIR_BY_USES    0
+#define MACRO_DIR_BY_DEFINES 1
+#define MACRO_DIR_BY_FILES   2
+
+/* any depth, for macro_dir_report() */
+#define MACRO_DIR_ALL_DEPTHS (-1)
+
+typedef struct MACRO_DIR {
+
+   unsigned int     parent;         /* id of the parent directory + 1, 0 for a top directory */
+   unsigned int     child_nums;     /* directories directly below */
+   int              depth;          /* below the common top, set by macro_dir_rollup() */
+
+   unsigned long    files;          /* counts of the files directly in this directory */
+   unsigned long    defines;
+   unsigned long    uses;
+
+   unsigned long    total_files;    /* counts of the whole subtree, set by macro_dir_rollup() */
+   unsigned long    total_defines;
+   unsigned long    total_uses;
+
+}MACRO_DIR;
+
+typedef struct MACRO_DIR_TREE {
+
+   STR_POOL         paths;          /* directory paths, the id is the index in dirs[] */
+   MACRO_DIR      * dirs;
+   unsigned int     dir_cap;
+   unsigned int     top;            /* id of the common top, valid after macro_dir_rollup() */
+
+}MACRO_DIR_TREE;
+
+#define macro_dir_nums(tree)      str_pool_nums(&(tree)->paths)
+#define macro_dir_path(tree, id)  str_pool_get(&(tree)->paths, (id))
+
+void macro_dir_tree_init(MACRO_DIR_TREE * tree);
+void macro_dir_tree_free(MACRO_DIR_TREE * tree);
+
+/* add the counts of the file 'path' to its directory. returns 0, or -1 if out of memory */
+int  macro_dir_add_file(MACRO_DIR_TREE * tree, const char * path, unsigned long defines, unsigned long uses);
+
+/* fill in the subtree totals and the depths, again after more files have been added */
+void macro_dir_rollup(MACRO_DIR_TREE * tree);
+
+/*
+ * the directories at 'depth'(or at every depth with MACRO_DIR_ALL_DEPTHS) sorted by their
+ * subtree count of 'by'(MACRO_DIR_BY_xxx), highest first. Rolls the tree up first.
+ * returns 0 on success, -1 if out of memory.
+ */
+int  macro_dir_report(MACRO_DIR_TREE * tree, int depth, int by, FILE * out);
+
+#endif /* MACRO_DIR_H */
@@ -0,0 +1,248 @@
+/*
+ * macro_export - the macro table in formats editors load directly, see macro_export.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "macro_export.h"
+
+static MACRO_WRITER * writer_create(FILE * out);
+static int  writer_finish(MACRO_WRITER * w);
+static void put_json_str(MACRO_WRITER * w, const char * str);
+static void put_json_sites(MACRO_WRITER * w, const MACRO_SITE * sites, unsigned int nums, unsigned int with_value, const unsigned int * path_rank);
+
+int macro_export_ctags(const MACRO_SCAN_CTX * ctx, FILE * out, unsigned int nthreads)
+{
+    unsigned int macro_nums = str_pool_nums(&ctx->names);
+    unsigned int nums;
+    unsigned int k;
+    unsigned int i;
+    int ret = -1;
+
+    MACRO_WRITER    * w;
+    MACRO_INFO_NODE ** macros;
+    unsigned int     * path_rank;
+    MACRO_SITE       * sites;
+    const char       * path;
+
+    assert(ctx != NULL);
+    assert(out != NULL);
+
+    if (macro_scan_rank(ctx, nthreads, &macros, &path_rank) != 0) {
+        return -1;
+    }
+
+    if ((w = writer_create(out)) == NULL) {
+        goto DONE;
+    }
+
+    macro_writer_put_str(w, "!_TAG_FILE_FORMAT\t2\t/extended format; --format=1 will not append ;\" to lines/\n");
+    macro_writer_put_str(w, "!_TAG_FILE_SORTED\t1\t/0=unsorted, 1=sorted, 2=foldcase/\n");
+    macro_writer_put_str(w, "!_TAG_PROGRAM_NAME\tlist_macros\t//\n");
+
+    for (k = 0; k < macro_nums; k++) {
+        if (macros[k]->di.nums == 0) {
+            continue;
+        }
+
+        if ((sites = macro_scan_sorted_sites(&macros[k]->di, 1, path_rank, &nums)) == NULL) {
+            free(w);
+            goto DONE;
+        }
+
+        for (i = 0; i < nums; i++) {
+            path = macro_scan_path(ctx, sites[i].file);
+            if (strpbrk(path, "\t\n") != NULL) {
+                continue;
+            }
+
+            macro_writer_put_str(w, macros[k]->name);
+            macro_writer_put(w, "\t", 1);
+            macro_writer_put_str(w, path);
+            macro_writer_put(w, "\t", 1);
+            macro_writer_put_uint(w, sites[i].ln);
+            macro_writer_put(w, ";\"\td\n", 5);
+        }
+
+        free(sites);
+    }
+
+    ret = writer_finish(w);
+
+DONE:
+    free(path_rank);
+    free(macros);
+
+    return ret;
+}
+
+int macro_export_json(const MACRO_SCAN_CTX * ctx, FILE * out, unsigned int nthreads)
+{
+    unsigned int path_nums  = str_pool_nums(&ctx->paths);
+    unsigned int value_nums = str_pool_nums(&ctx->values);
+    unsigned int macro_nums = str_pool_nums(&ctx->names);
+    unsigned int id;
+    unsigned int nums;
+    unsigned int k;
+    int ret = -1;
+
+    MACRO_WRITER    * w = NULL;
+    MACRO_INFO_NODE ** macros;
+    unsigned int     * path_rank;
+    unsigned int     * ranked_paths = NULL;
+    MACRO_SITE       * sites;
+
+    assert(ctx != NULL);
+    assert(out != NULL);
+
+    if (macro_scan_rank(ctx, nthreads, &macros, &path_rank) != 0) {
+        return -1;
+    }
+
+    if ((ranked_paths = malloc((path_nums + 1) * sizeof(unsigned int))) == NULL ||
+        (w = writer_create(out)) == NULL) {
+        goto DONE;
+    }
+
+    for (id = 0; id < path_nums; id++) {
+        ranked_paths[path_rank[id]] = id;
+    }
+
+    macro_writer_put_str(w, "{\"format\":\"list_macros-index\",\"version\":1,\n\"files\":[");
+    for (k = 0; k < path_nums; k++) {
+        if (k > 0) {
+            macro_writer_put(w, ",", 1);
+        }
+        put_json_str(w, str_pool_get(&ctx->paths, ranked_paths[k]));
+    }
+
+    macro_writer_put_str(w, "],\n\"values\":[");
+    for (id = 0; id < value_nums; id++) {
+        if (id > 0) {
+            macro_writer_put(w, ",", 1);
+        }
+        put_json_str(w, str_pool_get(&ctx->values, id));
+    }
+
+    macro_writer_put_str(w, "],\n\"macros\":[");
+    for (k = 0; k < macro_nums; k++) {
+        macro_writer_put_str(w, k > 0 ? ",\n{\"name\":" : "\n{\"name\":");
+        put_json_str(w, macros[k]->name);
+
+        /* an empty list gives NULL too, nums tells which it was */
+        sites = macro_scan_sorted_sites(&macros[k]->di, 1, path_rank, &nums);
+        if (sites == NULL && macros[k]->di.nums != 0) {
+            goto DONE;
+        }
+        macro_writer_put_str(w, ",\"defines\":");
+        put_json_sites(w, sites, nums, 1, path_rank);
+        free(sites);
+
+        sites = macro_scan_sorted_sites(&macros[k]->fi, 0, path_rank, &nums);
+        if (sites == NULL && macros[k]->fi.nums != 0) {
+            goto DONE;
+        }
+        macro_writer_put_str(w, ",\"uses\":");
+        put_json_sites(w, sites, nums, 0, path_rank);
+        free(sites);
+
+        macro_writer_put(w, "}", 1);
+    }
+    macro_writer_put_str(w, "\n]}\n");
+
+    ret = writer_finish(w);
+    w = NULL;
+
+DONE:
+    free(w);
+    free(ranked_paths);
+    free(path_rank);
+    free(macros);
+
+    return ret;
+}
+
+/* the writer is too big for the stack */
+static MACRO_WRITER * writer_create(FILE * out)
+{
+    MACRO_WRITER * w;
+
+    if ((w = malloc(sizeof(MACRO_WRITER))) == NULL) {
+        return NULL;
+    }
+
+    macro_writer_init(w, out);
+
+    return w;
+}
+
+/* write out what is buffered and free 'w'. returns 0 on success, -1 if any write failed */
+static int writer_finish(MACRO_WRITER * w)
+{
+    int ret = macro_writer_flush(w);
+
+    free(w);
+
+    return ret;
+}
+
+/* 'str' quoted, with '"', '\' and control characters escaped; other bytes are copied as they are */
+static void put_json_str(MACRO_WRITER * w, const char * str)
+{
+    static const char hex[] = "0123456789abcdef";
+    const char * run = str;
+    char esc[6] = { '\\', 'u', '0', '0', 0, 0 };
+
+    macro_writer_put(w, "\"", 1);
+
+    for (; *str != '\0'; str++) {
+        if (*str != '"' && *str != '\\' && (unsigned char)*str >= 0x20) {
+            continue;
+        }
+
+        macro_writer_put(w, run, str - run);
+        run = str + 1;
+
+        if (*str == '"' || *str == '\\') {
+            esc[1] = *str;
+            macro_writer_put(w, esc, 2);
+            esc[1] = 'u';
+        } else {
+            esc[4] = hex[(unsigned char)*str >> 4];
+            esc[5] = hex[(unsigned char)*str & 0xf];
+            macro_writer_put(w, esc, 6);
+        }
+    }
+
+    macro_writer_put(w, run, str - run);
+    macro_writer_put(w, "\"", 1);
+}
+
+/* [[file,line(,value)],...] with the file as its path rank and the value as its id or null */
+static void put_json_sites(MACRO_WRITER * w, const MACRO_SITE * sites, unsigned int nums, unsigned int with_value, const unsigned int * path_rank)
+{
+    unsigned int i;
+
+    macro_writer_put(w, "[", 1);
+
+    for (i = 0; i < nums; i++) {
+        macro_writer_put_str(w, i > 0 ? ",[" : "[");
+        macro_writer_put_uint(w, path_rank[sites[i].file]);
+        macro_writer_put(w, ",", 1);
+        macro_writer_put_uint(w, sites[i].ln);
+        if (with_value) {
+            macro_writer_put(w, ",", 1);
+            if (sites[i].value == 0) {
+                macro_writer_put_str(w, "null");
+            } else {
+                macro_writer_put_uint(w, sites[i].value - 1);
+            }
+        }
+        macro_writer_put(w, "]", 1);
+    }
+
+    macro_writer_put(w, "]", 1);
+}
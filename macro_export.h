@@ -0,0 +1,47 @@
+/*
+ * macro_export - the macro table in formats editors load directly
+ *
+ * Both exporters rank the table first(see macro_scan_rank()) and then write it in one pass,
+ * macro by macro in name order, through a macro_writer buffer.
+ *
+ * ctags: a sorted "tags" file with one line per '#define' site, so an editor binary searches
+ * it for the name under the cursor:
+ *
+ *     NAME <tab> path <tab> line;" <tab> d
+ *
+ * Names are compared bytewise, which is what "!_TAG_FILE_SORTED 1" promises. A site whose
+ * path holds a tab or a newline can not be written in this format and is left out.
+ *
+ * JSON: one object with the paths and values given once and referred to by index, one macro
+ * per line so a loader may also read it line by line:
+ *
+ *     {"format":"list_macros-index","version":1,
+ *      "files":["inc/cfg.h","src/a/a.c"],
+ *      "values":["1","0"],
+ *      "macros":[
+ *       {"name":"FEATURE_A","defines":[[0,3,0]],"uses":[[1,7]]},
+ *       ...
+ *     ]}
+ *
+ * A define is [file, line, value] with value null if the define has none, a use(an
+ * '#ifdef'/'#ifndef' site) is [file, line]. Files are sorted by path, sites by (path, line).
+ */
+
+#ifndef MACRO_EXPORT_H
+#define MACRO_EXPORT_H
+
+#include <stdio.h>
+
+#include "macro_scan.h"
+#include "macro_writer.h"
+
+/*
+ * write the matrix of 'ctx'(built with MACRO_SCAN_BUILD_MATRIX) to 'out' as a ctags file.
+ * returns 0 on success, -1 on write error or if out of memory.
+ */
+int macro_export_ctags(const MACRO_SCAN_CTX * ctx, FILE * out, unsigned int nthreads);
+
+/* the same as a JSON index. returns 0 on success, -1 on write error or if out of memory */
+int macro_export_json(const MACRO_SCAN_CTX * ctx, FILE * out, unsigned int nthreads);
+
+#endif /* MACRO_EXPORT_H */
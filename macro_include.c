@@ -0,0 +1,498 @@
+/*
+ * macro_include - include graph and visible '#define' sites, see macro_include.h
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/param.h>
+
+#include "macro_include.h"
+
+#define BITS_PER_WORD (8 * sizeof(unsigned long))
+
+/* state of Tarjan's strongly connected components walk, with its own call stack */
+typedef struct SCC_WALK {
+
+   MACRO_INCLUDE_GRAPH * graph;
+   unsigned int        * index;      /* visit order + 1, 0 means not visited */
+   unsigned int        * lowlink;
+   unsigned char       * on_stack;
+   unsigned int        * stack;
+   unsigned int          stack_len;
+   unsigned int        * call;       /* the files being visited, innermost last */
+   unsigned int          call_len;
+   unsigned int        * next_edge;  /* file -> the edge to follow when the walk gets back to it */
+   unsigned int          next_index;
+   unsigned int          member_nums; /* members placed in scc_files so far */
+
+}SCC_WALK;
+
+static char * normalize_path(char * path);
+static int  resolve_include(const MACRO_INCLUDE_GRAPH * graph, const MACRO_INCLUDE_SITE * site,
+                            const char * const * include_paths, unsigned int include_path_nums, unsigned int * file);
+static int  lookup_candidate(const MACRO_INCLUDE_GRAPH * graph, const char * dir, size_t dir_len, const char * name, unsigned int * file);
+static void scc_enter(SCC_WALK * walk, unsigned int file);
+static void scc_visit(SCC_WALK * walk, unsigned int root);
+
+MACRO_INCLUDE_GRAPH * macro_include_graph_build(const MACRO_SCAN_CTX * ctx, const char * const * include_paths, unsigned int include_path_nums)
+{
+    MACRO_INCLUDE_GRAPH * graph;
+    SCC_WALK walk;
+    char path[MAXPATHLEN];
+    unsigned int file_nums = str_pool_nums(&ctx->paths);
+    unsigned int * resolved = NULL;
+    unsigned int id;
+    unsigned int k;
+
+    assert(ctx != NULL);
+
+    if ((graph = calloc(1, sizeof(MACRO_INCLUDE_GRAPH))) == NULL) {
+        return NULL;
+    }
+
+    memset(&walk, 0, sizeof(walk));
+
+    graph->ctx       = ctx;
+    graph->file_nums = file_nums;
+    graph->words     = (file_nums + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    graph->reach_file = file_nums;
+    str_pool_init(&graph->norm_paths);
+
+    graph->norm_to_file = malloc((file_nums + 1) * sizeof(unsigned int));
+    graph->edge_start   = calloc(file_nums + 1, sizeof(unsigned int));
+    graph->edge_to      = malloc((ctx->include_nums + 1) * sizeof(unsigned int));
+    graph->scc          = malloc((file_nums + 1) * sizeof(unsigned int));
+    graph->scc_start    = malloc((file_nums + 2) * sizeof(unsigned int));
+    graph->scc_files    = malloc((file_nums + 1) * sizeof(unsigned int));
+    graph->reach        = malloc((graph->words + 1) * sizeof(unsigned long));
+    graph->scc_reached  = malloc(file_nums + 1);
+    resolved            = malloc((ctx->include_nums + 1) * sizeof(unsigned int));
+    if (graph->norm_to_file == NULL || graph->edge_start == NULL || graph->edge_to == NULL ||
+        graph->scc == NULL || graph->scc_start == NULL || graph->scc_files == NULL ||
+        graph->reach == NULL || graph->scc_reached == NULL || resolved == NULL) {
+        goto FAILED;
+    }
+
+    /* Step 1. every scanned path under one spelling */
+    for (id = 0; id < file_nums; id++) {
+        strncpy(path, str_pool_get(&ctx->paths, id), sizeof(path) - 1);
+        path[sizeof(path) - 1] = '\0';
+        normalize_path(path);
+
+        if (str_pool_intern(&graph->norm_paths, path, strlen(path), &k) != 0) {
+            goto FAILED;
+        }
+        graph->norm_to_file[k] = id;
+    }
+
+    /* Step 2. resolve the directives. They are in scan order, so grouped by including file already */
+    for (k = 0; k < ctx->include_nums; k++) {
+        if (resolve_include(graph, &ctx->includes[k], include_paths, include_path_nums, &resolved[k]) == 0) {
+            graph->edge_start[ctx->includes[k].file + 1]++;
+        } else {
+            resolved[k] = file_nums;
+            graph->unresolved_nums++;
+        }
+    }
+
+    for (id = 0; id < file_nums; id++) {
+        graph->edge_start[id + 1] += graph->edge_start[id];
+    }
+
+    for (k = 0; k < ctx->include_nums; k++) {
+        if (resolved[k] != file_nums) {
+            graph->edge_to[graph->edge_nums++] = resolved[k];
+        }
+    }
+
+    /* Step 3. fold include cycles */
+    walk.graph    = graph;
+    walk.index    = calloc(file_nums + 1, sizeof(unsigned int));
+    walk.lowlink  = malloc((file_nums + 1) * sizeof(unsigned int));
+    walk.on_stack = calloc(file_nums + 1, 1);
+    walk.stack    = malloc((file_nums + 1) * sizeof(unsigned int));
+    walk.call     = malloc((file_nums + 1) * sizeof(unsigned int));
+    walk.next_edge = malloc((file_nums + 1) * sizeof(unsigned int));
+    if (walk.index == NULL || walk.lowlink == NULL || walk.on_stack == NULL || walk.stack == NULL ||
+        walk.call == NULL || walk.next_edge == NULL) {
+        goto FAILED;
+    }
+
+    for (id = 0; id < file_nums; id++) {
+        if (walk.index[id] == 0) {
+            scc_visit(&walk, id);
+        }
+    }
+    graph->scc_start[graph->scc_nums] = walk.member_nums;
+
+    free(walk.next_edge);
+    free(walk.call);
+    free(walk.stack);
+    free(walk.on_stack);
+    free(walk.lowlink);
+    free(walk.index);
+    free(resolved);
+
+    return graph;
+
+FAILED:
+    free(walk.next_edge);
+    free(walk.call);
+    free(walk.stack);
+    free(walk.on_stack);
+    free(walk.lowlink);
+    free(walk.index);
+    free(resolved);
+    macro_include_graph_free(graph);
+
+    return NULL;
+}
+
+void macro_include_graph_free(MACRO_INCLUDE_GRAPH * graph)
+{
+    if (graph == NULL) {
+        return;
+    }
+
+    str_pool_free(&graph->norm_paths);
+    free(graph->scc_reached);
+    free(graph->reach);
+    free(graph->scc_files);
+    free(graph->scc_start);
+    free(graph->scc);
+    free(graph->edge_to);
+    free(graph->edge_start);
+    free(graph->norm_to_file);
+    free(graph);
+}
+
+int macro_include_find_file(const MACRO_INCLUDE_GRAPH * graph, const char * path, unsigned int * file)
+{
+    char cwd[MAXPATHLEN];
+
+    assert(graph != NULL);
+    assert(path  != NULL);
+
+    if (lookup_candidate(graph, NULL, 0, path, file) == 0) {
+        return 0;
+    }
+
+    /* a relative path given for a tree that was scanned by its absolute path */
+    if (path[0] != '/' && getcwd(cwd, sizeof(cwd)) != NULL) {
+        return lookup_candidate(graph, cwd, strlen(cwd), path, file);
+    }
+
+    return -1;
+}
+
+/*
+ * Tarjan numbers a component only after every component it reaches, so the ones reachable
+ * from 'file' all have a smaller number than its own. Going down from there, each reached
+ * component marks its successors before the loop gets to them: one pass, no recursion.
+ */
+const unsigned long * macro_include_reachable(MACRO_INCLUDE_GRAPH * graph, unsigned int file)
+{
+    unsigned int from;
+    unsigned int scc;
+    unsigned int m;
+    unsigned int e;
+    unsigned int member;
+
+    assert(graph != NULL);
+    assert(file < graph->file_nums);
+
+    if (graph->reach_file == file) {
+        return graph->reach;
+    }
+
+    from = graph->scc[file];
+    memset(graph->reach, 0, (graph->words + 1) * sizeof(unsigned long));
+    memset(graph->scc_reached, 0, from + 1);
+    graph->scc_reached[from] = 1;
+    graph->reach_nums = 0;
+
+    for (scc = from + 1; scc-- > 0; ) {
+        if (!graph->scc_reached[scc]) {
+            continue;
+        }
+        graph->reach_nums++;
+
+        for (m = graph->scc_start[scc]; m < graph->scc_start[scc + 1]; m++) {
+            member = graph->scc_files[m];
+            graph->reach[member / BITS_PER_WORD] |= 1UL << (member % BITS_PER_WORD);
+
+            for (e = graph->edge_start[member]; e < graph->edge_start[member + 1]; e++) {
+                graph->scc_reached[graph->scc[graph->edge_to[e]]] = 1;
+            }
+        }
+    }
+
+    graph->reach_file = file;
+
+    return graph->reach;
+}
+
+int macro_include_report_visible(MACRO_INCLUDE_GRAPH * graph, unsigned int file, const char * macro_name, FILE * out, unsigned int nthreads)
+{
+    const MACRO_SCAN_CTX * ctx = graph->ctx;
+    const unsigned long * bits;
+    const MACRO_SITE * site;
+    MACRO_POSTINGS_ITER it;
+    MACRO_INFO_NODE ** macros;
+    unsigned int * path_rank;
+    MACRO_SITE * sites;
+    unsigned int macro_nums = str_pool_nums(&ctx->names);
+    unsigned int reachable_nums = 0;
+    unsigned int visible_nums = 0;
+    unsigned int shown;
+    unsigned int nums;
+    unsigned int k;
+    unsigned int n;
+
+    assert(graph != NULL);
+    assert(out   != NULL);
+
+    bits = macro_include_reachable(graph, file);
+
+    for (k = 0; k < graph->file_nums; k++) {
+        reachable_nums += macro_include_test(bits, k);
+    }
+
+    if (macro_scan_rank(ctx, nthreads, &macros, &path_rank) != 0) {
+        return -1;
+    }
+
+    fprintf(out, "Visible from: %s\n", macro_scan_path(ctx, file));
+    fprintf(out, "-------------------------------------------\n");
+
+    for (k = 0; k < macro_nums; k++) {
+
+        if (macro_name != NULL && strcmp(macros[k]->name, macro_name) != 0) {
+            continue;
+        }
+
+        /* only look closer at macros with at least one visible define */
+        macro_postings_iter_init(&it, macros[k]->di.data, macros[k]->di.len, 1);
+        while ((site = macro_postings_iter_next(&it)) != NULL && !macro_include_test(bits, site->file)) {
+        }
+        if (site == NULL) {
+            continue;
+        }
+
+        if ((sites = macro_scan_sorted_sites(&macros[k]->di, 1, path_rank, &nums)) == NULL) {
+            free(path_rank);
+            free(macros);
+            return -1;
+        }
+
+        fprintf(out, "Macro:  %s\n", macros[k]->name);
+        for (n = 0, shown = 0; n < nums; n++) {
+            if (macro_include_test(bits, sites[n].file)) {
+                fprintf(out,"Line%d:%s    %s\n",
+                        sites[n].ln,
+                        macro_scan_path(ctx, sites[n].file),
+                        sites[n].value != 0 ? macro_scan_value(ctx, sites[n].value) : " ");
+                shown++;
+            }
+        }
+        fprintf(out, "-------------------------------------------\n");
+
+        visible_nums += shown;
+        free(sites);
+    }
+
+    /* output summary information */
+    fprintf(out,"\n------------------------------------------\n");
+    fprintf(out,"reachable files:%u\nvisible defines:%u\ninclude directives:%u\nunresolved includes:%u\ninclude components reached:%u\n",
+            reachable_nums, visible_nums, ctx->include_nums, graph->unresolved_nums, graph->reach_nums);
+
+    free(path_rank);
+    free(macros);
+
+    return 0;
+}
+
+/*
+ * "name" is looked for next to the including file first, then both forms in the include paths.
+ * returns 0 and the file id, or -1 if no scanned file matches.
+ */
+static int resolve_include(const MACRO_INCLUDE_GRAPH * graph, const MACRO_INCLUDE_SITE * site,
+                           const char * const * include_paths, unsigned int include_path_nums, unsigned int * file)
+{
+    const char * header = str_pool_get(&graph->ctx->headers, site->header);
+    const char * includer;
+    const char * slash;
+    unsigned int k;
+
+    if (header[0] == '/') {
+        return lookup_candidate(graph, NULL, 0, header, file);
+    }
+
+    if (site->quoted) {
+        includer = macro_scan_path(graph->ctx, site->file);
+        slash    = strrchr(includer, '/');
+
+        if (lookup_candidate(graph, includer, slash == NULL ? 0 : (size_t)(slash - includer), header, file) == 0) {
+            return 0;
+        }
+    }
+
+    for (k = 0; k < include_path_nums; k++) {
+        if (lookup_candidate(graph, include_paths[k], strlen(include_paths[k]), header, file) == 0) {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/* look up dir/name(or just name when dir_len is 0) among the scanned files */
+static int lookup_candidate(const MACRO_INCLUDE_GRAPH * graph, const char * dir, size_t dir_len, const char * name, unsigned int * file)
+{
+    char path[MAXPATHLEN];
+    unsigned int id;
+    int len;
+
+    if (dir_len == 0) {
+        len = snprintf(path, sizeof(path), "%s", name);
+    } else {
+        len = snprintf(path, sizeof(path), "%.*s/%s", (int)dir_len, dir, name);
+    }
+
+    if (len < 0 || len >= (int)sizeof(path)) {
+        return -1;
+    }
+
+    if (str_pool_lookup(&graph->norm_paths, normalize_path(path), &id) != 0) {
+        return -1;
+    }
+
+    *file = graph->norm_to_file[id];
+
+    return 0;
+}
+
+/*
+ * fold '//', '/./' and 'dir/..' without touching the file system, so that the spelling in a
+ * directive matches the spelling the tree walk produced. Leading '..' of a relative path stay.
+ */
+static char * normalize_path(char * path)
+{
+    char   copy[MAXPATHLEN];
+    char * src = copy;
+    char * dst = path;
+    char * base;
+    size_t len;
+    int absolute = (path[0] == '/');
+
+    /* read from a copy, writing the '/' after a component would clobber the unread input otherwise */
+    strncpy(copy, path, sizeof(copy) - 1);
+    copy[sizeof(copy) - 1] = '\0';
+
+    if (absolute) {
+        src++;
+        dst++;
+    }
+    base = dst;
+
+    while (*src != '\0') {
+
+        len = strcspn(src, "/");
+
+        if (len == 0 || (len == 1 && src[0] == '.')) {
+            /* empty or '.' component */
+        } else if (len == 2 && src[0] == '.' && src[1] == '.' &&
+                   dst > base && !(dst - base >= 3 && strncmp(dst - 3, "../", 3) == 0 && (dst - 3 == base || dst[-4] == '/'))) {
+            /* drop the last component written, unless it is a '..' itself */
+            dst--;
+            while (dst > base && dst[-1] != '/') {
+                dst--;
+            }
+        } else if (len == 2 && src[0] == '.' && src[1] == '.' && absolute) {
+            /* '/..' is '/' */
+        } else {
+            memcpy(dst, src, len);
+            dst += len;
+            *dst++ = '/';
+        }
+
+        src += len;
+        if (*src == '/') {
+            src++;
+        }
+    }
+
+    if (dst > base) {
+        dst--;     /* the trailing '/' */
+    }
+    *dst = '\0';
+
+    return path;
+}
+
+static void scc_enter(SCC_WALK * walk, unsigned int file)
+{
+    walk->index[file]     = ++walk->next_index;
+    walk->lowlink[file]   = walk->index[file];
+    walk->next_edge[file] = walk->graph->edge_start[file];
+    walk->stack[walk->stack_len++] = file;
+    walk->on_stack[file]  = 1;
+    walk->call[walk->call_len++]   = file;
+}
+
+/* Tarjan's walk from 'root', on walk->call instead of the C stack so include depth does not matter */
+static void scc_visit(SCC_WALK * walk, unsigned int root)
+{
+    MACRO_INCLUDE_GRAPH * graph = walk->graph;
+    unsigned int file;
+    unsigned int parent;
+    unsigned int to;
+    unsigned int member;
+
+    scc_enter(walk, root);
+
+    while (walk->call_len > 0) {
+        file = walk->call[walk->call_len - 1];
+
+        /* Step 1. follow the next edge of the innermost file */
+        if (walk->next_edge[file] < graph->edge_start[file + 1]) {
+            to = graph->edge_to[walk->next_edge[file]++];
+
+            if (walk->index[to] == 0) {
+                scc_enter(walk, to);
+            } else if (walk->on_stack[to] && walk->index[to] < walk->lowlink[file]) {
+                walk->lowlink[file] = walk->index[to];
+            }
+            continue;
+        }
+
+        /* Step 2. its edges are done: return to the file that included it */
+        walk->call_len--;
+        if (walk->call_len > 0) {
+            parent = walk->call[walk->call_len - 1];
+            if (walk->lowlink[file] < walk->lowlink[parent]) {
+                walk->lowlink[parent] = walk->lowlink[file];
+            }
+        }
+
+        if (walk->lowlink[file] != walk->index[file]) {
+            continue;
+        }
+
+        /* 'file' is the root of a component, everything above it on the stack belongs to it */
+        graph->scc_start[graph->scc_nums] = walk->member_nums;
+        do {
+            member = walk->stack[--walk->stack_len];
+            walk->on_stack[member] = 0;
+            graph->scc[member] = graph->scc_nums;
+            graph->scc_files[walk->member_nums++] = member;
+        } while (member != file);
+
+        graph->scc_nums++;
+    }
+}
@@ -0,0 +1,74 @@
+/*
+ * macro_include - which '#define' sites can reach a file through its '#include' chain
+ *
+ * The '#include' directives kept by a scan(MACRO_SCAN_INCLUDES) are resolved against the
+ * directory of the including file(for "name" only) and then the include paths, in that order,
+ * like a compiler does. Names that do not resolve to a scanned file(system headers, generated
+ * files) are counted and dropped.
+ *
+ * Include cycles are folded into strongly connected components first(Tarjan, with an explicit
+ * stack, so a long chain of generated headers does not overflow the C stack), so the graph
+ * that is walked is a DAG. The files reachable from a file are found in one pass over the
+ * components in reverse topological order, which is the order Tarjan numbers them in. Only
+ * the set of the last queried file is kept, so memory stays linear in the files.
+ */
+
+#ifndef MACRO_INCLUDE_H
+#define MACRO_INCLUDE_H
+
+#include <stdio.h>
+
+#include "macro_scan.h"
+#include "str_pool.h"
+
+typedef struct MACRO_INCLUDE_GRAPH {
+
+   const MACRO_SCAN_CTX * ctx;
+
+   unsigned int     file_nums;
+   unsigned int   * edge_start;      /* file id -> first edge in edge_to, file_nums + 1 entries */
+   unsigned int   * edge_to;         /* included file ids */
+   unsigned int     edge_nums;
+   unsigned int     unresolved_nums; /* directives naming a file outside the scanned tree */
+
+   STR_POOL         norm_paths;      /* the scanned paths with '.', '..' and '//' folded */
+   unsigned int   * norm_to_file;    /* id in norm_paths -> file id */
+
+   unsigned int   * scc;             /* file id -> strongly connected component */
+   unsigned int     scc_nums;
+   unsigned int   * scc_start;       /* component -> first member in scc_files, scc_nums + 1 entries */
+   unsigned int   * scc_files;       /* file ids grouped by component */
+
+   unsigned long  * reach;           /* bitset of the file ids reach_file reaches */
+   unsigned int     reach_file;      /* file_nums until a file is queried */
+   unsigned char  * scc_reached;     /* component -> reached from reach_file */
+   unsigned int     words;           /* unsigned longs per bitset */
+   unsigned int     reach_nums;      /* components reached from reach_file */
+
+}MACRO_INCLUDE_GRAPH;
+
+/*
+ * resolve the directives of 'ctx' and build the graph. 'include_paths' are searched in order.
+ * returns NULL if out of memory.
+ */
+MACRO_INCLUDE_GRAPH * macro_include_graph_build(const MACRO_SCAN_CTX * ctx, const char * const * include_paths, unsigned int include_path_nums);
+void                  macro_include_graph_free(MACRO_INCLUDE_GRAPH * graph);
+
+/* returns 0 and the file id of 'path'(any spelling of a scanned path), or -1 if it was not scanned */
+int macro_include_find_file(const MACRO_INCLUDE_GRAPH * graph, const char * path, unsigned int * file);
+
+/*
+ * returns the bitset(bit n is file id n) of every file 'file' reaches through '#include',
+ * itself included. Owned by the graph and valid until the next call for another file.
+ */
+const unsigned long * macro_include_reachable(MACRO_INCLUDE_GRAPH * graph, unsigned int file);
+
+#define macro_include_test(bits, file) (((bits)[(file) / (8 * sizeof(unsigned long))] >> ((file) % (8 * sizeof(unsigned long)))) & 1UL)
+
+/*
+ * print the '#define' sites of 'macro_name'(or of every macro if NULL) that are visible from
+ * 'file'. returns 0 on success, -1 if out of memory.
+ */
+int macro_include_report_visible(MACRO_INCLUDE_GRAPH * graph, unsigned int file, const char * macro_name, FILE * out, unsigned int nthreads);
+
+#endif /* MACRO_INCLUDE_H */
@@ -0,0 +1,199 @@
+/*
+ * macro_postings - compressed (file id, line[, value id]) lists, see macro_postings.h
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "macro_postings.h"
+
+#define MACRO_POSTINGS_FIRST_CAP 16
+
+static size_t varint_decode_run(const unsigned char ** pp, const unsigned char * end, unsigned int * out, size_t max);
+
+void macro_postings_init(MACRO_POSTINGS * pst)
+{
+    assert(pst != NULL);
+
+    memset(pst, 0, sizeof(MACRO_POSTINGS));
+}
+
+void macro_postings_free(MACRO_POSTINGS * pst)
+{
+    if (pst == NULL) {
+        return;
+    }
+
+    free(pst->data);
+    memset(pst, 0, sizeof(MACRO_POSTINGS));
+}
+
+int macro_postings_add(MACRO_POSTINGS * pst, unsigned int file, unsigned int ln, unsigned int with_value, unsigned int value)
+{
+    unsigned char * p;
+    unsigned int cap;
+
+    assert(pst != NULL);
+
+    if (pst->nums != 0) {
+        if (file == pst->last_file && ln == pst->last_ln) {
+            return 1;
+        }
+
+        if (file < pst->last_file || (file == pst->last_file && ln < pst->last_ln)) {
+            return -1;
+        }
+    }
+
+    if (pst->cap - pst->len < MACRO_POSTINGS_MAX_SITE_LEN) {
+        cap = pst->cap == 0 ? MACRO_POSTINGS_FIRST_CAP : pst->cap * 2;
+
+        if ((p = realloc(pst->data, cap)) == NULL) {
+            return -1;
+        }
+
+        pst->data = p;
+        pst->cap  = cap;
+    }
+
+    p = pst->data + pst->len;
+
+    p += macro_varint_put(p, file - pst->last_file);
+    p += macro_varint_put(p, file == pst->last_file ? ln - pst->last_ln : ln);
+    if (with_value) {
+        p += macro_varint_put(p, value);
+    }
+
+    pst->len       = p - pst->data;
+    pst->last_file = file;
+    pst->last_ln   = ln;
+    pst->nums++;
+
+    return 0;
+}
+
+void macro_postings_iter_init(MACRO_POSTINGS_ITER * it, const unsigned char * data, size_t len, unsigned int with_value)
+{
+    assert(it != NULL);
+
+    it->p          = data;
+    it->end        = data + len;
+    it->with_value = with_value;
+    it->file       = 0;
+    it->ln         = 0;
+    it->block_len  = 0;
+    it->block_pos  = 0;
+}
+
+/*
+ * Decoding goes a block at a time: first every varint of up to MACRO_POSTINGS_BLOCK sites is
+ * unpacked into a flat array, then the deltas are resolved in a second tight loop. Keeping the
+ * byte parsing and the delta chain apart keeps both loops short and branch-light.
+ */
+const MACRO_SITE * macro_postings_iter_next(MACRO_POSTINGS_ITER * it)
+{
+    unsigned int raw[MACRO_POSTINGS_BLOCK * 3];
+    unsigned int stride = it->with_value ? 3 : 2;
+    size_t n;
+    size_t i;
+    MACRO_SITE * site;
+
+    if (it->block_pos < it->block_len) {
+        return &it->block[it->block_pos++];
+    }
+
+    n = varint_decode_run(&it->p, it->end, raw, MACRO_POSTINGS_BLOCK * stride) / stride;
+    if (n == 0) {
+        return NULL;
+    }
+
+    for (i = 0, site = it->block; i < n; i++, site++) {
+        const unsigned int * r = raw + i * stride;
+
+        if (r[0] == 0) {
+            it->ln += r[1];
+        } else {
+            it->file += r[0];
+            it->ln    = r[1];
+        }
+
+        site->file  = it->file;
+        site->ln    = it->ln;
+        site->value = it->with_value ? r[2] : 0;
+    }
+
+    it->block_len = n;
+    it->block_pos = 1;
+
+    return &it->block[0];
+}
+
+unsigned int macro_varint_put(unsigned char * buf, unsigned int v)
+{
+    unsigned int n = 0;
+
+    while (v >= 0x80) {
+        buf[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    buf[n++] = (unsigned char)v;
+
+    return n;
+}
+
+int macro_varint_get(const unsigned char ** pp, const unsigned char * end, unsigned int * v)
+{
+    const unsigned char * p = *pp;
+    unsigned int result = 0;
+    unsigned int shift  = 0;
+
+    while (p < end && shift < 35) {
+        result |= (unsigned int)(*p & 0x7F) << shift;
+        if ((*p++ & 0x80) == 0) {
+            *v  = result;
+            *pp = p;
+            return 0;
+        }
+        shift += 7;
+    }
+
+    return -1;
+}
+
+/*
+ * decode up to 'max' varints. Most deltas fit in one byte, so 8 bytes are tested at once and
+ * copied straight out when none of them has the continuation bit set.
+ */
+static size_t varint_decode_run(const unsigned char ** pp, const unsigned char * end, unsigned int * out, size_t max)
+{
+    const unsigned char * p = *pp;
+    size_t n = 0;
+    uint64_t word;
+    unsigned int i;
+
+    while (n < max) {
+
+        if (end - p >= 8 && max - n >= 8) {
+            memcpy(&word, p, 8);
+            if ((word & 0x8080808080808080ULL) == 0) {
+                for (i = 0; i < 8; i++) {
+                    out[n + i] = p[i];
+                }
+                n += 8;
+                p += 8;
+                continue;
+            }
+        }
+
+        if (macro_varint_get(&p, end, &out[n]) != 0) {
+            break;
+        }
+        n++;
+    }
+
+    *pp = p;
+
+    return n;
+}
@@ -0,0 +1,79 @@
+/*
+ * macro_postings - compressed (file id, line[, value id]) lists
+ *
+ * The sites of one macro are appended in (file id, line) order, so each entry only stores
+ * the distance to the previous one as varints:
+ *
+ *     file delta, then line delta if the file did not change or the absolute line if it did,
+ *     then value id + 1(0 for no value) for lists created with a value.
+ *
+ * A typical site takes 2 or 3 bytes instead of a 32 bytes node plus malloc overhead. The same
+ * encoding is used by the snapshot files written with macro_snapshot_save().
+ */
+
+#ifndef MACRO_POSTINGS_H
+#define MACRO_POSTINGS_H
+
+#include <stddef.h>
+
+/* how many sites macro_postings_iter_next() decodes in one go */
+#define MACRO_POSTINGS_BLOCK 64
+
+/* the longest a single encoded site can be: three 32 bits varints */
+#define MACRO_POSTINGS_MAX_SITE_LEN 15
+
+typedef struct MACRO_POSTINGS {
+
+   unsigned char * data;        /* encoded sites */
+   unsigned int    len;         /* bytes used in data */
+   unsigned int    cap;         /* bytes allocated for data */
+   unsigned int    nums;        /* how many sites */
+   unsigned int    last_file;   /* file id of the last site, the base of the next delta */
+   unsigned int    last_ln;     /* line of the last site */
+
+}MACRO_POSTINGS;
+
+typedef struct MACRO_SITE {
+
+   unsigned int    file;        /* file id */
+   unsigned int    ln;          /* line number */
+   unsigned int    value;       /* value id + 1, 0 if the define has no value or the list has no values */
+
+}MACRO_SITE;
+
+typedef struct MACRO_POSTINGS_ITER {
+
+   const unsigned char * p;     /* next undecoded byte */
+   const unsigned char * end;
+   unsigned int          with_value;
+   unsigned int          file;  /* last decoded site, the base of the next delta */
+   unsigned int          ln;
+
+   MACRO_SITE            block[MACRO_POSTINGS_BLOCK];
+   unsigned int          block_len;
+   unsigned int          block_pos;
+
+}MACRO_POSTINGS_ITER;
+
+void macro_postings_init(MACRO_POSTINGS * pst);
+void macro_postings_free(MACRO_POSTINGS * pst);
+
+/*
+ * append a site. Sites must come in increasing (file, line) order.
+ * returns 0 if added, 1 if it is the same site as the last one(nothing added), -1 if out of memory
+ * or out of order.
+ */
+int macro_postings_add(MACRO_POSTINGS * pst, unsigned int file, unsigned int ln, unsigned int with_value, unsigned int value);
+
+/* iterate over encoded sites, 'data' may be a MACRO_POSTINGS or a block read from a snapshot */
+void macro_postings_iter_init(MACRO_POSTINGS_ITER * it, const unsigned char * data, size_t len, unsigned int with_value);
+
+/* returns the next site or NULL at the end */
+const MACRO_SITE * macro_postings_iter_next(MACRO_POSTINGS_ITER * it);
+
+/* varint helpers, also used for the snapshot files. 'buf' needs 5 bytes */
+unsigned int macro_varint_put(unsigned char * buf, unsigned int v);
+/* returns 0 and advances *pp, or -1 if the varint is cut or too long */
+int macro_varint_get(const unsigned char ** pp, const unsigned char * end, unsigned int * v);
+
+#endif /* MACRO_POSTINGS_H */
@@ -0,0 +1,258 @@
+/*
+ * macro_region - how many lines each macro controls, see macro_region.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "macro_region.h"
+#include "macro_sort.h"
+
+static unsigned long union_lines(const MACRO_REGION * first, const MACRO_REGION * last);
+static int compare_region(const void * a, const void * b);
+static int compare_ranked_macro(const void * a, const void * b);
+
+/* for sorting macros by gated lines, see macro_region_report_ranked() */
+typedef struct RANKED_MACRO {
+
+   unsigned long          lines;
+   unsigned int           regions;
+   const MACRO_INFO_NODE * node;
+
+}RANKED_MACRO;
+
+MACRO_REGION_INDEX * macro_region_index_build(const MACRO_SCAN_CTX * ctx, unsigned int nthreads)
+{
+    MACRO_REGION_INDEX * index;
+    unsigned int macro_nums = str_pool_nums(&ctx->names);
+    unsigned int macro;
+    unsigned int first;
+    unsigned int last;
+    unsigned int k;
+
+    assert(ctx != NULL);
+
+    if ((index = calloc(1, sizeof(MACRO_REGION_INDEX))) == NULL) {
+        return NULL;
+    }
+
+    index->ctx         = ctx;
+    index->region_nums = ctx->region_nums;
+    index->regions     = malloc((ctx->region_nums + 1) * sizeof(MACRO_REGION));
+    index->macro_start = calloc(macro_nums + 1, sizeof(unsigned int));
+    index->macro_lines = calloc(macro_nums + 1, sizeof(unsigned long));
+    if (index->regions == NULL || index->macro_start == NULL || index->macro_lines == NULL) {
+        macro_region_index_free(index);
+        return NULL;
+    }
+
+    memcpy(index->regions, ctx->regions, ctx->region_nums * sizeof(MACRO_REGION));
+    if (macro_parallel_sort(index->regions, index->region_nums, sizeof(MACRO_REGION), compare_region, nthreads) != 0) {
+        macro_region_index_free(index);
+        return NULL;
+    }
+
+    /* where each macro's regions start */
+    for (k = 0; k < index->region_nums; k++) {
+        index->macro_start[index->regions[k].macro + 1]++;
+    }
+    for (macro = 0; macro < macro_nums; macro++) {
+        index->macro_start[macro + 1] += index->macro_start[macro];
+    }
+
+    /* the tree-wide totals, one run of regions per (macro, file) */
+    for (first = 0; first < index->region_nums; first = last) {
+        for (last = first + 1;
+             last < index->region_nums &&
+             index->regions[last].macro == index->regions[first].macro &&
+             index->regions[last].file  == index->regions[first].file;
+             last++) {
+        }
+
+        index->macro_lines[index->regions[first].macro] += union_lines(&index->regions[first], &index->regions[last]);
+    }
+
+    return index;
+}
+
+void macro_region_index_free(MACRO_REGION_INDEX * index)
+{
+    if (index == NULL) {
+        return;
+    }
+
+    free(index->macro_lines);
+    free(index->macro_start);
+    free(index->regions);
+    free(index);
+}
+
+unsigned long macro_region_lines(const MACRO_REGION_INDEX * index, unsigned int macro, unsigned int file)
+{
+    unsigned int lo = index->macro_start[macro];
+    unsigned int hi = index->macro_start[macro + 1];
+    unsigned int mid;
+    unsigned int last;
+
+    /* first region of the macro in 'file' */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (index->regions[mid].file < file) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (last = lo; last < index->macro_start[macro + 1] && index->regions[last].file == file; last++) {
+    }
+
+    return union_lines(&index->regions[lo], &index->regions[last]);
+}
+
+int macro_region_report_ranked(const MACRO_REGION_INDEX * index, FILE * out)
+{
+    const MACRO_SCAN_CTX * ctx = index->ctx;
+    unsigned int macro_nums = str_pool_nums(&ctx->names);
+    unsigned int nums = 0;
+    unsigned int macro;
+    unsigned int k;
+    unsigned long total = 0;
+    RANKED_MACRO * ranked;
+
+    if ((ranked = malloc((macro_nums + 1) * sizeof(RANKED_MACRO))) == NULL) {
+        return -1;
+    }
+
+    for (macro = 0; macro < macro_nums; macro++) {
+        if (index->macro_start[macro + 1] == index->macro_start[macro]) {
+            continue;
+        }
+
+        ranked[nums].lines   = index->macro_lines[macro];
+        ranked[nums].regions = index->macro_start[macro + 1] - index->macro_start[macro];
+        ranked[nums].node    = ctx->macros[macro];
+        total += ranked[nums].lines;
+        nums++;
+    }
+
+    qsort(ranked, nums, sizeof(RANKED_MACRO), compare_ranked_macro);
+
+    fprintf(out, "Macros by gated lines:\n");
+    for (k = 0; k < nums; k++) {
+        fprintf(out, "  %-48s lines:%lu regions:%u\n", ranked[k].node->name, ranked[k].lines, ranked[k].regions);
+    }
+    fprintf(out, "-------------------------------------------\n");
+
+    /* output summary information */
+    fprintf(out,"\n------------------------------------------\n");
+    fprintf(out,"processed files:%lu\nconditional regions:%u\ngating macro:%u\ngated lines:%lu\n",
+            ctx->file_nums, index->region_nums, nums, total);
+
+    free(ranked);
+
+    return 0;
+}
+
+int macro_region_report_macro(const MACRO_REGION_INDEX * index, const char * macro_name, const char * file, FILE * out)
+{
+    const MACRO_SCAN_CTX * ctx = index->ctx;
+    const MACRO_REGION * region;
+    unsigned int macro;
+    unsigned int file_id = 0;
+    unsigned int k;
+
+    if (str_pool_lookup(&ctx->names, macro_name, &macro) != 0) {
+        return -1;
+    }
+
+    if (file != NULL && str_pool_lookup(&ctx->paths, file, &file_id) != 0) {
+        return -1;
+    }
+
+    fprintf(out, "Macro:  %s\n", macro_name);
+    fprintf(out, "Gated regions:\n");
+    for (k = index->macro_start[macro]; k < index->macro_start[macro + 1]; k++) {
+        region = &index->regions[k];
+
+        if (file != NULL && region->file != file_id) {
+            continue;
+        }
+
+        if (region->else_ln != 0) {
+            fprintf(out, "Line%u-%u(else %u):%s    %s\n", region->start, region->end, region->else_ln,
+                    macro_scan_path(ctx, region->file), region->negated ? "#ifndef" : "#ifdef");
+        } else {
+            fprintf(out, "Line%u-%u:%s    %s\n", region->start, region->end,
+                    macro_scan_path(ctx, region->file), region->negated ? "#ifndef" : "#ifdef");
+        }
+    }
+    fprintf(out, "-------------------------------------------\n");
+
+    if (file != NULL) {
+        fprintf(out, "gated lines in %s:%lu\n", file, macro_region_lines(index, macro, file_id));
+    }
+    fprintf(out, "gated lines in tree:%lu\n", macro_region_total(index, macro));
+
+    return 0;
+}
+
+/*
+ * lines covered by the regions [first, last) of one macro in one file, which are sorted by
+ * start. Nested or overlapping regions are merged so no line is counted twice.
+ */
+static unsigned long union_lines(const MACRO_REGION * first, const MACRO_REGION * last)
+{
+    unsigned long lines = 0;
+    unsigned int  lo = 0;
+    unsigned int  hi = 0;    /* the merged interval [lo, hi) of lines being built */
+    const MACRO_REGION * region;
+
+    for (region = first; region < last; region++) {
+        if (region->start + 1 >= hi) {
+            lines += hi - lo;
+            lo = region->start + 1;
+            hi = region->end;
+        } else if (region->end > hi) {
+            hi = region->end;
+        }
+
+        if (hi < lo) {
+            hi = lo;
+        }
+    }
+
+    return lines + (hi - lo);
+}
+
+static int compare_region(const void * a, const void * b)
+{
+    const MACRO_REGION * ra = a;
+    const MACRO_REGION * rb = b;
+
+    if (ra->macro != rb->macro) {
+        return ra->macro < rb->macro ? -1 : 1;
+    }
+    if (ra->file != rb->file) {
+        return ra->file < rb->file ? -1 : 1;
+    }
+    if (ra->start != rb->start) {
+        return ra->start < rb->start ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static int compare_ranked_macro(const void * a, const void * b)
+{
+    const RANKED_MACRO * ra = a;
+    const RANKED_MACRO * rb = b;
+
+    if (ra->lines != rb->lines) {
+        return ra->lines > rb->lines ? -1 : 1;
+    }
+
+    return strcmp(ra->node->name, rb->node->name);
+}
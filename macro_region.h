@@ -0,0 +1,53 @@
+/*
+ * macro_region - how many lines each macro controls
+ *
+ * A scan with MACRO_SCAN_REGIONS keeps every '#ifdef NAME'/'#ifndef NAME' ... '#endif' as an
+ * interval(start, else, end). The index sorts those intervals by (macro, file, start) once, so
+ * "lines gated by NAME in file F" is a binary search plus a walk over NAME's intervals in F, and
+ * "lines gated by NAME in the whole tree" is a lookup.
+ *
+ * The lines gated by a region are the lines between the '#ifdef' and its '#endif', both branches.
+ * Nested regions of the same macro are counted once.
+ */
+
+#ifndef MACRO_REGION_H
+#define MACRO_REGION_H
+
+#include <stdio.h>
+
+#include "macro_scan.h"
+
+typedef struct MACRO_REGION_INDEX {
+
+   const MACRO_SCAN_CTX * ctx;
+
+   MACRO_REGION   * regions;       /* ctx->regions sorted by (macro, file, start) */
+   unsigned int     region_nums;
+   unsigned int   * macro_start;   /* macro id -> first region of the macro, macro nums + 1 entries */
+   unsigned long  * macro_lines;   /* macro id -> lines gated in the whole tree */
+
+}MACRO_REGION_INDEX;
+
+/* returns NULL if out of memory */
+MACRO_REGION_INDEX * macro_region_index_build(const MACRO_SCAN_CTX * ctx, unsigned int nthreads);
+void                 macro_region_index_free(MACRO_REGION_INDEX * index);
+
+/* lines gated by the macro in one file */
+unsigned long macro_region_lines(const MACRO_REGION_INDEX * index, unsigned int macro, unsigned int file);
+
+/* lines gated by the macro in the whole tree */
+#define macro_region_total(index, macro) ((index)->macro_lines[(macro)])
+
+/*
+ * every macro that guards code, the ones controlling the most lines first.
+ * returns 0 on success, -1 if out of memory.
+ */
+int macro_region_report_ranked(const MACRO_REGION_INDEX * index, FILE * out);
+
+/*
+ * the regions of one macro, in one file or in all of them if 'file' is NULL.
+ * returns 0 on success, -1 if the macro or the file is unknown.
+ */
+int macro_region_report_macro(const MACRO_REGION_INDEX * index, const char * macro_name, const char * file, FILE * out);
+
+#endif /* MACRO_REGION_H */
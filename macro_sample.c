@@ -0,0 +1,707 @@
+/*
+ * macro_sample - approximate statistics from a sample of the files, see macro_sample.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <assert.h>
+
+#include "macro_sample.h"
+
+/* 95% of a normal distribution is within this many standard deviations */
+#define Z_95 1.96
+
+/* size classes of 4 times the one before, enough for any unsigned long size */
+#define SIZE_CLASSES 33
+
+static int  on_listed(void * user, const char * path, const struct stat * st);
+static void on_define(void * user, const char * name, const char * fpath, unsigned int ln, const char * value);
+static void on_found(void * user, const char * name, const char * fpath, unsigned int ln);
+static int  see_name(MACRO_SAMPLE * sample, const char * name, unsigned int * pid);
+static int  merge_strata(MACRO_SAMPLE * sample, int by_size);
+static void plan_strata(MACRO_SAMPLE * sample, unsigned int wanted);
+static void stratum_done(MACRO_SAMPLE * sample, MACRO_SAMPLE_STRATUM * stratum);
+static void sketch_add(MACRO_SAMPLE * sample, const char * name, double weight);
+static double sketch_estimate(const MACRO_SAMPLE * sample, const char * name);
+static void candidates_add(MACRO_SAMPLE * sample, const char * name, double weight);
+static unsigned int random_below(MACRO_SAMPLE * sample, unsigned int n);
+static void estimate_total(const MACRO_SAMPLE * sample, int uses, double * total, double * margin);
+static int  compare_candidate(const void * a, const void * b);
+
+/* for sorting the candidates by their sketch estimate, see macro_sample_report() */
+typedef struct RANKED_CANDIDATE {
+
+   double                          estimate;
+   const MACRO_SAMPLE_CANDIDATE  * candidate;
+
+}RANKED_CANDIDATE;
+
+int macro_sample_init(MACRO_SAMPLE * sample, double fraction, unsigned long long seed, unsigned int top)
+{
+    assert(sample != NULL);
+    assert(fraction > 0 && fraction <= 1);
+
+    memset(sample, 0, sizeof(MACRO_SAMPLE));
+    sample->fraction = fraction;
+    sample->seed     = seed;
+    sample->rng      = seed;
+
+    str_pool_init(&sample->paths);
+    str_pool_init(&sample->strata_keys);
+    str_pool_init(&sample->names);
+
+    sample->candidate_cap = (top > 0 ? top : 1) * MACRO_SAMPLE_CANDIDATES_PER_TOP;
+    sample->candidates    = malloc(sample->candidate_cap * sizeof(MACRO_SAMPLE_CANDIDATE));
+    sample->sketch        = calloc(MACRO_SAMPLE_SKETCH_DEPTH * MACRO_SAMPLE_SKETCH_WIDTH, sizeof(double));
+    if (sample->candidates == NULL || sample->sketch == NULL) {
+        macro_sample_free(sample);
+        return -1;
+    }
+
+    return 0;
+}
+
+void macro_sample_free(MACRO_SAMPLE * sample)
+{
+    if (sample == NULL) {
+        return;
+    }
+
+    str_pool_free(&sample->paths);
+    str_pool_free(&sample->strata_keys);
+    str_pool_free(&sample->names);
+    free(sample->files);
+    free(sample->strata);
+    free(sample->name_files);
+    free(sample->name_last);
+    free(sample->name_uses);
+    free(sample->touched);
+    free(sample->sketch);
+    free(sample->candidates);
+
+    memset(sample, 0, sizeof(MACRO_SAMPLE));
+}
+
+int macro_sample_add_root(MACRO_SAMPLE * sample, const char * root)
+{
+    sample->root = root;
+
+    if (macro_scan_walk(root, on_listed, sample) < 0) {
+        return -1;
+    }
+
+    if (sample->failed) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+int macro_sample_run(MACRO_SAMPLE * sample)
+{
+    unsigned int file_nums = str_pool_nums(&sample->paths);
+    unsigned int wanted;
+    unsigned int planned;
+    unsigned int * start = NULL;     /* stratum -> first of its files in order[], strata_nums + 1 entries */
+    unsigned int * order = NULL;     /* file indexes grouped by stratum */
+    unsigned int * fill  = NULL;
+    unsigned int h;
+    unsigned int k;
+    unsigned int pick;
+    unsigned int tmp;
+    MACRO_SAMPLE_STRATUM * stratum;
+    MACRO_SCAN_CALLBACKS cb = { on_define, on_found, NULL, NULL };
+    MACRO_SCAN_CTX * ctx = NULL;
+    const char * path;
+    int ret = -1;
+
+    /* Step 1. merge the strata while 2 files of each would be more than wanted */
+    wanted = (unsigned int)ceil(sample->fraction * file_nums);
+    if (2 * sample->strata_nums > wanted && merge_strata(sample, 1) != 0) {
+        goto DONE;
+    }
+    if (2 * sample->strata_nums > wanted && merge_strata(sample, 0) != 0) {
+        goto DONE;
+    }
+
+    start = calloc(sample->strata_nums + 1, sizeof(unsigned int));
+    fill  = calloc(sample->strata_nums + 1, sizeof(unsigned int));
+    order = malloc((file_nums + 1) * sizeof(unsigned int));
+    cb.user = sample;
+    if (start == NULL || fill == NULL || order == NULL || (ctx = macro_scan_create(&cb, 0)) == NULL) {
+        errno = ENOMEM;
+        goto DONE;
+    }
+
+    /* Step 2. how many files of each stratum */
+    plan_strata(sample, wanted);
+
+    /* Step 3. group the files by stratum */
+    for (k = 0; k < file_nums; k++) {
+        start[sample->files[k].stratum + 1]++;
+    }
+    for (h = 0; h < sample->strata_nums; h++) {
+        start[h + 1] += start[h];
+    }
+    for (k = 0; k < file_nums; k++) {
+        h = sample->files[k].stratum;
+        order[start[h] + fill[h]++] = k;
+    }
+
+    /*
+     * Step 4. draw each stratum's files(the first ones of a partial shuffle) and scan them. A file
+     *         that can not be read is replaced by the next draw from the same stratum, until the
+     *         planned number has been read or the stratum runs out of files.
+     */
+    for (h = 0; h < sample->strata_nums; h++) {
+        stratum = &sample->strata[h];
+        planned = stratum->sampled;
+        stratum->sampled = 0;
+
+        for (k = 0; stratum->sampled < planned && k < stratum->file_nums; k++) {
+            pick = start[h] + k + random_below(sample, stratum->file_nums - k);
+            tmp = order[start[h] + k];
+            order[start[h] + k] = order[pick];
+            order[pick] = tmp;
+
+            path = str_pool_get(&sample->paths, sample->files[order[start[h] + k]].path);
+
+            sample->file_pos++;
+            sample->file_defines = 0;
+            sample->file_uses    = 0;
+
+            if (macro_scan_file(ctx, path) != 0) {
+                if (errno == ENOMEM) {
+                    goto DONE;
+                }
+                fprintf(stderr,"Read file(%s) failed:%s\n",path,strerror(errno));
+                continue;
+            }
+
+            if (sample->failed) {
+                errno = ENOMEM;
+                goto DONE;
+            }
+
+            stratum->defines    += sample->file_defines;
+            stratum->defines_sq += (double)sample->file_defines * sample->file_defines;
+            stratum->uses       += sample->file_uses;
+            stratum->uses_sq    += (double)sample->file_uses * sample->file_uses;
+            stratum->sampled++;
+            sample->scanned++;
+        }
+
+        /* weigh the stratum's sites by the files that were read */
+        stratum_done(sample, stratum);
+    }
+
+    ret = 0;
+
+DONE:
+    macro_scan_destroy(ctx);
+    free(order);
+    free(fill);
+    free(start);
+
+    return ret;
+}
+
+void macro_sample_report(const MACRO_SAMPLE * sample, unsigned int top, FILE * out)
+{
+    unsigned int file_nums = str_pool_nums(&sample->paths);
+    unsigned int name_nums = str_pool_nums(&sample->names);
+    unsigned int q1 = 0;
+    unsigned int q2 = 0;
+    unsigned int id;
+    unsigned int k;
+    double total;
+    double margin;
+    double chao2;
+    double m = sample->scanned;
+    RANKED_CANDIDATE * ranked;
+
+    fprintf(out, "Sampled %u of %u files in %u strata(%.1f%%), seed %llu\n",
+            sample->scanned, file_nums, sample->strata_nums,
+            file_nums > 0 ? 100.0 * sample->scanned / file_nums : 0.0, sample->seed);
+
+    fprintf(out, "Estimated(95%% confidence):\n");
+    estimate_total(sample, 0, &total, &margin);
+    fprintf(out, "  define sites:       %.0f +/- %.0f\n", total, margin);
+    estimate_total(sample, 1, &total, &margin);
+    fprintf(out, "  found-from sites:   %.0f +/- %.0f\n", total, margin);
+
+    /* Chao2 from the macros seen in exactly one and exactly two sampled files */
+    for (id = 0; id < name_nums; id++) {
+        q1 += sample->name_files[id] == 1;
+        q2 += sample->name_files[id] == 2;
+    }
+    chao2 = name_nums;
+    if (sample->scanned < file_nums && m > 0) {
+        chao2 += (m - 1) / m * q1 * (q1 > 0 ? q1 - 1.0 : 0.0) / (2.0 * (q2 + 1));
+    }
+    fprintf(out, "  macros:             %.0f(%u seen, Chao2)\n", chao2, name_nums);
+
+    fprintf(out, "Most used macros(estimated found-from sites):\n");
+    if ((ranked = malloc((sample->candidate_nums + 1) * sizeof(RANKED_CANDIDATE))) != NULL) {
+        for (k = 0; k < sample->candidate_nums; k++) {
+            ranked[k].candidate = &sample->candidates[k];
+            ranked[k].estimate  = sketch_estimate(sample, sample->candidates[k].name);
+        }
+
+        qsort(ranked, sample->candidate_nums, sizeof(RANKED_CANDIDATE), compare_candidate);
+
+        for (k = 0; k < sample->candidate_nums && k < top; k++) {
+            fprintf(out, "  %-48s ~%.0f\n", ranked[k].candidate->name, ranked[k].estimate);
+        }
+
+        free(ranked);
+    }
+    fprintf(out, "-------------------------------------------\n");
+
+    /* output summary information */
+    fprintf(out,"\n------------------------------------------\n");
+    fprintf(out,"listed files:%u\nsampled files:%u\nsketch overestimate at most:%.0f(98%%)\n",
+            file_nums, sample->scanned, exp(1.0) / MACRO_SAMPLE_SKETCH_WIDTH * sample->sketch_total);
+}
+
+/* see macro_sample_add_root(), the listing stops when out of memory */
+static int on_listed(void * user, const char * path, const struct stat * st)
+{
+    MACRO_SAMPLE * sample = user;
+    char key[MAX_PATH_LEN + 16];
+    const char * rel = path + strlen(sample->root);
+    const char * slash;
+    unsigned long size = (unsigned long)st->st_size;
+    unsigned int size_class = 0;
+    unsigned int path_id;
+    unsigned int stratum;
+    unsigned int nums;
+    unsigned int cap;
+    void * p;
+
+    if (sample->failed) {
+        return 1;
+    }
+
+    while (*rel == '/') {
+        rel++;
+    }
+
+    /* the top directory below the root, "." for the files in the root itself */
+    slash = strchr(rel, '/');
+    for (; size >= 4; size /= 4) {
+        size_class++;
+    }
+    if (slash != NULL) {
+        snprintf(key, sizeof(key), "%.*s\t%u", (int)(slash - path), path, size_class);
+    } else {
+        snprintf(key, sizeof(key), "%s/.\t%u", sample->root, size_class);
+    }
+
+    nums = str_pool_nums(&sample->paths);
+    if (str_pool_intern(&sample->paths, path, strlen(path), &path_id) != 0) {
+        goto FAILED;
+    }
+    if (str_pool_nums(&sample->paths) == nums) {
+        /* listed under another root already */
+        return 0;
+    }
+
+    if (nums == sample->file_cap) {
+        cap = sample->file_cap > 0 ? sample->file_cap * 2 : 1024;
+        if ((p = realloc(sample->files, cap * sizeof(MACRO_SAMPLE_FILE))) == NULL) {
+            goto FAILED;
+        }
+        sample->files    = p;
+        sample->file_cap = cap;
+    }
+
+    nums = str_pool_nums(&sample->strata_keys);
+    if (str_pool_intern(&sample->strata_keys, key, strlen(key), &stratum) != 0) {
+        goto FAILED;
+    }
+    if (stratum == nums) {
+        if (nums == sample->strata_cap) {
+            cap = sample->strata_cap > 0 ? sample->strata_cap * 2 : 64;
+            if ((p = realloc(sample->strata, cap * sizeof(MACRO_SAMPLE_STRATUM))) == NULL) {
+                goto FAILED;
+            }
+            sample->strata     = p;
+            sample->strata_cap = cap;
+        }
+        memset(&sample->strata[stratum], 0, sizeof(MACRO_SAMPLE_STRATUM));
+        sample->strata_nums++;
+    }
+
+    sample->files[path_id].path    = path_id;
+    sample->files[path_id].stratum = stratum;
+    sample->files[path_id].size    = (unsigned long)st->st_size;
+    sample->strata[stratum].file_nums++;
+    sample->strata[stratum].bytes += (unsigned long)st->st_size;
+
+    return 0;
+
+FAILED:
+    sample->failed = 1;
+    return 1;
+}
+
+static void on_define(void * user, const char * name, const char * fpath, unsigned int ln, const char * value)
+{
+    MACRO_SAMPLE * sample = user;
+
+    (void)fpath;
+    (void)ln;
+    (void)value;
+
+    sample->file_defines++;
+    if (see_name(sample, name, NULL) != 0) {
+        sample->failed = 1;
+    }
+}
+
+static void on_found(void * user, const char * name, const char * fpath, unsigned int ln)
+{
+    MACRO_SAMPLE * sample = user;
+    unsigned int id;
+    unsigned int cap;
+    void * p;
+
+    (void)fpath;
+    (void)ln;
+
+    sample->file_uses++;
+    if (see_name(sample, name, &id) != 0) {
+        sample->failed = 1;
+        return;
+    }
+
+    /* counted until the stratum is done and its weight known, see stratum_done() */
+    if (sample->name_uses[id]++ == 0) {
+        if (sample->touched_nums == sample->touched_cap) {
+            cap = sample->touched_cap > 0 ? sample->touched_cap * 2 : 1024;
+            if ((p = realloc(sample->touched, cap * sizeof(unsigned int))) == NULL) {
+                sample->failed = 1;
+                return;
+            }
+            sample->touched     = p;
+            sample->touched_cap = cap;
+        }
+        sample->touched[sample->touched_nums++] = id;
+    }
+}
+
+/* count the sampled files each macro is seen in, for Chao2. 'pid' may be NULL */
+static int see_name(MACRO_SAMPLE * sample, const char * name, unsigned int * pid)
+{
+    unsigned int nums = str_pool_nums(&sample->names);
+    unsigned int id;
+    unsigned int cap;
+    void * p;
+
+    if (str_pool_intern(&sample->names, name, strlen(name), &id) != 0) {
+        return -1;
+    }
+
+    if (id == nums) {
+        if (nums == sample->name_cap) {
+            cap = sample->name_cap > 0 ? sample->name_cap * 2 : 1024;
+            if ((p = realloc(sample->name_files, cap * sizeof(unsigned int))) == NULL) {
+                return -1;
+            }
+            sample->name_files = p;
+            if ((p = realloc(sample->name_last, cap * sizeof(unsigned int))) == NULL) {
+                return -1;
+            }
+            sample->name_last = p;
+            if ((p = realloc(sample->name_uses, cap * sizeof(unsigned int))) == NULL) {
+                return -1;
+            }
+            sample->name_uses = p;
+            sample->name_cap  = cap;
+        }
+        sample->name_files[id] = 0;
+        sample->name_last[id]  = 0;
+        sample->name_uses[id]  = 0;
+    }
+
+    if (sample->name_last[id] != sample->file_pos) {
+        sample->name_last[id] = sample->file_pos;
+        sample->name_files[id]++;
+    }
+
+    if (pid != NULL) {
+        *pid = id;
+    }
+
+    return 0;
+}
+
+/*
+ * put the strata together: by their size class if 'by_size', else all into one.
+ * returns 0, or -1 with errno set if out of memory
+ */
+static int merge_strata(MACRO_SAMPLE * sample, int by_size)
+{
+    unsigned int file_nums = str_pool_nums(&sample->paths);
+    unsigned int class_group[SIZE_CLASSES];   /* size class -> merged stratum + 1 */
+    unsigned int * group;                     /* stratum -> merged stratum */
+    unsigned int group_nums = 0;
+    unsigned int size_class;
+    unsigned int h;
+    unsigned int k;
+    const char * tab;
+    MACRO_SAMPLE_STRATUM * merged;
+
+    group  = malloc((sample->strata_nums + 1) * sizeof(unsigned int));
+    merged = calloc(sample->strata_nums + 1, sizeof(MACRO_SAMPLE_STRATUM));
+    if (group == NULL || merged == NULL) {
+        free(group);
+        free(merged);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    memset(class_group, 0, sizeof(class_group));
+    for (h = 0; h < sample->strata_nums; h++) {
+        size_class = 0;
+        if (by_size && (tab = strrchr(str_pool_get(&sample->strata_keys, h), '\t')) != NULL) {
+            size_class = (unsigned int)atoi(tab + 1) % SIZE_CLASSES;
+        }
+        if (class_group[size_class] == 0) {
+            class_group[size_class] = ++group_nums;
+        }
+        group[h] = class_group[size_class] - 1;
+    }
+
+    for (h = 0; h < sample->strata_nums; h++) {
+        merged[group[h]].file_nums += sample->strata[h].file_nums;
+        merged[group[h]].bytes     += sample->strata[h].bytes;
+    }
+    memcpy(sample->strata, merged, group_nums * sizeof(MACRO_SAMPLE_STRATUM));
+
+    for (k = 0; k < file_nums; k++) {
+        sample->files[k].stratum = group[sample->files[k].stratum];
+    }
+    sample->strata_nums = group_nums;
+
+    free(merged);
+    free(group);
+
+    return 0;
+}
+
+/*
+ * set 'sampled' of each stratum to the files to draw from it, 'wanted' in all: 2 of each(all of
+ * a smaller one), the rest in proportion to the bytes of the strata that have files left
+ */
+static void plan_strata(MACRO_SAMPLE * sample, unsigned int wanted)
+{
+    MACRO_SAMPLE_STRATUM * stratum;
+    unsigned int left = wanted;
+    unsigned int given;
+    unsigned int add;
+    unsigned int h;
+    double total;
+    double share;
+
+    for (h = 0; h < sample->strata_nums; h++) {
+        stratum = &sample->strata[h];
+        stratum->sampled = stratum->file_nums < 2 ? stratum->file_nums : 2;
+        if (stratum->sampled > left) {
+            /* only when merged into one stratum and a single file is wanted */
+            stratum->sampled = left;
+        }
+        left -= stratum->sampled;
+    }
+
+    while (left > 0) {
+        total = 0;
+        for (h = 0; h < sample->strata_nums; h++) {
+            stratum = &sample->strata[h];
+            if (stratum->sampled < stratum->file_nums) {
+                total += stratum->bytes > 0 ? stratum->bytes : 1;
+            }
+        }
+        if (total == 0) {
+            break;
+        }
+
+        /* rounded down, so never more than is left */
+        given = 0;
+        for (h = 0; h < sample->strata_nums; h++) {
+            stratum = &sample->strata[h];
+            if (stratum->sampled == stratum->file_nums) {
+                continue;
+            }
+            share = (stratum->bytes > 0 ? stratum->bytes : 1) / total;
+            add = (unsigned int)(left * share);
+            if (add > stratum->file_nums - stratum->sampled) {
+                add = stratum->file_nums - stratum->sampled;
+            }
+            stratum->sampled += add;
+            given += add;
+        }
+
+        /* too little left to share out: a file each while it lasts */
+        if (given == 0) {
+            for (h = 0; h < sample->strata_nums && given < left; h++) {
+                stratum = &sample->strata[h];
+                if (stratum->sampled < stratum->file_nums) {
+                    stratum->sampled++;
+                    given++;
+                }
+            }
+        }
+
+        left -= given;
+    }
+}
+
+/* the stratum has been scanned: add its found-from sites, weighted by N/n, to the sketch and candidates */
+static void stratum_done(MACRO_SAMPLE * sample, MACRO_SAMPLE_STRATUM * stratum)
+{
+    const char * name;
+    unsigned int id;
+    unsigned int k;
+
+    stratum->weight = stratum->sampled > 0 ? (double)stratum->file_nums / stratum->sampled : 0;
+
+    for (k = 0; k < sample->touched_nums; k++) {
+        id   = sample->touched[k];
+        name = str_pool_get(&sample->names, id);
+
+        sketch_add(sample, name, sample->name_uses[id] * stratum->weight);
+        candidates_add(sample, name, sample->name_uses[id] * stratum->weight);
+        sample->name_uses[id] = 0;
+    }
+
+    sample->touched_nums = 0;
+}
+
+/* row k uses h1 + k * h2, two hashes are enough for a count-min sketch */
+static void sketch_add(MACRO_SAMPLE * sample, const char * name, double weight)
+{
+    unsigned int h1 = str_pool_hash(name, strlen(name));
+    unsigned int h2 = ((h1 * 0x9E3779B1U) ^ (h1 >> 16)) | 1;
+    unsigned int k;
+
+    for (k = 0; k < MACRO_SAMPLE_SKETCH_DEPTH; k++) {
+        sample->sketch[k * MACRO_SAMPLE_SKETCH_WIDTH + ((h1 + k * h2) & (MACRO_SAMPLE_SKETCH_WIDTH - 1))] += weight;
+    }
+    sample->sketch_total += weight;
+}
+
+static double sketch_estimate(const MACRO_SAMPLE * sample, const char * name)
+{
+    unsigned int h1 = str_pool_hash(name, strlen(name));
+    unsigned int h2 = ((h1 * 0x9E3779B1U) ^ (h1 >> 16)) | 1;
+    unsigned int k;
+    double v;
+    double min = 0;
+
+    for (k = 0; k < MACRO_SAMPLE_SKETCH_DEPTH; k++) {
+        v = sample->sketch[k * MACRO_SAMPLE_SKETCH_WIDTH + ((h1 + k * h2) & (MACRO_SAMPLE_SKETCH_WIDTH - 1))];
+        if (k == 0 || v < min) {
+            min = v;
+        }
+    }
+
+    return min;
+}
+
+/* space-saving: a new name takes the place of the smallest candidate and inherits its count */
+static void candidates_add(MACRO_SAMPLE * sample, const char * name, double weight)
+{
+    MACRO_SAMPLE_CANDIDATE * candidate;
+    unsigned int min = 0;
+    unsigned int k;
+
+    for (k = 0; k < sample->candidate_nums; k++) {
+        if (strcmp(sample->candidates[k].name, name) == 0) {
+            sample->candidates[k].count += weight;
+            return;
+        }
+        if (sample->candidates[k].count < sample->candidates[min].count) {
+            min = k;
+        }
+    }
+
+    if (sample->candidate_nums < sample->candidate_cap) {
+        candidate = &sample->candidates[sample->candidate_nums++];
+        candidate->count = weight;
+        candidate->error = 0;
+    } else {
+        candidate = &sample->candidates[min];
+        candidate->error = candidate->count;
+        candidate->count += weight;
+    }
+
+    snprintf(candidate->name, sizeof(candidate->name), "%s", name);
+}
+
+/* xorshift64*, the seed decides the whole sample */
+static unsigned int random_below(MACRO_SAMPLE * sample, unsigned int n)
+{
+    unsigned long long x = sample->rng != 0 ? sample->rng : 0x9E3779B97F4A7C15ULL;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    sample->rng = x;
+
+    return (unsigned int)(((x * 0x2545F4914F6CDD1DULL) >> 32) % n);
+}
+
+/* stratified estimate of a total and its 95% margin */
+static void estimate_total(const MACRO_SAMPLE * sample, int uses, double * total, double * margin)
+{
+    unsigned int strata_nums = sample->strata_nums;
+    unsigned int h;
+    const MACRO_SAMPLE_STRATUM * stratum;
+    double n;
+    double N;
+    double sum;
+    double sum_sq;
+    double s2;
+    double variance = 0;
+
+    *total = 0;
+
+    for (h = 0; h < strata_nums; h++) {
+        stratum = &sample->strata[h];
+        N = stratum->file_nums;
+        n = stratum->sampled;
+        sum    = uses ? stratum->uses    : stratum->defines;
+        sum_sq = uses ? stratum->uses_sq : stratum->defines_sq;
+
+        if (n == 0) {
+            continue;
+        }
+
+        *total += N / n * sum;
+
+        if (n > 1) {
+            s2 = (sum_sq - sum * sum / n) / (n - 1);
+            variance += N * N * (1 - n / N) * s2 / n;
+        }
+    }
+
+    *margin = Z_95 * sqrt(variance > 0 ? variance : 0);
+}
+
+static int compare_candidate(const void * a, const void * b)
+{
+    const RANKED_CANDIDATE * ra = a;
+    const RANKED_CANDIDATE * rb = b;
+
+    if (ra->estimate != rb->estimate) {
+        return ra->estimate > rb->estimate ? -1 : 1;
+    }
+
+    return strcmp(ra->candidate->name, rb->candidate->name);
+}
@@ -0,0 +1,125 @@
+/*
+ * macro_sample - approximate statistics from a sample of the files
+ *
+ * The wanted files below the roots are listed first(names and sizes only) and put into strata
+ * by their top directory below the root and their size class(each class 4 times the size of
+ * the one before). The sample is never more than the fraction asked for: each stratum gets 2
+ * of its files(all of a smaller one), the rest is spread over the strata in proportion to their
+ * bytes, and the files are drawn at random inside each stratum. When there are too many strata
+ * for 2 files each, they are merged into their size classes, and if that is still too many,
+ * into a single stratum.
+ *
+ * Only the sampled files are scanned, through the scan callbacks, so no macro table is built:
+ *
+ *   - define and found-from totals are extrapolated per stratum(N/n times the sampled sum) with
+ *     a 95% confidence interval from the spread of the per file counts in each stratum,
+ *   - the number of distinct macros is the Chao2 estimate from how many sampled files each
+ *     macro was seen in,
+ *   - found-from sites per macro go, weighted by N/n of their stratum(n being the files of it
+ *     that were read, not the ones drawn), into a count-min sketch,
+ *     and the most used macros are tracked with a space-saving list of candidates; their
+ *     estimates come from the sketch, which can only overestimate.
+ */
+
+#ifndef MACRO_SAMPLE_H
+#define MACRO_SAMPLE_H
+
+#include <stdio.h>
+
+#include "macro_scan.h"
+#include "str_pool.h"
+
+#define MACRO_SAMPLE_SKETCH_DEPTH  4
+#define MACRO_SAMPLE_SKETCH_WIDTH  (1 << 14)
+
+/* the candidates kept for the most used macros, per macro asked for */
+#define MACRO_SAMPLE_CANDIDATES_PER_TOP 4
+
+typedef struct MACRO_SAMPLE_FILE {
+
+   unsigned int     path;           /* id in paths */
+   unsigned int     stratum;
+   unsigned long    size;
+
+}MACRO_SAMPLE_FILE;
+
+typedef struct MACRO_SAMPLE_STRATUM {
+
+   unsigned int     file_nums;      /* N, files in the stratum */
+   unsigned int     sampled;        /* n, files drawn from it and scanned */
+   unsigned long    bytes;
+   double           weight;         /* N/n, once the stratum has been scanned */
+
+   double           defines;        /* sum and sum of squares of the per file counts of the sample */
+   double           defines_sq;
+   double           uses;
+   double           uses_sq;
+
+}MACRO_SAMPLE_STRATUM;
+
+/* a candidate for the most used macros, kept by space-saving */
+typedef struct MACRO_SAMPLE_CANDIDATE {
+
+   char             name[MAX_MACRO_NAME_LEN];
+   double           count;
+   double           error;          /* count it may have inherited from the candidate it replaced */
+
+}MACRO_SAMPLE_CANDIDATE;
+
+typedef struct MACRO_SAMPLE {
+
+   double                   fraction;        /* of the files to scan, 0 < fraction <= 1 */
+   unsigned long long       seed;
+   unsigned long long       rng;
+
+   STR_POOL                 paths;
+   MACRO_SAMPLE_FILE      * files;
+   unsigned int             file_cap;
+
+   STR_POOL                 strata_keys;     /* "top directory <tab> size class", the id is the stratum until merged */
+   MACRO_SAMPLE_STRATUM   * strata;
+   unsigned int             strata_nums;
+   unsigned int             strata_cap;
+   const char             * root;            /* the root being listed, see macro_sample_add_root() */
+   int                      failed;          /* a callback ran out of memory */
+
+   /* the file being scanned */
+   unsigned int             file_pos;        /* how many sampled files have been started */
+   unsigned long            file_defines;
+   unsigned long            file_uses;
+   unsigned int             scanned;
+
+   /* distinct macros, for Chao2 */
+   STR_POOL                 names;
+   unsigned int           * name_files;      /* name id -> sampled files it was seen in */
+   unsigned int           * name_last;       /* name id -> file_pos it was last seen in */
+   unsigned int           * name_uses;       /* name id -> found-from sites in the current stratum */
+   unsigned int             name_cap;
+   unsigned int           * touched;         /* name ids with name_uses set */
+   unsigned int             touched_nums;
+   unsigned int             touched_cap;
+
+   double                 * sketch;          /* MACRO_SAMPLE_SKETCH_DEPTH rows of MACRO_SAMPLE_SKETCH_WIDTH */
+   double                   sketch_total;
+   MACRO_SAMPLE_CANDIDATE * candidates;
+   unsigned int             candidate_nums;
+   unsigned int             candidate_cap;
+
+}MACRO_SAMPLE;
+
+/*
+ * 'top' is how many of the most used macros will be reported.
+ * returns 0, or -1 if out of memory.
+ */
+int  macro_sample_init(MACRO_SAMPLE * sample, double fraction, unsigned long long seed, unsigned int top);
+void macro_sample_free(MACRO_SAMPLE * sample);
+
+/* list the wanted files below 'root'. returns 0, or -1 with errno set */
+int  macro_sample_add_root(MACRO_SAMPLE * sample, const char * root);
+
+/* draw the sample and scan it. returns 0, or -1 with errno set if out of memory */
+int  macro_sample_run(MACRO_SAMPLE * sample);
+
+void macro_sample_report(const MACRO_SAMPLE * sample, unsigned int top, FILE * out);
+
+#endif /* MACRO_SAMPLE_H */
@@ -0,0 +1,1726 @@
+/*
+ * macro_scan - the scanning library behind list_macros, see macro_scan.h
+ */
+
+/*
+ *
+ * 1  EXTERNAL RESOURCES
+ *
+ *     1.1 Include Files
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "macro_scan.h"
+#include "macro_sort.h"
+
+/*  2   LOCAL CONSTANTS AND MACROS  */
+//#define DEBUG
+
+/* conditional directives, see directive_kind() */
+#define DIRECTIVE_NONE   0
+#define DIRECTIVE_IF     1     /* '#if', also '#ifdef'/'#ifndef' used as header protection */
+#define DIRECTIVE_IFDEF  2
+#define DIRECTIVE_IFNDEF 3
+#define DIRECTIVE_ELSE   4     /* '#else' and '#elif' */
+#define DIRECTIVE_ENDIF  5
+
+/* put all illegal characters contains in the macro name here...MUST END BY '\0' */
+static const char _illegal_chars[] = {'(',')','\\','"','#','*','{','}','\0'};
+
+static const char * _skip_files[] = { "testscript_dodo.c",
+                                      NULL };
+
+/* the extensions we scan, compared case insensitively */
+static const char * _source_exts[] = { "c", "cc", "cpp", "h", "hi", "inc",
+                                       NULL };
+
+/* an '#if' level that has not seen its '#endif' yet, see macro_scan_buffer() */
+typedef struct OPEN_REGION {
+
+   unsigned int   macro;      /* macro id, if has_macro */
+   unsigned int   has_macro;  /* 0 for '#if' and header protection, nothing is recorded for them */
+   unsigned int   negated;
+   unsigned int   start;
+   unsigned int   else_ln;
+
+}OPEN_REGION;
+
+/*  3   Local Function Prototypes  */
+static MACRO_INFO_NODE * find_or_add_macro(MACRO_SCAN_CTX * ctx, const char * macro_name);
+static int  append_define_info_into_matrix(MACRO_SCAN_CTX * ctx,const char * macro_name,unsigned int file,const char * value,unsigned int line_number);
+static int  append_found_from_info_into_matrix(MACRO_SCAN_CTX * ctx,const char * macro_name,unsigned int file,unsigned int line_number,unsigned int * macro_id);
+static int  append_region(MACRO_SCAN_CTX * ctx, const OPEN_REGION * open, unsigned int file, unsigned int end);
+static int  directive_kind(const char * line);
+static int  parse_found_from_line(char * line, char * macro_mname);
+static int  parse_define_line(char * line, char * macro_mname, char * macro_value);
+static int  parse_include_line(char * line, char * header, unsigned int * quoted);
+static int  append_include(MACRO_SCAN_CTX * ctx, unsigned int file, const char * header, unsigned int quoted, unsigned int line_number);
+static int  macro_matrix_index(const char * macro_name);
+static int  remember_file(MACRO_SCAN_CTX * ctx, const char * path, unsigned int * file, const char ** fpath);
+static int  remember_root(MACRO_SCAN_CTX * ctx, const char * root);
+static int  scan_targets(MACRO_SCAN_CTX * ctx, unsigned int file, const char * fpath, const char * buf, size_t len);
+static int  finish_file(MACRO_SCAN_CTX * ctx, const char * fpath, size_t len, unsigned long define_nums, unsigned long found_nums);
+static int  scan_walked_file(void * user, const char * path, const struct stat * st);
+static size_t define_name_offset(const char * line);
+static void define_value(const char * pcursor, char * macro_value);
+static void free_macro_matrix(MACRO_MATRIX_ELEMENT * macro_matrix);
+static int  dump_macro(const MACRO_SCAN_CTX * ctx, const MACRO_INFO_NODE * pnode, const unsigned int * path_rank, FILE * out);
+static int  compare_macro_by_name(const void * a, const void * b);
+static int  compare_path_by_name(const void * a, const void * b);
+static int  compare_ranked_site(const void * a, const void * b);
+static unsigned int macro_have_illegal_characters(const char * str);
+static int  is_header_guard(const char * pcursor);
+static char * ltrim(char * str);
+
+/* a decoded site keyed by the rank of its path, see macro_scan_sorted_sites() */
+typedef struct RANKED_SITE {
+
+   unsigned int   path;       /* rank of the path */
+   MACRO_SITE     site;
+
+}RANKED_SITE;
+
+typedef struct PATH_RANK {
+
+   const char   * path;
+   unsigned int   id;         /* file id in ctx->paths */
+
+}PATH_RANK;
+
+/*  4   MODULE CODE */
+
+MACRO_SCAN_CTX * macro_scan_create(const MACRO_SCAN_CALLBACKS * cb, unsigned int flags)
+{
+    MACRO_SCAN_CTX * ctx = calloc(1, sizeof(MACRO_SCAN_CTX));
+
+    if (ctx == NULL) {
+        return NULL;
+    }
+
+    if (cb != NULL) {
+        ctx->cb = *cb;
+    }
+    ctx->flags = flags;
+
+    str_pool_init(&ctx->paths);
+    str_pool_init(&ctx->names);
+    str_pool_init(&ctx->values);
+    str_pool_init(&ctx->roots);
+    str_pool_init(&ctx->headers);
+    macro_dir_tree_init(&ctx->dirs);
+
+    return ctx;
+}
+
+void macro_scan_destroy(MACRO_SCAN_CTX * ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+
+    free_macro_matrix(&ctx->matrix[0]);
+
+    /* free the memory for saving file path, names and values */
+    str_pool_free(&ctx->paths);
+    str_pool_free(&ctx->names);
+    str_pool_free(&ctx->values);
+    str_pool_free(&ctx->roots);
+    str_pool_free(&ctx->headers);
+    macro_dir_tree_free(&ctx->dirs);
+    free(ctx->macros);
+    free(ctx->includes);
+    free(ctx->regions);
+
+    free(ctx);
+}
+
+int macro_scan_path_is_wanted(const char * path)
+{
+    unsigned int idx = 0;
+    const char * ext;
+    const char * base;
+
+    assert(path != NULL);
+
+    base = strrchr(path, '/');
+    base = (base == NULL) ? path : base + 1;
+
+    if ((ext = strrchr(base, '.')) == NULL) {
+        return 0;
+    }
+    ext++;
+
+    while (_source_exts[idx] != NULL && strcasecmp(ext, _source_exts[idx]) != 0) {
+        idx++;
+    }
+
+    if (_source_exts[idx] == NULL) {
+        return 0;
+    }
+
+    /* make sure the file is not in skip list */
+    for (idx = 0; _skip_files[idx] != NULL; idx++) {
+        if (strstr(path, _skip_files[idx]) != NULL) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int macro_scan_tree(MACRO_SCAN_CTX * ctx, const char * root)
+{
+    assert(ctx  != NULL);
+    assert(root != NULL);
+
+    if (remember_root(ctx, root) != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return macro_scan_walk(root, scan_walked_file, ctx) < 0 ? -1 : 0;
+}
+
+/*
+ * Walk 'root' depth first like 'find' does: symbolic links to directories are not followed,
+ * 'on_file' is called for every regular file(or link to one) with a wanted name.
+ */
+int macro_scan_walk(const char * root, MACRO_WALK_CALLBACK on_file, void * user)
+{
+    DIR * dir;
+    struct dirent * entry;
+    struct stat st;
+    char path[MAX_PATH_LEN];
+    int len;
+
+    assert(root    != NULL);
+    assert(on_file != NULL);
+
+    if (lstat(root, &st) != 0) {
+        return -1;
+    }
+
+    if (!S_ISDIR(st.st_mode)) {
+        if (!macro_scan_path_is_wanted(root)) {
+            return 0;
+        }
+
+        if (S_ISLNK(st.st_mode) && (stat(root, &st) != 0 || !S_ISREG(st.st_mode))) {
+            return 0;
+        }
+
+        return on_file(user, root, &st) != 0 ? 1 : 0;
+    }
+
+    if ((dir = opendir(root)) == NULL) {
+        fprintf(stderr,"Open directory(%s) failed:%s\n",root,strerror(errno));
+        return 0;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        len = snprintf(path, sizeof(path), "%s%s%s", root,
+                       (root[0] != '\0' && root[strlen(root) - 1] == '/') ? "" : "/", entry->d_name);
+        if (len < 0 || len >= (int)sizeof(path)) {
+            fprintf(stderr,"Path too long, skipped: %s/%s\n",root,entry->d_name);
+            continue;
+        }
+
+        if (macro_scan_walk(path, on_file, user) == 1) {
+            closedir(dir);
+            return 1;
+        }
+    }
+
+    closedir(dir);
+
+    return 0;
+}
+
+/* see macro_scan_tree(), the walk stops once a budgeted scan is interrupted */
+static int scan_walked_file(void * user, const char * path, const struct stat * st)
+{
+    MACRO_SCAN_CTX * ctx = user;
+
+    (void)st;
+
+    if (ctx->budget != NULL && macro_budget_interrupted()) {
+        return 1;
+    }
+
+    if (macro_scan_file(ctx, path) != 0) {
+        fprintf(stderr,"Read file(%s) failed:%s\n",path,strerror(errno));
+    }
+
+    return 0;
+}
+
+int macro_scan_file(MACRO_SCAN_CTX * ctx, const char * path)
+{
+    FILE * fd = NULL;
+    char * buf;
+    long   len;
+    int    ret;
+
+    assert(ctx  != NULL);
+    assert(path != NULL);
+
+    if (ctx->budget != NULL) {
+        macro_budget_open(ctx->budget);
+    }
+
+    if ((fd = fopen(path,"rb")) == NULL) {
+        return -1;
+    }
+
+    if (fseek(fd, 0, SEEK_END) != 0 || (len = ftell(fd)) < 0 || fseek(fd, 0, SEEK_SET) != 0) {
+        fclose(fd);
+        return -1;
+    }
+
+    if (ctx->budget != NULL) {
+        macro_budget_read(ctx->budget, len);
+    }
+
+    if ((buf = malloc(len + 1)) == NULL) {
+        fclose(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (len > 0 && fread(buf, 1, len, fd) != (size_t)len) {
+        free(buf);
+        fclose(fd);
+        errno = EIO;
+        return -1;
+    }
+
+    if (ctx->budget != NULL) {
+        macro_budget_drop_cache(fileno(fd));
+    }
+
+    fclose(fd);
+
+    ret = macro_scan_buffer(ctx, path, buf, len);
+
+    free(buf);
+
+    return ret;
+}
+
+/*
+ * Go through the buffer line by line, looking for '#ifdef'/'#ifndef' and '#define' in one go.
+ * Lines longer than MAX_LINE_LEN are cut, only the head of them is looked at.
+ */
+int macro_scan_buffer(MACRO_SCAN_CTX * ctx, const char * path, const char * buf, size_t len)
+{
+    const char * pcursor = buf;
+    const char * pend    = buf + len;
+    const char * eol;
+    const char * fpath;
+    const char * value;
+    size_t line_len;
+    unsigned int line_number = 0;
+    unsigned int file = 0;
+    unsigned int quoted;
+    unsigned int macro_id = 0;
+    unsigned int have_id;        /* macro_id was set for the current line */
+    unsigned int depth = 0;      /* '#if' nesting, may go past MAX_REGION_DEPTH */
+    int kind = DIRECTIVE_NONE;
+    int ret;
+    unsigned long define_nums = ctx->define_nums;    /* to count the sites of this file */
+    unsigned long found_nums  = ctx->found_nums;
+
+    OPEN_REGION open[MAX_REGION_DEPTH];
+
+    char line[MAX_LINE_LEN];
+    char macro_mname[MAX_MACRO_NAME_LEN];
+    char macro_value[MAX_MACRO_VALUE_LEN];
+    char header[MAX_PATH_LEN];
+
+    assert(ctx  != NULL);
+    assert(path != NULL);
+    assert(buf  != NULL || len == 0);
+
+    if ((ret = remember_file(ctx, path, &file, &fpath)) > 0) {
+        /* the path has been scanned already */
+        return 0;
+    }
+    if (ret < 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+#ifdef DEBUG
+    fprintf(stdout,"Scanning %s.....\n",fpath);
+    fprintf(stdout,"-----------------------------\n");
+#endif
+
+    if (ctx->targets != NULL) {
+        if (scan_targets(ctx, file, fpath, buf, len) != 0 ||
+            finish_file(ctx, fpath, len, define_nums, found_nums) != 0) {
+            errno = ENOMEM;
+            return -1;
+        }
+
+        return 0;
+    }
+
+    while (pcursor < pend) {
+
+        if ((eol = memchr(pcursor, '\n', pend - pcursor)) == NULL) {
+            eol = pend;
+        }
+
+        line_number++;
+
+        line_len = eol - pcursor;
+        if (line_len > MAX_LINE_LEN - 1) {
+            line_len = MAX_LINE_LEN - 1;
+        }
+        memcpy(line, pcursor, line_len);
+        line[line_len] = '\0';
+
+        pcursor = eol + 1;
+
+        /* keep the '#if' nesting for the conditional regions */
+        if ((ctx->flags & MACRO_SCAN_REGIONS) && (ctx->flags & MACRO_SCAN_BUILD_MATRIX)) {
+            kind = directive_kind(line);
+
+            if (kind == DIRECTIVE_IF || kind == DIRECTIVE_IFDEF || kind == DIRECTIVE_IFNDEF) {
+                if (depth < MAX_REGION_DEPTH) {
+                    open[depth].has_macro = 0;
+                    open[depth].negated   = (kind == DIRECTIVE_IFNDEF);
+                    open[depth].start     = line_number;
+                    open[depth].else_ln   = 0;
+                }
+                depth++;
+            } else if (kind == DIRECTIVE_ELSE && depth > 0 && depth <= MAX_REGION_DEPTH) {
+                if (open[depth - 1].else_ln == 0) {
+                    open[depth - 1].else_ln = line_number;
+                }
+            } else if (kind == DIRECTIVE_ENDIF && depth > 0) {
+                depth--;
+                if (depth < MAX_REGION_DEPTH && open[depth].has_macro &&
+                    append_region(ctx, &open[depth], file, line_number) != 0) {
+                    errno = ENOMEM;
+                    return -1;
+                }
+            }
+        }
+
+        if (parse_found_from_line(line, macro_mname)) {
+#ifdef DEBUG
+            fprintf(stdout,"%s at line%d\n",macro_mname,line_number);
+#endif
+            have_id = 0;
+            if (ctx->flags & MACRO_SCAN_BUILD_MATRIX) {
+                if (append_found_from_info_into_matrix(ctx,macro_mname,file,line_number,&macro_id) != 0) {
+                    errno = ENOMEM;
+                    return -1;
+                }
+                have_id = 1;
+            }
+
+            /* the level just opened is guarded by this macro, regions refer to it by id */
+            if (have_id && (kind == DIRECTIVE_IFDEF || kind == DIRECTIVE_IFNDEF) && depth <= MAX_REGION_DEPTH) {
+                open[depth - 1].has_macro = 1;
+                open[depth - 1].macro     = macro_id;
+            }
+
+            if (ctx->cb.on_found != NULL) {
+                ctx->cb.on_found(ctx->cb.user, macro_mname, fpath, line_number);
+            }
+
+            ctx->found_nums++;
+            ctx->macro_nums++;
+        }
+
+        if (parse_define_line(line, macro_mname, macro_value)) {
+#ifdef DEBUG
+            fprintf(stdout,">>%s,%s,%d\n",macro_mname,macro_value,line_number);
+#endif
+            value = macro_value[0] == '\0' ? NULL : macro_value;
+
+            if ((ctx->flags & MACRO_SCAN_BUILD_MATRIX) &&
+                append_define_info_into_matrix(ctx,macro_mname,file,value,line_number) != 0) {
+                errno = ENOMEM;
+                return -1;
+            }
+
+            if (ctx->cb.on_define != NULL) {
+                ctx->cb.on_define(ctx->cb.user, macro_mname, fpath, line_number, value);
+            }
+
+            ctx->define_nums++;
+            ctx->macro_nums++;
+        }
+
+        if ((ctx->flags & MACRO_SCAN_INCLUDES) && (ctx->flags & MACRO_SCAN_BUILD_MATRIX) &&
+            parse_include_line(line, header, &quoted) &&
+            append_include(ctx, file, header, quoted, line_number) != 0) {
+            errno = ENOMEM;
+            return -1;
+        }
+
+        kind = DIRECTIVE_NONE;
+    }
+
+    /* close what is left open at the end of the file */
+    while (depth > 0) {
+        depth--;
+        if (depth < MAX_REGION_DEPTH && open[depth].has_macro &&
+            append_region(ctx, &open[depth], file, line_number + 1) != 0) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    if (finish_file(ctx, fpath, len, define_nums, found_nums) != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+void macro_scan_set_targets(MACRO_SCAN_CTX * ctx, const MACRO_TARGETS * targets)
+{
+    assert(ctx != NULL);
+
+    ctx->targets = targets;
+}
+
+void macro_scan_set_budget(MACRO_SCAN_CTX * ctx, MACRO_BUDGET * budget)
+{
+    assert(ctx != NULL);
+
+    ctx->budget = budget;
+}
+
+/*
+ * one pass of the target automaton over the whole buffer, see macro_scan_set_targets().
+ * returns 0 on success, -1 if out of memory.
+ */
+static int scan_targets(MACRO_SCAN_CTX * ctx, unsigned int file, const char * fpath, const char * buf, size_t len)
+{
+    MACRO_TARGET_ITER iter;
+    const char * name;
+    const char * pline;
+    const char * eol;
+    const char * value;
+    const char * parsed = NULL;    /* the line parsed last */
+    size_t offset;
+    size_t line_len;
+    unsigned int target;
+    unsigned int ln;
+    unsigned int macro_id;
+    unsigned int is_define;
+    size_t name_len;
+    size_t name_offset = 0;        /* where NAME is in the parsed line, 0 if it is no '#define' */
+
+    char line[MAX_LINE_LEN];
+    char macro_value[MAX_MACRO_VALUE_LEN];
+
+    macro_target_iter_init(&iter, ctx->targets, buf, len);
+
+    while (macro_target_iter_next(&iter, &target, &ln, &pline, &offset)) {
+
+        name = macro_targets_name(ctx->targets, target);
+
+        /* parse a line once, whatever number of names it has */
+        if (pline != parsed) {
+            parsed = pline;
+
+            if ((eol = memchr(pline, '\n', buf + len - pline)) == NULL) {
+                eol = buf + len;
+            }
+            line_len = eol - pline;
+            if (line_len > MAX_LINE_LEN - 1) {
+                line_len = MAX_LINE_LEN - 1;
+            }
+            memcpy(line, pline, line_len);
+            line[line_len] = '\0';
+
+            name_offset = define_name_offset(line);
+        }
+
+        /* only the whole name right after '#define' is defined, the value may use other targets */
+        name_len  = strlen(name);
+        is_define = name_offset != 0 && offset == name_offset && offset + name_len <= line_len &&
+                    !isalnum((int)line[offset + name_len]) && line[offset + name_len] != '_';
+        value = NULL;
+        if (is_define) {
+            define_value(line + offset + name_len, macro_value);
+            value = macro_value[0] != '\0' ? macro_value : NULL;
+        }
+
+        if (is_define) {
+            if ((ctx->flags & MACRO_SCAN_BUILD_MATRIX) &&
+                append_define_info_into_matrix(ctx, name, file, value, ln) != 0) {
+                return -1;
+            }
+
+            if (ctx->cb.on_define != NULL) {
+                ctx->cb.on_define(ctx->cb.user, name, fpath, ln, value);
+            }
+
+            ctx->define_nums++;
+        } else {
+            if ((ctx->flags & MACRO_SCAN_BUILD_MATRIX) &&
+                append_found_from_info_into_matrix(ctx, name, file, ln, &macro_id) != 0) {
+                return -1;
+            }
+
+            if (ctx->cb.on_found != NULL) {
+                ctx->cb.on_found(ctx->cb.user, name, fpath, ln);
+            }
+
+            ctx->found_nums++;
+        }
+
+        ctx->macro_nums++;
+    }
+
+    return 0;
+}
+
+/*
+ * where NAME starts in a '#define NAME' line, 0 if the line is no '#define'. Unlike
+ * parse_define_line() any name and value are taken, e.g. '#define FOO (1)' or '#define FOO(x) x'.
+ */
+static size_t define_name_offset(const char * line)
+{
+    const char * pcursor = line;
+
+    while (isspace((int)*pcursor)) {
+        pcursor++;
+    }
+
+    if (*pcursor++ != '#') {
+        return 0;
+    }
+
+    while (isspace((int)*pcursor)) {
+        pcursor++;
+    }
+
+    if (strncmp(pcursor, "define", 6) != 0 || !isspace((int)pcursor[6])) {
+        return 0;
+    }
+    pcursor += 6;
+
+    while (isspace((int)*pcursor)) {
+        pcursor++;
+    }
+
+    return pcursor - line;
+}
+
+/*
+ * the value of the '#define' whose name ends at 'pcursor': the first word after it, up to a
+ * comment. A function-like macro('NAME(' without space) has no value, neither has '#define NAME'.
+ */
+static void define_value(const char * pcursor, char * macro_value)
+{
+    int idx = 0;
+
+    if (*pcursor != '(') {
+        while (isspace((int)*pcursor)) {
+            pcursor++;
+        }
+
+        while (*pcursor != '\0' && !isspace((int)*pcursor) && idx < MAX_MACRO_VALUE_LEN - 1) {
+            if (*pcursor == '/' && (*(pcursor+1) == '*' || *(pcursor+1) == '/')) {
+                break;
+            }
+            macro_value[idx++] = *pcursor++;
+        }
+    }
+
+    macro_value[idx] = '\0';
+}
+
+/*
+ * count the file, and its sites for its directory with MACRO_SCAN_DIRS. 'define_nums' and
+ * 'found_nums' are the context's counts before the file was scanned, 'len' its size for the budget.
+ * returns 0 on success, -1 if out of memory.
+ */
+static int finish_file(MACRO_SCAN_CTX * ctx, const char * fpath, size_t len, unsigned long define_nums, unsigned long found_nums)
+{
+    ctx->file_nums++;
+
+    if (ctx->cb.on_file_done != NULL) {
+        ctx->cb.on_file_done(ctx->cb.user, fpath);
+    }
+
+    if (ctx->budget != NULL) {
+        macro_budget_file_done(ctx->budget, len);
+    }
+
+    if (!(ctx->flags & MACRO_SCAN_DIRS)) {
+        return 0;
+    }
+
+    return macro_dir_add_file(&ctx->dirs, fpath, ctx->define_nums - define_nums, ctx->found_nums - found_nums);
+}
+
+/*
+ * intern the path when building the matrix, the postings refer to it by file id. Otherwise
+ * the path is only needed during the callbacks.
+ * returns 0 on success, 1 if the path has been scanned before, -1 if out of memory.
+ */
+static int remember_file(MACRO_SCAN_CTX * ctx, const char * path, unsigned int * file, const char ** fpath)
+{
+    unsigned int nums = str_pool_nums(&ctx->paths);
+
+    if (!(ctx->flags & MACRO_SCAN_BUILD_MATRIX)) {
+        *fpath = path;
+        return 0;
+    }
+
+    if (str_pool_intern(&ctx->paths, path, strlen(path), file) != 0) {
+        return -1;
+    }
+
+    *fpath = str_pool_get(&ctx->paths, *file);
+
+    return str_pool_nums(&ctx->paths) == nums ? 1 : 0;
+}
+
+/*
+ * keep the directory the walked paths start with: 'root' without its trailing '/'s, or the
+ * directory part of it when it names a file. Nothing is kept for a bare file name.
+ * returns 0 on success, -1 if out of memory.
+ */
+static int remember_root(MACRO_SCAN_CTX * ctx, const char * root)
+{
+    struct stat st;
+    size_t len = strlen(root);
+    unsigned int id;
+
+    if (lstat(root, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        while (len > 0 && root[len - 1] != '/') {
+            len--;
+        }
+    }
+
+    while (len > 1 && root[len - 1] == '/') {
+        len--;
+    }
+
+    if (len == 0) {
+        return 0;
+    }
+
+    return str_pool_intern(&ctx->roots, root, len, &id);
+}
+
+/*
+ * returns 1 if the line is '#ifdef NAME' or '#ifndef NAME' no matter how many spaces between '#' and 'if'
+ * and copies NAME into macro_mname
+   e.g. #ifdef
+        # ifdef
+        #   ifdef
+ */
+static int parse_found_from_line(char * line, char * macro_mname)
+{
+    char * pcursor;  /* the cursor for the current line we are processing */
+    int idx = 0;
+
+    pcursor = ltrim(line);
+
+    if (*pcursor++ != '#') {
+        /* illegal: '#' is not the first available character */
+        return 0;
+    }
+
+    if (*pcursor != 'i' &&
+        !isspace((int)*pcursor)) {
+        /* illegal: only space or character 'i' can follow '#' */
+        return 0;
+    }
+
+    /* ignore spaces behind '#' */
+    while (isspace((int)*pcursor)) {
+        pcursor++;
+    }
+
+    if ((pcursor = strstr(line,"ifdef")) == NULL &&
+        (pcursor = strstr(line,"ifndef")) == NULL ) {
+        /* illegal: no 'ifdef' and 'ifndef' follow '#' */
+        return 0;
+    }
+
+    if ((pcursor = strpbrk(pcursor," \t")) == NULL) {
+        /* illegal: no space(s) follow #ifdef or #ifndef */
+        return 0;
+    }
+
+    /* ignore spaces between ifdef/ifndef and macro name */
+    while (isspace((int)*pcursor)) {
+        pcursor++;
+    }
+
+    /* get macro name...
+
+       return if the macro is for header file protection only,like
+       #ifnde  FOO_H
+       #define FOO_H
+       or
+       #ifnde  FOO_H_
+       #define FOO_H_
+     */
+    while (*pcursor != '\0' && !isspace((int)*pcursor) && idx < MAX_MACRO_NAME_LEN - 1) {
+
+        if (*pcursor == '/' && (*(pcursor+1) == '*' || *(pcursor+1) == '/')) {
+            /* stop seeking if meets 'slash*' and '//' after macro name */
+            break;
+        }
+
+        if (is_header_guard(pcursor)) {
+            return 0;
+        }
+
+        macro_mname[idx++] = *pcursor++;
+    }
+    macro_mname[idx] = '\0';
+
+    /* make sure we got a name that can go into the matrix */
+    return macro_matrix_index(macro_mname) >= 0;
+}
+
+/*
+ * returns 1 if the line is '#define NAME [value]' no matter how many spaces between '#' and 'define'
+ * and copies NAME into macro_mname and value into macro_value('\0' if there is no value)
+   e.g. #define
+        # define
+ */
+static int parse_define_line(char * line, char * macro_mname, char * macro_value)
+{
+    char * pcursor;  /* the cursor for the current line we are processing */
+    int idx = 0;
+
+    pcursor = ltrim(line);
+
+    if (*pcursor++ != '#') {
+        /* illegal: '#' is not the first available character */
+        return 0;
+    }
+
+    if (*pcursor != 'd' &&
+        !isspace((int)*pcursor)) {
+        /* illegal: only space or character 'd' can follow '#' */
+        return 0;
+    }
+
+    /* ignore spaces behind '#' */
+    while (isspace((int)*pcursor)) {
+        pcursor++;
+    }
+
+    if ((pcursor = strstr(line,"define")) == NULL) {
+        /* illegal: no 'define' follows '#' */
+        return 0;
+    }
+
+    if ((pcursor = strpbrk(pcursor," \t")) == NULL) {
+        /* illegal: no space(s) follow '#define' */
+        return 0;
+    }
+
+    /* ignore spaces between define and macro name */
+    while (isspace((int)*pcursor)) {
+        pcursor++;
+    }
+
+    /* get macro name...
+
+       return if the macro is for header file protection only,like
+       #ifnde  FOO_H
+       #define FOO_H
+       or
+       #ifnde  FOO_H_
+       #define FOO_H_
+     */
+    while (*pcursor != '\0' && !isspace((int)*pcursor) && idx < MAX_MACRO_NAME_LEN - 1) {
+
+        if (is_header_guard(pcursor)) {
+            return 0;
+        }
+
+        macro_mname[idx++] = *pcursor++;
+    }
+    macro_mname[idx] = '\0';
+
+    /* make sure no illegal characters in macro name */
+    if (macro_have_illegal_characters(macro_mname) || macro_matrix_index(macro_mname) < 0) {
+        return 0;
+    }
+
+    /* ignore spaces between macro name and its value */
+    while (isspace((int)*pcursor)) {
+        pcursor++;
+    }
+
+    /* get macro value */
+    idx = 0;
+    while (*pcursor != '\0' && !isspace((int)*pcursor) && idx < MAX_MACRO_VALUE_LEN - 1) {
+
+        if (*pcursor == '/' && (*(pcursor+1) == '*' || *(pcursor+1) == '/')) {
+            /* stop seeking if meets 'slash*' and '//' in macro value */
+            break;
+        }
+
+        macro_value[idx++] = *pcursor++;
+    }
+    macro_value[idx] = '\0';
+
+    /* make sure no illegal characters in macro value */
+    if (macro_have_illegal_characters(macro_value)) {
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * returns 1 if the line is '#include "name"' or '#include <name>' and copies name into header
+   e.g. #include "foo.h"
+        # include <sys/foo.h>
+ */
+static int parse_include_line(char * line, char * header, unsigned int * quoted)
+{
+    char * pcursor;  /* the cursor for the current line we are processing */
+    char   closing;
+    int idx = 0;
+
+    pcursor = ltrim(line);
+
+    if (*pcursor++ != '#') {
+        /* illegal: '#' is not the first available character */
+        return 0;
+    }
+
+    /* ignore spaces behind '#' */
+    while (isspace((int)*pcursor)) {
+        pcursor++;
+    }
+
+    if (strncmp(pcursor, "include", 7) != 0) {
+        /* illegal: no 'include' follows '#' */
+        return 0;
+    }
+    pcursor += 7;
+
+    /* ignore spaces between include and the name */
+    while (isspace((int)*pcursor)) {
+        pcursor++;
+    }
+
+    if (*pcursor == '"') {
+        closing = '"';
+        *quoted = 1;
+    } else if (*pcursor == '<') {
+        closing = '>';
+        *quoted = 0;
+    } else {
+        /* illegal: computed includes like '#include FOO_HEADER' can not be resolved */
+        return 0;
+    }
+    pcursor++;
+
+    while (*pcursor != '\0' && *pcursor != closing && idx < MAX_PATH_LEN - 1) {
+        header[idx++] = *pcursor++;
+    }
+    header[idx] = '\0';
+
+    return *pcursor == closing && idx > 0;
+}
+
+static int append_include(MACRO_SCAN_CTX * ctx, unsigned int file, const char * header, unsigned int quoted, unsigned int line_number)
+{
+    MACRO_INCLUDE_SITE * site;
+    void * p;
+
+    if (ctx->include_nums == ctx->include_cap) {
+        unsigned int cap = ctx->include_cap == 0 ? 1024 : ctx->include_cap * 2;
+
+        if ((p = realloc(ctx->includes, cap * sizeof(MACRO_INCLUDE_SITE))) == NULL) {
+            return -1;
+        }
+
+        ctx->includes    = p;
+        ctx->include_cap = cap;
+    }
+
+    site = &ctx->includes[ctx->include_nums];
+    if (str_pool_intern(&ctx->headers, header, strlen(header), &site->header) != 0) {
+        return -1;
+    }
+
+    site->file   = file;
+    site->ln     = line_number;
+    site->quoted = quoted;
+    ctx->include_nums++;
+
+    return 0;
+}
+
+/*
+ * returns which conditional directive the line is(DIRECTIVE_xxx), no matter how many spaces
+ * between '#' and the keyword
+ */
+static int directive_kind(const char * line)
+{
+    static const struct {
+        const char * keyword;
+        size_t       len;
+        int          kind;
+    } directives[] = {
+        { "ifdef",  5, DIRECTIVE_IFDEF  },
+        { "ifndef", 6, DIRECTIVE_IFNDEF },
+        { "if",     2, DIRECTIVE_IF     },
+        { "elif",   4, DIRECTIVE_ELSE   },
+        { "else",   4, DIRECTIVE_ELSE   },
+        { "endif",  5, DIRECTIVE_ENDIF  },
+        { NULL,     0, DIRECTIVE_NONE   }
+    };
+    const char * pcursor = line;
+    unsigned int i;
+
+    while (isspace((int)*pcursor)) {
+        pcursor++;
+    }
+
+    if (*pcursor++ != '#') {
+        return DIRECTIVE_NONE;
+    }
+
+    while (isspace((int)*pcursor)) {
+        pcursor++;
+    }
+
+    for (i = 0; directives[i].keyword != NULL; i++) {
+        if (strncmp(pcursor, directives[i].keyword, directives[i].len) == 0 &&
+            !isalnum((int)pcursor[directives[i].len]) && pcursor[directives[i].len] != '_') {
+            return directives[i].kind;
+        }
+    }
+
+    return DIRECTIVE_NONE;
+}
+
+/* FOO_H, FOO_h, FOO_H_ and FOO_H__ are treated as header file protection */
+static int is_header_guard(const char * pcursor)
+{
+    return *pcursor == '_' &&
+           (*(pcursor+1) == 'H' || *(pcursor+1) == 'h') &&
+           (*(pcursor+2) == '\0' || isspace((int)*(pcursor+2)) || *(pcursor+2) == '_');
+}
+
+/* returns the matrix row of the macro, or -1 if the name can not be a macro name */
+static int macro_matrix_index(const char * macro_name)
+{
+    if (macro_name[0] >= 'a' && macro_name[0] <= 'z') {
+        return macro_name[0] - 'a';
+    } else if (macro_name[0] >= 'A' && macro_name[0] <= 'Z') {
+        return macro_name[0] - 'A';
+    } else if (macro_name[0] == '_') {
+        return 26;
+    }
+
+    return -1;
+}
+
+/*
+ * returns the node of the macro, adding it to the end of its matrix row if it is new,
+ * or NULL if out of memory. The name is looked up by its interned id, so no linker is walked.
+ */
+static MACRO_INFO_NODE * find_or_add_macro(MACRO_SCAN_CTX * ctx, const char * macro_name)
+{
+    int idx = macro_matrix_index(macro_name);
+    unsigned int nums = str_pool_nums(&ctx->names);
+    unsigned int id;
+    MACRO_INFO_NODE * newnode_min;
+    void * p;
+
+    assert(idx >= 0);
+
+    if (str_pool_intern(&ctx->names, macro_name, strlen(macro_name), &id) != 0) {
+        return NULL;
+    }
+
+    if (str_pool_nums(&ctx->names) == nums) {
+        return ctx->macros[id];
+    }
+
+    /* we don have the macro yet... */
+    if (id >= ctx->macro_cap) {
+        unsigned int cap = ctx->macro_cap == 0 ? 1024 : ctx->macro_cap * 2;
+
+        if ((p = realloc(ctx->macros, cap * sizeof(MACRO_INFO_NODE *))) == NULL) {
+            return NULL;
+        }
+
+        ctx->macros    = p;
+        ctx->macro_cap = cap;
+    }
+
+    if ((newnode_min = (MACRO_INFO_NODE *)malloc(sizeof(MACRO_INFO_NODE))) == NULL) {
+        return NULL;
+    }
+
+    newnode_min->name = ctx->names.strs[id];
+    newnode_min->id   = id;
+    newnode_min->next = NULL;
+    macro_postings_init(&newnode_min->di);
+    macro_postings_init(&newnode_min->fi);
+
+    if (ctx->matrix[idx].header == NULL) {
+        ctx->matrix[idx].header = newnode_min;
+    } else {
+        ctx->matrix[idx].last->next = newnode_min;
+    }
+    ctx->matrix[idx].last = newnode_min;
+
+    ctx->macros[id] = newnode_min;
+
+    return newnode_min;
+}
+
+/*
+ * returns 0 means the site has been recorded(or it is dulicated with the last one)
+ * returns -1 if out of memory
+ */
+static int append_found_from_info_into_matrix(MACRO_SCAN_CTX * ctx,         /* in/out */
+                                              const char * macro_name,     /* in, macro name */
+                                              unsigned int file,           /* in, macro in which file */
+                                              unsigned int line_number,    /* in, the line number of the macro in the file */
+                                              unsigned int * macro_id)     /* out, the id of the macro */
+{
+    MACRO_INFO_NODE * pnode;
+
+    if ((pnode = find_or_add_macro(ctx, macro_name)) == NULL) {
+        return -1;
+    }
+
+    *macro_id = pnode->id;
+
+    return macro_postings_add(&pnode->fi, file, line_number, 0, 0) < 0 ? -1 : 0;
+}
+
+static int append_define_info_into_matrix(MACRO_SCAN_CTX * ctx,         /* in/out */
+                                          const char * macro_name,     /* in, macro name */
+                                          unsigned int file,           /* in, macro in which file */
+                                          const char * value,          /* in, macro value, can be NULL */
+                                          unsigned int line_number)    /* in, the line number of the macro in the file */
+{
+    MACRO_INFO_NODE * pnode;
+    unsigned int value_id = 0;
+
+    if ((pnode = find_or_add_macro(ctx, macro_name)) == NULL) {
+        return -1;
+    }
+
+    if (value != NULL) {
+        if (str_pool_intern(&ctx->values, value, strlen(value), &value_id) != 0) {
+            return -1;
+        }
+        value_id++;
+    }
+
+    return macro_postings_add(&pnode->di, file, line_number, 1, value_id) < 0 ? -1 : 0;
+}
+
+static int append_region(MACRO_SCAN_CTX * ctx, const OPEN_REGION * open, unsigned int file, unsigned int end)
+{
+    MACRO_REGION * region;
+    void * p;
+
+    if (ctx->region_nums == ctx->region_cap) {
+        unsigned int cap = ctx->region_cap == 0 ? 1024 : ctx->region_cap * 2;
+
+        if ((p = realloc(ctx->regions, cap * sizeof(MACRO_REGION))) == NULL) {
+            return -1;
+        }
+
+        ctx->regions    = p;
+        ctx->region_cap = cap;
+    }
+
+    region = &ctx->regions[ctx->region_nums++];
+    region->macro   = open->macro;
+    region->file    = file;
+    region->start   = open->start;
+    region->else_ln = open->else_ln;
+    region->end     = end;
+    region->negated = open->negated;
+
+    return 0;
+}
+
+static void free_macro_matrix(MACRO_MATRIX_ELEMENT * macro_matrix)
+{
+    unsigned int i;
+    MACRO_INFO_NODE * pcursor;
+    MACRO_INFO_NODE * free_cursor = NULL;
+
+    if (macro_matrix == NULL) {
+        return;
+    }
+
+    /* start going through macro matrix...from A to Z and special characters,like '_' */
+    for(i = 0; i < MAX_CHARACTER_NUMS; i++) {
+
+        pcursor = macro_matrix[i].header;
+
+        /* start going through macro info linker start... */
+        while (pcursor != NULL) {
+
+            free_cursor = pcursor;
+
+            macro_postings_free(&pcursor->di);
+            macro_postings_free(&pcursor->fi);
+
+            /* next one... */
+            pcursor = pcursor->next;
+
+            free(free_cursor);
+        }
+
+        macro_matrix[i].header = NULL;
+        macro_matrix[i].last   = NULL;
+    } /* end for */
+}
+
+/*
+    returns 0 means no illegal characters in macro name
+    otherwise returns 1
+ */
+static unsigned int macro_have_illegal_characters(const char * str)
+{
+    unsigned int ret = 0;
+    unsigned int i   = 0;
+
+    const char * ptr = str;
+
+    assert(str != NULL);
+
+    /* space also means the macro name string is end */
+    while (*ptr != ' ' && *ptr != '\0' ) {
+        i = 0;
+
+        while( _illegal_chars[i] != '\0') {
+            if (*ptr == _illegal_chars[i++]) {
+                ret = 1;
+                goto GOOOO;
+            }
+        }
+
+       ptr++;
+    }
+
+GOOOO:
+    return ret;
+}
+
+void macro_scan_dump(const MACRO_SCAN_CTX * ctx, FILE * out)
+{
+    unsigned int i;
+    MACRO_INFO_NODE * pcursor;
+
+    assert(ctx != NULL);
+    assert(out != NULL);
+
+    /*
+        go through macro matrix {
+            go through macro info linker  {
+                go through di(defined info) postings
+                go through fi(found from info) postings
+            }
+        }
+     */
+
+    /* start going through macro matrix...from A to Z and special characters,like '_' */
+    for(i = 0; i < MAX_CHARACTER_NUMS; i++) {
+
+        /* start going through macro info linker start... */
+        for (pcursor = ctx->matrix[i].header; pcursor != NULL; pcursor = pcursor->next) {
+            dump_macro(ctx, pcursor, NULL, out);
+        }
+    } /* end for */
+
+    /* output summary information */
+    fprintf(out,"\n------------------------------------------\n");
+    fprintf(out,"processed files:%lu\nprocessed macro:%lu\n",ctx->file_nums,ctx->macro_nums);
+}
+
+/*
+ * output one macro: name, defined-in and found-from sites. With 'path_rank' the sites are
+ * put in (path, line) order first, otherwise they come in scan order. returns 0, or -1 with
+ * errno set if the sites could not be sorted.
+ */
+static int dump_macro(const MACRO_SCAN_CTX * ctx, const MACRO_INFO_NODE * pnode, const unsigned int * path_rank, FILE * out)
+{
+    const MACRO_SITE * site;
+    unsigned int n;
+    unsigned int k;
+
+    /* Step 1. output macro name */
+    fprintf(out, "Macro:  %s\n",pnode->name);
+
+    /* Step 2. output defined-in infor */
+    fprintf(out, "Defined in:\n");
+    site = path_rank != NULL ? macro_scan_sorted_sites(&pnode->di, 1, path_rank, &n) : NULL;
+    if (site == NULL && path_rank != NULL && pnode->di.nums != 0) {
+        return -1;
+    }
+    if (site != NULL) {
+        for (k = 0; k < n; k++) {
+            fprintf(out,"Line%d:%s    %s\n",
+                    site[k].ln,
+                    macro_scan_path(ctx, site[k].file),
+                    site[k].value != 0 ? macro_scan_value(ctx, site[k].value) : " ");
+        }
+        free((void *)site);
+    } else {
+        MACRO_POSTINGS_ITER it;
+
+        macro_postings_iter_init(&it, pnode->di.data, pnode->di.len, 1);
+        while ((site = macro_postings_iter_next(&it)) != NULL) {
+            fprintf(out,"Line%d:%s    %s\n",
+                    site->ln,
+                    macro_scan_path(ctx, site->file),
+                    site->value != 0 ? macro_scan_value(ctx, site->value) : " ");
+        }
+    }
+    fprintf(out, "\n");
+
+    /* Step 3. output found-from infor */
+    fprintf(out, "Found from:\n");
+    site = path_rank != NULL ? macro_scan_sorted_sites(&pnode->fi, 0, path_rank, &n) : NULL;
+    if (site == NULL && path_rank != NULL && pnode->fi.nums != 0) {
+        return -1;
+    }
+    if (site != NULL) {
+        for (k = 0; k < n; k++) {
+            fprintf(out,"Line%d:%s\n",
+                    site[k].ln,
+                    macro_scan_path(ctx, site[k].file));
+        }
+        free((void *)site);
+    } else {
+        MACRO_POSTINGS_ITER it;
+
+        macro_postings_iter_init(&it, pnode->fi.data, pnode->fi.len, 0);
+        while ((site = macro_postings_iter_next(&it)) != NULL) {
+            fprintf(out,"Line%d:%s\n",
+                    site->ln,
+                    macro_scan_path(ctx, site->file));
+        }
+    }
+    fprintf(out, "-------------------------------------------\n");
+
+    return 0;
+}
+
+MACRO_SITE * macro_scan_sorted_sites(const MACRO_POSTINGS * pst, unsigned int with_value, const unsigned int * path_rank, unsigned int * nums)
+{
+    MACRO_POSTINGS_ITER it;
+    const MACRO_SITE * site;
+    RANKED_SITE * ranked;
+    MACRO_SITE * sites;
+    unsigned int k = 0;
+
+    *nums = 0;
+    if (pst->nums == 0) {
+        return NULL;
+    }
+
+    ranked = malloc(pst->nums * sizeof(RANKED_SITE));
+    sites  = malloc(pst->nums * sizeof(MACRO_SITE));
+    if (ranked == NULL || sites == NULL) {
+        free(ranked);
+        free(sites);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    macro_postings_iter_init(&it, pst->data, pst->len, with_value);
+    while ((site = macro_postings_iter_next(&it)) != NULL && k < pst->nums) {
+        ranked[k].path = path_rank[site->file];
+        ranked[k].site = *site;
+        k++;
+    }
+
+    qsort(ranked, k, sizeof(RANKED_SITE), compare_ranked_site);
+
+    for (*nums = 0; *nums < k; (*nums)++) {
+        sites[*nums] = ranked[*nums].site;
+    }
+
+    free(ranked);
+
+    return sites;
+}
+
+static int compare_ranked_site(const void * a, const void * b)
+{
+    const RANKED_SITE * sa = a;
+    const RANKED_SITE * sb = b;
+
+    if (sa->path != sb->path) {
+        return sa->path < sb->path ? -1 : 1;
+    }
+    if (sa->site.ln != sb->site.ln) {
+        return sa->site.ln < sb->site.ln ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Everything that decides the order is turned into small integers once: the macro nodes are
+ * sorted by name and every file id gets the rank of its path. Sorting the sites of one macro
+ * then only compares integers.
+ */
+int macro_scan_rank(const MACRO_SCAN_CTX * ctx, unsigned int nthreads, MACRO_INFO_NODE *** macros, unsigned int ** path_rank)
+{
+    unsigned int macro_nums = str_pool_nums(&ctx->names);
+    unsigned int path_nums  = str_pool_nums(&ctx->paths);
+    unsigned int id;
+    PATH_RANK * paths;
+
+    assert(ctx != NULL);
+
+    *macros    = malloc((macro_nums + 1) * sizeof(MACRO_INFO_NODE *));
+    *path_rank = malloc((path_nums + 1) * sizeof(unsigned int));
+    paths      = malloc((path_nums + 1) * sizeof(PATH_RANK));
+    if (*macros == NULL || *path_rank == NULL || paths == NULL) {
+        goto FAILED;
+    }
+
+    /* Step 1. the macros by name */
+    if (macro_nums > 0) {
+        memcpy(*macros, ctx->macros, macro_nums * sizeof(MACRO_INFO_NODE *));
+    }
+
+    if (macro_parallel_sort(*macros, macro_nums, sizeof(MACRO_INFO_NODE *), compare_macro_by_name, nthreads) != 0) {
+        goto FAILED;
+    }
+
+    /* Step 2. the file ids by path */
+    for (id = 0; id < path_nums; id++) {
+        paths[id].path = str_pool_get(&ctx->paths, id);
+        paths[id].id   = id;
+    }
+
+    if (macro_parallel_sort(paths, path_nums, sizeof(PATH_RANK), compare_path_by_name, nthreads) != 0) {
+        goto FAILED;
+    }
+
+    for (id = 0; id < path_nums; id++) {
+        (*path_rank)[paths[id].id] = id;
+    }
+
+    free(paths);
+
+    return 0;
+
+FAILED:
+    free(paths);
+    free(*path_rank);
+    free(*macros);
+    *path_rank = NULL;
+    *macros    = NULL;
+    errno = ENOMEM;
+
+    return -1;
+}
+
+int macro_scan_dump_sorted(const MACRO_SCAN_CTX * ctx, FILE * out, unsigned int nthreads)
+{
+    unsigned int macro_nums = str_pool_nums(&ctx->names);
+    unsigned int k;
+    int ret = -1;
+
+    MACRO_INFO_NODE ** macros;
+    unsigned int     * path_rank;
+
+    assert(ctx != NULL);
+    assert(out != NULL);
+
+    if (macro_scan_rank(ctx, nthreads, &macros, &path_rank) != 0) {
+        return -1;
+    }
+
+    for (k = 0; k < macro_nums; k++) {
+        if (dump_macro(ctx, macros[k], path_rank, out) != 0) {
+            goto DONE;
+        }
+    }
+
+    /* output summary information */
+    fprintf(out,"\n------------------------------------------\n");
+    fprintf(out,"processed files:%lu\nprocessed macro:%lu\n",ctx->file_nums,ctx->macro_nums);
+
+    ret = 0;
+
+DONE:
+    free(path_rank);
+    free(macros);
+
+    return ret;
+}
+
+static int compare_path_by_name(const void * a, const void * b)
+{
+    return strcmp(((const PATH_RANK *)a)->path, ((const PATH_RANK *)b)->path);
+}
+
+static int compare_macro_by_name(const void * a, const void * b)
+{
+    const MACRO_INFO_NODE * ma = *(const MACRO_INFO_NODE * const *)a;
+    const MACRO_INFO_NODE * mb = *(const MACRO_INFO_NODE * const *)b;
+
+    return strcmp(ma->name, mb->name);
+}
+
+/*
+ * Report macros that are defined but never tested by #ifdef/#ifndef(dead) and
+ * macros that are tested but never defined anywhere(dangling).
+ *
+ * Every MACRO_INFO_NODE already joins the define and found-from sites of one macro and its
+ * postings know how many sites they hold, so there is nothing to merge: one pass over the
+ * id -> node table tests each macro once. Only the macros reported are sorted by name.
+ */
+int macro_scan_report_dead(const MACRO_SCAN_CTX * ctx, FILE * out, unsigned int nthreads)
+{
+    unsigned int n = str_pool_nums(&ctx->names);
+    unsigned int dead_nums = 0;
+    unsigned int dangling_nums = 0;
+    unsigned int id;
+    unsigned int k;
+    int ret = -1;
+
+    MACRO_INFO_NODE ** dead     = NULL;
+    MACRO_INFO_NODE ** dangling = NULL;
+
+    assert(ctx != NULL);
+    assert(out != NULL);
+
+    if ((dead = malloc((n + 1) * sizeof(MACRO_INFO_NODE *))) == NULL ||
+        (dangling = malloc((n + 1) * sizeof(MACRO_INFO_NODE *))) == NULL) {
+        errno = ENOMEM;
+        goto DONE;
+    }
+
+    /* Step 1. one test per macro */
+    for (id = 0; id < n; id++) {
+        if (ctx->macros[id]->di.nums != 0 && ctx->macros[id]->fi.nums == 0) {
+            dead[dead_nums++] = ctx->macros[id];
+        } else if (ctx->macros[id]->di.nums == 0 && ctx->macros[id]->fi.nums != 0) {
+            dangling[dangling_nums++] = ctx->macros[id];
+        }
+    }
+
+    /* Step 2. by name for the output */
+    if (macro_parallel_sort(dead, dead_nums, sizeof(MACRO_INFO_NODE *), compare_macro_by_name, nthreads) != 0 ||
+        macro_parallel_sort(dangling, dangling_nums, sizeof(MACRO_INFO_NODE *), compare_macro_by_name, nthreads) != 0) {
+        errno = ENOMEM;
+        goto DONE;
+    }
+
+    fprintf(out, "Dead macros(defined but never tested by #ifdef/#ifndef):\n");
+    for (k = 0; k < dead_nums; k++) {
+        fprintf(out, "  %-48s defined:%u used:%u\n", dead[k]->name, dead[k]->di.nums, dead[k]->fi.nums);
+    }
+    fprintf(out, "-------------------------------------------\n");
+
+    fprintf(out, "Dangling macros(tested but never defined):\n");
+    for (k = 0; k < dangling_nums; k++) {
+        fprintf(out, "  %-48s defined:%u used:%u\n", dangling[k]->name, dangling[k]->di.nums, dangling[k]->fi.nums);
+    }
+    fprintf(out, "-------------------------------------------\n");
+
+    /* output summary information */
+    fprintf(out,"\n------------------------------------------\n");
+    fprintf(out,"processed files:%lu\nprocessed macro:%lu\ndistinct macro:%u\ndead macro:%u\ndangling macro:%u\n",
+            ctx->file_nums, ctx->macro_nums, n, dead_nums, dangling_nums);
+
+    ret = 0;
+
+DONE:
+    free(dangling);
+    free(dead);
+
+    return ret;
+}
+
+/*
+ * Report macros defined with more than one value. The values are interned, so equal values
+ * have the same id and the sites of a macro are grouped by value id in one pass without
+ * comparing strings. The first pass over all sites only finds the conflicting macros, then
+ * those are sorted by name and grouped again for the output.
+ *
+ * A define without value('#define FOO', typically tested by #ifdef) does not conflict with
+ * one that has a value, its sites are listed under "(no value)" when the macro conflicts anyway.
+ */
+int macro_scan_report_conflicts(const MACRO_SCAN_CTX * ctx, FILE * out, unsigned int nthreads)
+{
+    unsigned int n = str_pool_nums(&ctx->names);
+    unsigned int value_nums = str_pool_nums(&ctx->values);
+    unsigned int id;
+    unsigned int k;
+    unsigned int defined_nums = 0;
+    unsigned int conflict_nums = 0;
+    unsigned int stamp = 0;
+    unsigned int max_sites = 0;
+    unsigned int valued;
+    unsigned int group_nums;
+    unsigned int g;
+    unsigned int i;
+    int ret = -1;
+
+    MACRO_INFO_NODE ** conflicts = NULL;
+    unsigned int     * seen_by   = NULL;   /* value id + 1 -> the stamp of the pass that saw it last */
+    unsigned int     * group_of  = NULL;   /* value id + 1 -> its group in that macro */
+    unsigned int     * group_value = NULL; /* group -> value id + 1 */
+    unsigned int     * group_start = NULL; /* group -> first of its sites in sites[], then its count */
+    MACRO_SITE       * sites     = NULL;   /* the sites of one macro, grouped by value */
+    MACRO_POSTINGS_ITER it;
+    const MACRO_SITE * site;
+    const char * value;
+
+    assert(ctx != NULL);
+    assert(out != NULL);
+
+    if ((conflicts = malloc((n + 1) * sizeof(MACRO_INFO_NODE *))) == NULL ||
+        (seen_by = calloc(value_nums + 1, sizeof(unsigned int))) == NULL ||
+        (group_of = malloc((value_nums + 1) * sizeof(unsigned int))) == NULL) {
+        errno = ENOMEM;
+        goto DONE;
+    }
+
+    /* Step 1. count the distinct values of each macro, stop at the second one */
+    for (id = 0; id < n; id++) {
+        if (ctx->macros[id]->di.nums == 0) {
+            continue;
+        }
+        defined_nums++;
+
+        valued = 0;
+        stamp++;
+        macro_postings_iter_init(&it, ctx->macros[id]->di.data, ctx->macros[id]->di.len, 1);
+        while (valued < 2 && (site = macro_postings_iter_next(&it)) != NULL) {
+            if (site->value != 0 && seen_by[site->value] != stamp) {
+                seen_by[site->value] = stamp;
+                valued++;
+            }
+        }
+
+        if (valued >= 2) {
+            conflicts[conflict_nums++] = ctx->macros[id];
+            if (ctx->macros[id]->di.nums > max_sites) {
+                max_sites = ctx->macros[id]->di.nums;
+            }
+        }
+    }
+
+    /* Step 2. only the conflicting macros, by name */
+    if (macro_parallel_sort(conflicts, conflict_nums, sizeof(MACRO_INFO_NODE *), compare_macro_by_name, nthreads) != 0 ||
+        (group_value = malloc((max_sites + 1) * sizeof(unsigned int))) == NULL ||
+        (group_start = malloc((max_sites + 2) * sizeof(unsigned int))) == NULL ||
+        (sites = malloc((max_sites + 1) * sizeof(MACRO_SITE))) == NULL) {
+        errno = ENOMEM;
+        goto DONE;
+    }
+
+    /* Step 3. group the sites of each by value */
+    fprintf(out, "Conflicting macros(defined with different values):\n");
+    for (k = 0; k < conflict_nums; k++) {
+
+        group_nums = 0;
+        stamp++;
+        macro_postings_iter_init(&it, conflicts[k]->di.data, conflicts[k]->di.len, 1);
+        while ((site = macro_postings_iter_next(&it)) != NULL) {
+            if (seen_by[site->value] != stamp) {
+                seen_by[site->value]  = stamp;
+                group_of[site->value] = group_nums;
+                group_value[group_nums] = site->value;
+                group_start[group_nums + 1] = 0;
+                group_nums++;
+            }
+            group_start[group_of[site->value] + 1]++;
+        }
+
+        /* counts -> where each group starts, then a second pass drops every site into its group */
+        group_start[0] = 0;
+        for (g = 0; g < group_nums; g++) {
+            group_start[g + 1] += group_start[g];
+        }
+        macro_postings_iter_init(&it, conflicts[k]->di.data, conflicts[k]->di.len, 1);
+        while ((site = macro_postings_iter_next(&it)) != NULL) {
+            sites[group_start[group_of[site->value]]++] = *site;
+        }
+
+        fprintf(out, "  %-48s values:%u defined:%u\n", conflicts[k]->name, group_nums, conflicts[k]->di.nums);
+        for (g = 0, i = 0; g < group_nums; g++) {
+            value = macro_scan_value(ctx, group_value[g]);
+            fprintf(out, "    %s\n", value != NULL ? value : "(no value)");
+            for (; i < group_start[g]; i++) {
+                fprintf(out, "      %s:%u\n", macro_scan_path(ctx, sites[i].file), sites[i].ln);
+            }
+        }
+    }
+    fprintf(out, "-------------------------------------------\n");
+
+    /* output summary information */
+    fprintf(out,"\n------------------------------------------\n");
+    fprintf(out,"processed files:%lu\ndistinct macro:%u\ndefined macro:%u\nconflicting macro:%u\n",
+            ctx->file_nums, n, defined_nums, conflict_nums);
+
+    ret = 0;
+
+DONE:
+    free(conflicts);
+    free(seen_by);
+    free(group_of);
+    free(group_value);
+    free(group_start);
+    free(sites);
+
+    return ret;
+}
+
+static char * ltrim(char *str)
+{
+    char *ptr;
+    int  len;
+
+    for (ptr = str; *ptr && isspace((int)*ptr); ++ptr);
+
+    len = strlen(ptr);
+    memmove(str, ptr, len + 1);
+
+    return str;
+}
@@ -0,0 +1,245 @@
+/*
+ * macro_scan - the scanning library behind list_macros
+ *
+ * A scan context collects every '#define' site and every '#ifdef'/'#ifndef' site found in
+ * the paths or in-memory buffers handed to it. Each site is reported as an event through the
+ * callbacks given at creation time, and, when MACRO_SCAN_BUILD_MATRIX is set, is also kept in
+ * the context's macro matrix for the dump and report functions below.
+ *
+ * Contexts do not share any state, so several scans can run side by side in one process.
+ *
+ * Example:
+ *
+ *     static void on_found(void * user, const char * name, const char * fpath, unsigned int ln)
+ *     {
+ *         printf("%s used at %s:%u\n", name, fpath, ln);
+ *     }
+ *
+ *     MACRO_SCAN_CALLBACKS cb = { NULL, on_found, NULL };
+ *     MACRO_SCAN_CTX * ctx = macro_scan_create(&cb, 0);
+ *     macro_scan_tree(ctx, "/path/to/project");
+ *     macro_scan_destroy(ctx);
+ */
+
+#ifndef MACRO_SCAN_H
+#define MACRO_SCAN_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include "str_pool.h"
+#include "macro_postings.h"
+#include "macro_target.h"
+#include "macro_dir.h"
+#include "macro_budget.h"
+
+/*  1   CONSTANTS AND MACROS  */
+#define MAX_PATH_LEN 512
+#define MAX_LINE_LEN 512*2
+
+#define MAX_MACRO_NAME_LEN  512
+#define MAX_MACRO_VALUE_LEN 512
+#define MAX_CHARACTER_NUMS ('Z'-'A'+1+1)
+
+/* flags for macro_scan_create() */
+#define MACRO_SCAN_BUILD_MATRIX 0x01    /* keep every event in the macro matrix, needed by dump and reports */
+#define MACRO_SCAN_INCLUDES     0x02    /* keep every '#include' directive too, see macro_include.h. Needs MACRO_SCAN_BUILD_MATRIX */
+#define MACRO_SCAN_REGIONS      0x04    /* keep the lines each '#ifdef'/'#ifndef' guards, see macro_region.h. Needs MACRO_SCAN_BUILD_MATRIX */
+#define MACRO_SCAN_DIRS         0x08    /* count the sites of each directory, see macro_dir.h */
+
+/* how deep '#if' nesting is followed for MACRO_SCAN_REGIONS, deeper levels are not recorded */
+#define MAX_REGION_DEPTH 64
+
+/*  2   DATA STRUCTURES      */
+typedef struct MACRO_INFO_NODE {
+
+   char             * name;      /* macro name, interned in ctx->names */
+   unsigned int       id;        /* macro id, the index of name in ctx->names */
+   MACRO_POSTINGS     di;        /* the macro defined in where(file id, line number, value id + 1) */
+   MACRO_POSTINGS     fi;        /* the macro found from where(file id, line number) */
+
+   struct MACRO_INFO_NODE * next;
+
+}MACRO_INFO_NODE,* PMACRO_INFO_NODE;
+
+typedef struct MACRO_MATRIX_ELEMENT {
+
+  MACRO_INFO_NODE * header;  /* point to the first node of macro infor linker(see MACRO_INFO_NODE) */
+  MACRO_INFO_NODE * last;    /* point to the last node of macro infor linker(see MACRO_INFO_NODE) */
+
+}MACRO_MATRIX_ELEMENT;
+
+typedef struct MACRO_INCLUDE_SITE {
+
+   unsigned int       file;      /* file id of the including file */
+   unsigned int       header;    /* id of the name as spelled in the directive, in ctx->headers */
+   unsigned int       ln;        /* line number */
+   unsigned int       quoted;    /* 1 for #include "name", 0 for #include <name> */
+
+}MACRO_INCLUDE_SITE;
+
+typedef struct MACRO_REGION {
+
+   unsigned int       macro;     /* macro id of the '#ifdef'/'#ifndef' */
+   unsigned int       file;      /* file id */
+   unsigned int       start;     /* line of the '#ifdef'/'#ifndef' */
+   unsigned int       else_ln;   /* line of the first '#else'/'#elif' of this level, 0 if there is none */
+   unsigned int       end;       /* line of the matching '#endif', or the last line + 1 if it is missing */
+   unsigned int       negated;   /* 1 for '#ifndef' */
+
+}MACRO_REGION;
+
+/*
+ * Event callbacks. Any of them may be NULL.
+ *
+ * 'fpath' and 'value' are only guaranteed to stay valid during the call unless the context
+ * was created with MACRO_SCAN_BUILD_MATRIX, in which case 'fpath' lives as long as the context.
+ * A path that has already been scanned is skipped when building the matrix.
+ * 'value' is NULL for a define without value, like '#define FOO'.
+ */
+typedef void (*MACRO_DEFINE_CALLBACK)(void * user, const char * name, const char * fpath, unsigned int ln, const char * value);
+typedef void (*MACRO_FOUND_CALLBACK)(void * user, const char * name, const char * fpath, unsigned int ln);
+typedef void (*MACRO_FILE_CALLBACK)(void * user, const char * fpath);
+
+typedef struct MACRO_SCAN_CALLBACKS {
+
+   MACRO_DEFINE_CALLBACK on_define;   /* called for each '#define NAME [value]' */
+   MACRO_FOUND_CALLBACK  on_found;    /* called for each '#ifdef NAME' and '#ifndef NAME' */
+   void                * user;        /* passed back as the first argument of each callback */
+   MACRO_FILE_CALLBACK   on_file_done; /* called after each file has been scanned, may be NULL */
+
+}MACRO_SCAN_CALLBACKS;
+
+typedef struct MACRO_SCAN_CTX {
+
+   /* A to Z plus '_', each element points to a linker header that contain all macros infor(name,defined in,found from) with same capital letter
+      matrix[0] is all macros begin 'A'
+      matrix[25] is all macros begin 'Z'
+      matrix[26] is all macros begin '_'
+    */
+   MACRO_MATRIX_ELEMENT matrix[MAX_CHARACTER_NUMS];
+
+   STR_POOL             paths;        /* every scanned path when building the matrix, the id is the file id */
+   STR_POOL             names;        /* every macro name, the id is the macro id */
+   STR_POOL             values;       /* every distinct macro value */
+   STR_POOL             roots;        /* the directories given to macro_scan_tree(), the scanned paths are below them */
+
+   MACRO_INFO_NODE   ** macros;       /* macro id -> node, for finding a macro without walking its linker */
+   unsigned int         macro_cap;    /* capacity of macros[] */
+
+   MACRO_INCLUDE_SITE * includes;     /* every '#include' in scan order, with MACRO_SCAN_INCLUDES */
+   unsigned int         include_nums;
+   unsigned int         include_cap;
+   STR_POOL             headers;      /* the names spelled in the '#include' directives */
+
+   MACRO_REGION       * regions;      /* every '#ifdef'/'#ifndef' ... '#endif' in the order they closed, with MACRO_SCAN_REGIONS */
+   unsigned int         region_nums;
+   unsigned int         region_cap;
+
+   unsigned long        file_nums;    /* how many files be processed */
+   unsigned long        macro_nums;   /* how many define and found-from sites we found */
+   unsigned long        define_nums;  /* how many of them are define sites */
+   unsigned long        found_nums;   /* how many of them are found-from sites */
+
+   MACRO_DIR_TREE       dirs;         /* the sites counted per directory, with MACRO_SCAN_DIRS */
+
+   unsigned int         flags;        /* MACRO_SCAN_xxx */
+   MACRO_SCAN_CALLBACKS cb;
+
+   const MACRO_TARGETS * targets;     /* only these names are looked for when set, see macro_scan_set_targets() */
+   MACRO_BUDGET        * budget;      /* paces the reading when set, see macro_scan_set_budget() */
+
+}MACRO_SCAN_CTX;
+
+/*  3   FUNCTION PROTOTYPES  */
+
+/* returns NULL if out of memory. 'cb' may be NULL */
+MACRO_SCAN_CTX * macro_scan_create(const MACRO_SCAN_CALLBACKS * cb, unsigned int flags);
+void             macro_scan_destroy(MACRO_SCAN_CTX * ctx);
+
+/* returns 1 if 'path' has one of the scanned extensions(*.c,*.cc,*.cpp,*.h,*.hi,*.inc) and is not in the skip list */
+int macro_scan_path_is_wanted(const char * path);
+
+/*
+ * The scan functions return 0 on success and -1 on failure with errno set.
+ * macro_scan_tree() walks 'root' recursively and scans every wanted file below it; it keeps
+ * going when a single file can not be read and reports it on stderr. 'root'(or the directory
+ * of it when it is a file) is kept in 'roots' so the paths can be taken relative to it.
+ */
+int macro_scan_tree(MACRO_SCAN_CTX * ctx, const char * root);
+
+/*
+ * the walk behind macro_scan_tree(): 'on_file' gets every wanted file below 'root' without
+ * scanning it, and returns non zero to stop the walk. returns 0, 1 if 'on_file' stopped it,
+ * or -1 with errno set if 'root' can not be found.
+ */
+typedef int (*MACRO_WALK_CALLBACK)(void * user, const char * path, const struct stat * st);
+int macro_scan_walk(const char * root, MACRO_WALK_CALLBACK on_file, void * user);
+int macro_scan_file(MACRO_SCAN_CTX * ctx, const char * path);
+int macro_scan_buffer(MACRO_SCAN_CTX * ctx, const char * path, const char * buf, size_t len);
+
+/*
+ * look for the compiled 'targets' everywhere in the files instead of parsing directives: an
+ * occurrence on a '#define NAME' line for that very NAME is a define site, any other one(in
+ * '#if' expressions, code, macro arguments...) is a found-from site. Any '#define' counts,
+ * whatever its value, so '#define FOO (1)' and '#define FOO(x) x' both define FOO(the value
+ * of the latter is empty), while the FOO in '#define BAR FOO' is a found-from site of FOO.
+ * One site is kept per name and line. '#include' directives and conditional regions are not
+ * recorded in this mode.
+ * 'targets' must outlive the scans, NULL goes back to parsing directives.
+ */
+void macro_scan_set_targets(MACRO_SCAN_CTX * ctx, const MACRO_TARGETS * targets);
+
+/*
+ * pace macro_scan_file() and macro_scan_tar() with 'budget'(see macro_budget.h): every file
+ * open and read waits for its tokens, and read pages are dropped from the page cache. Once
+ * macro_budget_interrupted() is true no more files are scanned. 'budget' must outlive the
+ * scans, NULL scans flat out again.
+ */
+void macro_scan_set_budget(MACRO_SCAN_CTX * ctx, MACRO_BUDGET * budget);
+
+/* the following need MACRO_SCAN_BUILD_MATRIX */
+void macro_scan_dump(const MACRO_SCAN_CTX * ctx, FILE * out);
+
+/*
+ * same output as macro_scan_dump() but in an order that does not depend on the scan order:
+ * macros sorted by name, their define and found-from sites sorted by (path, line).
+ * Sorting runs on up to 'nthreads' threads. returns 0 on success, -1 with errno set if out of
+ * memory, in which case the output stops at the macro that could not be sorted.
+ */
+int  macro_scan_dump_sorted(const MACRO_SCAN_CTX * ctx, FILE * out, unsigned int nthreads);
+
+/*
+ * list the macros defined but never tested(dead) and tested but never defined(dangling),
+ * by name, with their define and use counts. Sorting runs on up to 'nthreads' threads.
+ * returns 0 on success, -1 with errno set if out of memory.
+ */
+int  macro_scan_report_dead(const MACRO_SCAN_CTX * ctx, FILE * out, unsigned int nthreads);
+
+/*
+ * list the macros defined with at least two different values, by name, with the define sites
+ * of each value. A define without value does not conflict by itself, it is listed as
+ * "(no value)" with the others. Sorting runs on up to 'nthreads' threads.
+ * returns 0 on success, -1 with errno set if out of memory.
+ */
+int  macro_scan_report_conflicts(const MACRO_SCAN_CTX * ctx, FILE * out, unsigned int nthreads);
+
+/*
+ * sort the macro nodes by name and give every file id the rank of its path, so later
+ * ordering only compares integers. Both arrays are malloc()ed, free() them.
+ * returns 0 on success, -1 with errno set if out of memory.
+ */
+int  macro_scan_rank(const MACRO_SCAN_CTX * ctx, unsigned int nthreads, MACRO_INFO_NODE *** macros, unsigned int ** path_rank);
+
+/*
+ * decode a postings list into an array sorted by (path rank, line); the file ids are kept.
+ * returns NULL for an empty list or, with errno set, if out of memory; free() the result.
+ */
+MACRO_SITE * macro_scan_sorted_sites(const MACRO_POSTINGS * pst, unsigned int with_value, const unsigned int * path_rank, unsigned int * nums);
+
+/* file id -> path, value id + 1 -> value(NULL for 0) */
+#define macro_scan_path(ctx, file)    str_pool_get(&(ctx)->paths, (file))
+#define macro_scan_value(ctx, value)  ((value) == 0 ? NULL : str_pool_get(&(ctx)->values, (value) - 1))
+
+#endif /* MACRO_SCAN_H */
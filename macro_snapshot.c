@@ -0,0 +1,435 @@
+/*
+ * macro_snapshot - saved scan results, see macro_snapshot.h
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "macro_snapshot.h"
+
+/* how much of a postings block is read at a time, see read_postings() */
+#define SNAPSHOT_READ_STEP (1024 * 1024)
+
+static int write_varint(FILE * out, unsigned int v);
+static int write_string(FILE * out, const char * str);
+static int write_postings(FILE * out, const MACRO_POSTINGS * pst, unsigned int with_value, const unsigned int * path_rank);
+static int read_varint(FILE * in, unsigned int * v);
+static int read_string(FILE * in, char * buf, unsigned int size, unsigned int * len);
+static int read_table(MACRO_SNAPSHOT * snap, STR_POOL * pool);
+static int check_left(const MACRO_SNAPSHOT * snap, unsigned int len);
+static int grow_postings(MACRO_SNAPSHOT * snap, unsigned int need);
+static int read_postings(MACRO_SNAPSHOT * snap, unsigned char ** data, unsigned int * len, unsigned int * nums);
+
+int macro_snapshot_save(const MACRO_SCAN_CTX * ctx, FILE * out, unsigned int nthreads)
+{
+    unsigned int root_nums  = str_pool_nums(&ctx->roots);
+    unsigned int path_nums  = str_pool_nums(&ctx->paths);
+    unsigned int value_nums = str_pool_nums(&ctx->values);
+    unsigned int macro_nums = str_pool_nums(&ctx->names);
+    unsigned int id;
+    unsigned int k;
+    int ret = -1;
+
+    MACRO_INFO_NODE ** macros;
+    unsigned int     * path_rank;
+    unsigned int     * ranked_paths = NULL;
+
+    assert(ctx != NULL);
+    assert(out != NULL);
+
+    if (macro_scan_rank(ctx, nthreads, &macros, &path_rank) != 0) {
+        return -1;
+    }
+
+    if ((ranked_paths = malloc((path_nums + 1) * sizeof(unsigned int))) == NULL) {
+        goto DONE;
+    }
+
+    for (id = 0; id < path_nums; id++) {
+        ranked_paths[path_rank[id]] = id;
+    }
+
+    if (fwrite(MACRO_SNAPSHOT_MAGIC, 1, MACRO_SNAPSHOT_MAGIC_LEN, out) != MACRO_SNAPSHOT_MAGIC_LEN) {
+        goto DONE;
+    }
+
+    /* Step 1. the roots the paths start with */
+    if (write_varint(out, root_nums) != 0) {
+        goto DONE;
+    }
+    for (id = 0; id < root_nums; id++) {
+        if (write_string(out, str_pool_get(&ctx->roots, id)) != 0) {
+            goto DONE;
+        }
+    }
+
+    /* Step 2. paths in rank order, so the snapshot's file id is the rank */
+    if (write_varint(out, path_nums) != 0) {
+        goto DONE;
+    }
+    for (k = 0; k < path_nums; k++) {
+        if (write_string(out, str_pool_get(&ctx->paths, ranked_paths[k])) != 0) {
+            goto DONE;
+        }
+    }
+
+    /* Step 3. values in id order */
+    if (write_varint(out, value_nums) != 0) {
+        goto DONE;
+    }
+    for (id = 0; id < value_nums; id++) {
+        if (write_string(out, str_pool_get(&ctx->values, id)) != 0) {
+            goto DONE;
+        }
+    }
+
+    /* Step 4. macros in name order */
+    if (write_varint(out, macro_nums) != 0) {
+        goto DONE;
+    }
+    for (k = 0; k < macro_nums; k++) {
+        if (write_string(out, macros[k]->name) != 0 ||
+            write_postings(out, &macros[k]->di, 1, path_rank) != 0 ||
+            write_postings(out, &macros[k]->fi, 0, path_rank) != 0) {
+            goto DONE;
+        }
+    }
+
+    ret = fflush(out) == 0 ? 0 : -1;
+
+DONE:
+    free(ranked_paths);
+    free(path_rank);
+    free(macros);
+
+    return ret;
+}
+
+int macro_snapshot_open(MACRO_SNAPSHOT * snap, FILE * in)
+{
+    char magic[MACRO_SNAPSHOT_MAGIC_LEN];
+    struct stat st;
+
+    assert(snap != NULL);
+    assert(in   != NULL);
+
+    memset(snap, 0, sizeof(MACRO_SNAPSHOT));
+    snap->in   = in;
+    snap->size = -1;
+    if (fstat(fileno(in), &st) == 0 && S_ISREG(st.st_mode)) {
+        snap->size = (long)st.st_size;
+    }
+    str_pool_init(&snap->roots);
+    str_pool_init(&snap->paths);
+    str_pool_init(&snap->values);
+
+    if (fread(magic, 1, MACRO_SNAPSHOT_MAGIC_LEN, in) != MACRO_SNAPSHOT_MAGIC_LEN) {
+        errno = EINVAL;
+        goto FAILED;
+    }
+
+    if (memcmp(magic, MACRO_SNAPSHOT_MAGIC, MACRO_SNAPSHOT_MAGIC_LEN) == 0) {
+        if (read_table(snap, &snap->roots) != 0) {
+            goto FAILED;
+        }
+    } else if (memcmp(magic, MACRO_SNAPSHOT_MAGIC_V1, MACRO_SNAPSHOT_MAGIC_LEN) != 0) {
+        errno = EINVAL;
+        goto FAILED;
+    }
+
+    if (read_table(snap, &snap->paths) != 0 ||
+        read_table(snap, &snap->values) != 0 ||
+        read_varint(in, &snap->macro_nums) != 0) {
+        goto FAILED;
+    }
+
+    return 0;
+
+FAILED:
+    macro_snapshot_close(snap);
+    return -1;
+}
+
+void macro_snapshot_close(MACRO_SNAPSHOT * snap)
+{
+    if (snap == NULL) {
+        return;
+    }
+
+    str_pool_free(&snap->roots);
+    str_pool_free(&snap->paths);
+    str_pool_free(&snap->values);
+    free(snap->di);
+    free(snap->fi);
+
+    snap->di = NULL;
+    snap->fi = NULL;
+    snap->cap = 0;
+}
+
+int macro_snapshot_next(MACRO_SNAPSHOT * snap)
+{
+    unsigned int len;
+
+    if (snap->macro_pos == snap->macro_nums) {
+        return 0;
+    }
+
+    if (read_string(snap->in, snap->name, sizeof(snap->name), &len) != 0 ||
+        read_postings(snap, &snap->di, &snap->di_len, &snap->di_nums) != 0 ||
+        read_postings(snap, &snap->fi, &snap->fi_len, &snap->fi_nums) != 0) {
+        return -1;
+    }
+
+    snap->macro_pos++;
+
+    return 1;
+}
+
+/* re-encode the postings with the path ranks as file ids, in (path, line) order */
+static int write_postings(FILE * out, const MACRO_POSTINGS * pst, unsigned int with_value, const unsigned int * path_rank)
+{
+    MACRO_POSTINGS ranked;
+    MACRO_SITE * sites;
+    unsigned int nums;
+    unsigned int k;
+    int ret = -1;
+
+    if (pst->nums == 0) {
+        return write_varint(out, 0) != 0 || write_varint(out, 0) != 0 ? -1 : 0;
+    }
+
+    if ((sites = macro_scan_sorted_sites(pst, with_value, path_rank, &nums)) == NULL) {
+        return -1;
+    }
+
+    macro_postings_init(&ranked);
+    for (k = 0; k < nums; k++) {
+        if (macro_postings_add(&ranked, path_rank[sites[k].file], sites[k].ln, with_value, sites[k].value) < 0) {
+            goto DONE;
+        }
+    }
+
+    if (write_varint(out, ranked.nums) != 0 ||
+        write_varint(out, ranked.len)  != 0 ||
+        fwrite(ranked.data, 1, ranked.len, out) != ranked.len) {
+        goto DONE;
+    }
+
+    ret = 0;
+
+DONE:
+    macro_postings_free(&ranked);
+    free(sites);
+
+    return ret;
+}
+
+static int write_varint(FILE * out, unsigned int v)
+{
+    unsigned char buf[5];
+    unsigned int n = macro_varint_put(buf, v);
+
+    return fwrite(buf, 1, n, out) == n ? 0 : -1;
+}
+
+static int write_string(FILE * out, const char * str)
+{
+    size_t len = strlen(str);
+
+    if (write_varint(out, (unsigned int)len) != 0) {
+        return -1;
+    }
+
+    return fwrite(str, 1, len, out) == len ? 0 : -1;
+}
+
+/* returns 0, or -1 with errno set if the file is cut or corrupted */
+static int read_varint(FILE * in, unsigned int * v)
+{
+    unsigned char buf[5];
+    const unsigned char * p = buf;
+    unsigned int n = 0;
+    int c;
+
+    do {
+        if ((c = getc(in)) == EOF) {
+            errno = ferror(in) ? EIO : EINVAL;
+            return -1;
+        }
+        buf[n++] = (unsigned char)c;
+    } while ((c & 0x80) && n < sizeof(buf));
+
+    if (macro_varint_get(&p, buf + n, v) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* read a (length, bytes) string into 'buf' of 'size' bytes and '\0' terminate it */
+static int read_string(FILE * in, char * buf, unsigned int size, unsigned int * len)
+{
+    if (read_varint(in, len) != 0) {
+        return -1;
+    }
+
+    if (*len >= size) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (fread(buf, 1, *len, in) != *len) {
+        errno = ferror(in) ? EIO : EINVAL;
+        return -1;
+    }
+    buf[*len] = '\0';
+
+    return 0;
+}
+
+/*
+ * a count then that many strings, their ids must come out in file order. A string can be as
+ * long as the scanner made it, the buffer grows to the longest one.
+ */
+static int read_table(MACRO_SNAPSHOT * snap, STR_POOL * pool)
+{
+    char * buf = NULL;
+    unsigned int buf_size = 0;
+    unsigned int nums;
+    unsigned int len;
+    unsigned int id;
+    unsigned int k;
+    int ret = -1;
+    void * p;
+
+    if (read_varint(snap->in, &nums) != 0) {
+        return -1;
+    }
+
+    for (k = 0; k < nums; k++) {
+        if (read_varint(snap->in, &len) != 0 || check_left(snap, len) != 0) {
+            goto DONE;
+        }
+
+        if (len >= buf_size) {
+            if ((p = realloc(buf, (size_t)len + 1)) == NULL) {
+                errno = ENOMEM;
+                goto DONE;
+            }
+            buf      = p;
+            buf_size = len + 1;
+        }
+
+        if (fread(buf, 1, len, snap->in) != len) {
+            errno = ferror(snap->in) ? EIO : EINVAL;
+            goto DONE;
+        }
+        buf[len] = '\0';
+
+        if (str_pool_intern(pool, buf, len, &id) != 0) {
+            errno = ENOMEM;
+            goto DONE;
+        }
+
+        if (id != k) {
+            /* the same string twice */
+            errno = EINVAL;
+            goto DONE;
+        }
+    }
+
+    ret = 0;
+
+DONE:
+    free(buf);
+
+    return ret;
+}
+
+/* returns 0 if 'len' more bytes can be in the file, or -1 with errno EINVAL for a corrupt length */
+static int check_left(const MACRO_SNAPSHOT * snap, unsigned int len)
+{
+    long pos;
+
+    if (snap->size < 0 || (pos = ftell(snap->in)) < 0) {
+        return 0;
+    }
+
+    if ((unsigned long)len > (unsigned long)(snap->size - pos)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* make room for 'need' bytes in both postings buffers, they share cap */
+static int grow_postings(MACRO_SNAPSHOT * snap, unsigned int need)
+{
+    unsigned int cap;
+    void * p;
+
+    if (need <= snap->cap) {
+        return 0;
+    }
+
+    for (cap = snap->cap > 0 ? snap->cap : 256; cap < need; cap = cap > UINT_MAX / 2 ? need : cap * 2) {
+    }
+
+    if ((p = realloc(snap->di, cap)) == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    snap->di = p;
+
+    if ((p = realloc(snap->fi, cap)) == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    snap->fi = p;
+
+    snap->cap = cap;
+
+    return 0;
+}
+
+/*
+ * read one postings block into *data(snap->di or snap->fi). The length is checked against
+ * what is left of a regular file; from a pipe the block is read in steps, so a corrupt length
+ * runs into the end of the input before much memory is taken.
+ */
+static int read_postings(MACRO_SNAPSHOT * snap, unsigned char ** data, unsigned int * len, unsigned int * nums)
+{
+    unsigned int done = 0;
+    unsigned int chunk;
+
+    if (read_varint(snap->in, nums) != 0 || read_varint(snap->in, len) != 0 ||
+        check_left(snap, *len) != 0) {
+        return -1;
+    }
+
+    while (done < *len) {
+        chunk = *len - done < SNAPSHOT_READ_STEP ? *len - done : SNAPSHOT_READ_STEP;
+
+        if (grow_postings(snap, done + chunk) != 0) {
+            return -1;
+        }
+
+        if (fread(*data + done, 1, chunk, snap->in) != chunk) {
+            errno = ferror(snap->in) ? EIO : EINVAL;
+            return -1;
+        }
+        done += chunk;
+    }
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * macro_snapshot - saved scan results
+ *
+ * A snapshot keeps the whole macro matrix in a compact file so it can be looked at later
+ * without scanning the tree again. Layout, every number is a varint(see macro_postings.h):
+ *
+ *     "LMSNAP02"
+ *     root nums,  then each root as(length, bytes): the directories the scan started from
+ *     path nums,  then each path as(length, bytes) sorted by path; a file id is the rank of its path
+ *     value nums, then each value as(length, bytes); a value id + 1 refers to it, 0 is no value
+ *     macro nums, then for each macro in name order:
+ *         name as(length, bytes)
+ *         define nums, define bytes, the define postings(file id, line, value id + 1)
+ *         found nums,  found bytes,  the found-from postings(file id, line)
+ *
+ * Both postings of a macro are in (path, line) order, so two snapshots can be merged site by site.
+ * An "LMSNAP01" snapshot is the same without the roots, it is still read with no roots.
+ *
+ * A snapshot is read back macro by macro: the path and value tables are loaded when it is
+ * opened, then each macro_snapshot_next() replaces the current macro with the following one,
+ * so memory does not grow with the number of macros.
+ */
+
+#ifndef MACRO_SNAPSHOT_H
+#define MACRO_SNAPSHOT_H
+
+#include <stdio.h>
+
+#include "macro_scan.h"
+#include "str_pool.h"
+
+#define MACRO_SNAPSHOT_MAGIC      "LMSNAP02"
+#define MACRO_SNAPSHOT_MAGIC_V1   "LMSNAP01"   /* written before the roots were kept */
+#define MACRO_SNAPSHOT_MAGIC_LEN  8
+
+/*
+ * write the matrix of 'ctx'(built with MACRO_SCAN_BUILD_MATRIX) to 'out'.
+ * returns 0 on success, -1 on write error or if out of memory.
+ */
+int macro_snapshot_save(const MACRO_SCAN_CTX * ctx, FILE * out, unsigned int nthreads);
+
+/* an opened snapshot and the macro read last */
+typedef struct MACRO_SNAPSHOT {
+
+   FILE           * in;
+   long             size;                      /* of the file, -1 if it is not a regular file */
+   STR_POOL         roots;                     /* the scan roots, the paths are below them */
+   STR_POOL         paths;                     /* the id is the file id used in the postings */
+   STR_POOL         values;                    /* the id is value id, the postings store it + 1 */
+   unsigned int     macro_nums;
+   unsigned int     macro_pos;                 /* how many macros have been read */
+
+   /* the current macro, valid until the next macro_snapshot_next() */
+   char             name[MAX_MACRO_NAME_LEN];
+   unsigned char  * di;                        /* define postings, with values */
+   unsigned int     di_len;
+   unsigned int     di_nums;
+   unsigned char  * fi;                        /* found-from postings */
+   unsigned int     fi_len;
+   unsigned int     fi_nums;
+   unsigned int     cap;                       /* bytes allocated for each of di and fi */
+
+}MACRO_SNAPSHOT;
+
+/*
+ * read the header and the root, path and value tables of a snapshot.
+ * returns 0 on success, -1 with errno set on read error, bad format(EINVAL) or out of memory.
+ */
+int  macro_snapshot_open(MACRO_SNAPSHOT * snap, FILE * in);
+void macro_snapshot_close(MACRO_SNAPSHOT * snap);
+
+/* read the next macro. returns 1 if there was one, 0 at the end, -1 with errno set on error */
+int  macro_snapshot_next(MACRO_SNAPSHOT * snap);
+
+#endif /* MACRO_SNAPSHOT_H */
@@ -0,0 +1,184 @@
+/*
+ * macro_sort - parallel merge sort, see macro_sort.h
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "macro_sort.h"
+
+/* below this many elements per thread the threads cost more than they save */
+#define MACRO_SORT_MIN_PER_THREAD  16384
+#define MACRO_SORT_MAX_THREADS     64
+
+typedef struct SORT_TASK {
+
+   char             * src;     /* runs to sort or merge */
+   char             * dst;     /* merge output, unused when sorting */
+   size_t             lo;      /* first element of the left run */
+   size_t             mid;     /* first element of the right run, == hi when sorting */
+   size_t             hi;      /* one past the last element of the right run */
+   size_t             size;    /* element size */
+   MACRO_SORT_COMPARE compar;
+
+}SORT_TASK;
+
+static void * sort_run(void * arg);
+static void * merge_runs(void * arg);
+static void   run_tasks(SORT_TASK * tasks, unsigned int ntasks, void * (*fn)(void *));
+
+unsigned int macro_sort_default_threads(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (n < 1) {
+        return 1;
+    }
+
+    return n > MACRO_SORT_MAX_THREADS ? MACRO_SORT_MAX_THREADS : (unsigned int)n;
+}
+
+int macro_parallel_sort(void * base, size_t nmemb, size_t size, MACRO_SORT_COMPARE compar, unsigned int nthreads)
+{
+    SORT_TASK tasks[MACRO_SORT_MAX_THREADS];
+    size_t bounds[MACRO_SORT_MAX_THREADS + 1];
+    unsigned int runs = 1;
+    unsigned int width;
+    unsigned int ntasks;
+    unsigned int i;
+    char * src = base;
+    char * dst;
+    char * tmp;
+
+    assert(base != NULL || nmemb == 0);
+    assert(compar != NULL);
+
+    if (nthreads > MACRO_SORT_MAX_THREADS) {
+        nthreads = MACRO_SORT_MAX_THREADS;
+    }
+
+    /* power of two runs so every merge round pairs them up evenly */
+    while (runs * 2 <= nthreads && nmemb / (runs * 2) >= MACRO_SORT_MIN_PER_THREAD) {
+        runs *= 2;
+    }
+
+    if (runs == 1) {
+        qsort(base, nmemb, size, compar);
+        return 0;
+    }
+
+    if ((tmp = malloc(nmemb * size)) == NULL) {
+        return -1;
+    }
+    dst = tmp;
+
+    for (i = 0; i <= runs; i++) {
+        bounds[i] = nmemb / runs * i + (i == runs ? nmemb % runs : 0);
+    }
+
+    /* Step 1. sort every run on its own */
+    for (i = 0; i < runs; i++) {
+        tasks[i].src    = src;
+        tasks[i].dst    = NULL;
+        tasks[i].lo     = bounds[i];
+        tasks[i].mid    = bounds[i + 1];
+        tasks[i].hi     = bounds[i + 1];
+        tasks[i].size   = size;
+        tasks[i].compar = compar;
+    }
+    run_tasks(tasks, runs, sort_run);
+
+    /* Step 2. merge neighbour runs until one is left, flipping between the array and tmp */
+    for (width = 1; width < runs; width *= 2) {
+
+        ntasks = 0;
+        for (i = 0; i < runs; i += 2 * width) {
+            tasks[ntasks].src    = src;
+            tasks[ntasks].dst    = dst;
+            tasks[ntasks].lo     = bounds[i];
+            tasks[ntasks].mid    = bounds[i + width];
+            tasks[ntasks].hi     = bounds[i + 2 * width];
+            tasks[ntasks].size   = size;
+            tasks[ntasks].compar = compar;
+            ntasks++;
+        }
+        run_tasks(tasks, ntasks, merge_runs);
+
+        dst = src;
+        src = tasks[0].dst;
+    }
+
+    if (src != base) {
+        memcpy(base, src, nmemb * size);
+    }
+
+    free(tmp);
+
+    return 0;
+}
+
+/* run every task in a thread of its own, or inline if no thread can be created */
+static void run_tasks(SORT_TASK * tasks, unsigned int ntasks, void * (*fn)(void *))
+{
+    pthread_t threads[MACRO_SORT_MAX_THREADS];
+    char started[MACRO_SORT_MAX_THREADS];
+    unsigned int i;
+
+    for (i = 1; i < ntasks; i++) {
+        started[i] = pthread_create(&threads[i], NULL, fn, &tasks[i]) == 0;
+        if (!started[i]) {
+            fn(&tasks[i]);
+        }
+    }
+
+    /* the calling thread takes the first task itself */
+    fn(&tasks[0]);
+
+    for (i = 1; i < ntasks; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+static void * sort_run(void * arg)
+{
+    SORT_TASK * task = arg;
+
+    qsort(task->src + task->lo * task->size, task->hi - task->lo, task->size, task->compar);
+
+    return NULL;
+}
+
+static void * merge_runs(void * arg)
+{
+    SORT_TASK * task = arg;
+    size_t size = task->size;
+    char * left      = task->src + task->lo  * size;
+    char * left_end  = task->src + task->mid * size;
+    char * right     = left_end;
+    char * right_end = task->src + task->hi  * size;
+    char * out       = task->dst + task->lo  * size;
+
+    while (left < left_end && right < right_end) {
+        if (task->compar(left, right) <= 0) {
+            memcpy(out, left, size);
+            left += size;
+        } else {
+            memcpy(out, right, size);
+            right += size;
+        }
+        out += size;
+    }
+
+    memcpy(out, left, left_end - left);
+    out += left_end - left;
+    memcpy(out, right, right_end - right);
+
+    return NULL;
+}
@@ -0,0 +1,24 @@
+/*
+ * macro_sort - parallel merge sort used to put scan results into a deterministic order
+ */
+
+#ifndef MACRO_SORT_H
+#define MACRO_SORT_H
+
+#include <stddef.h>
+
+typedef int (*MACRO_SORT_COMPARE)(const void * a, const void * b);
+
+/* how many threads to sort with when the caller does not care: the online CPUs, at least 1 */
+unsigned int macro_sort_default_threads(void);
+
+/*
+ * sort like qsort() does, but split the array over up to 'nthreads' threads that sort their
+ * part with qsort() and then merge the sorted runs pairwise, again one thread per pair.
+ * Small arrays are sorted in the calling thread.
+ *
+ * returns 0 on success, -1 if out of memory(the array is then left untouched).
+ */
+int macro_parallel_sort(void * base, size_t nmemb, size_t size, MACRO_SORT_COMPARE compar, unsigned int nthreads);
+
+#endif /* MACRO_SORT_H */
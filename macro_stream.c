@@ -0,0 +1,119 @@
+/*
+ * macro_stream - write every define and found-from event as soon as the scanner sees it,
+ * see macro_stream.h
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/stat.h>
+
+#include "macro_stream.h"
+
+static void on_define(void * user, const char * name, const char * fpath, unsigned int ln, const char * value);
+static void on_found(void * user, const char * name, const char * fpath, unsigned int ln);
+static void on_file_done(void * user, const char * fpath);
+static void put_escaped(MACRO_WRITER * w, const char * str);
+
+void macro_stream_init(MACRO_STREAM_WRITER * writer, FILE * out, MACRO_SCAN_CALLBACKS * cb)
+{
+    struct stat st;
+
+    assert(writer != NULL);
+    assert(out    != NULL);
+    assert(cb     != NULL);
+
+    macro_writer_init(&writer->w, out);
+    writer->record_nums = 0;
+    writer->per_file    = !(fstat(fileno(out), &st) == 0 && S_ISREG(st.st_mode));
+
+    /* the records are buffered here already */
+    setvbuf(out, NULL, _IONBF, 0);
+
+    cb->on_define    = on_define;
+    cb->on_found     = on_found;
+    cb->on_file_done = on_file_done;
+    cb->user         = writer;
+}
+
+void macro_stream_write(MACRO_STREAM_WRITER * writer, int kind, const char * name, const char * fpath, unsigned int ln, const char * value)
+{
+    MACRO_WRITER * w = &writer->w;
+    char head[2] = { (char)kind, '\t' };
+
+    if (w->failed) {
+        return;
+    }
+
+    macro_writer_put(w, head, 2);
+    put_escaped(w, name);
+    macro_writer_put(w, "\t", 1);
+    put_escaped(w, fpath);
+    macro_writer_put(w, "\t", 1);
+    macro_writer_put_uint(w, ln);
+    macro_writer_put(w, "\t", 1);
+    if (value != NULL) {
+        put_escaped(w, value);
+    }
+    macro_writer_put(w, "\n", 1);
+
+    writer->record_nums++;
+}
+
+int macro_stream_flush(MACRO_STREAM_WRITER * writer)
+{
+    return macro_writer_flush(&writer->w);
+}
+
+static void on_define(void * user, const char * name, const char * fpath, unsigned int ln, const char * value)
+{
+    macro_stream_write(user, MACRO_STREAM_KIND_DEFINE, name, fpath, ln, value);
+}
+
+static void on_found(void * user, const char * name, const char * fpath, unsigned int ln)
+{
+    macro_stream_write(user, MACRO_STREAM_KIND_FOUND, name, fpath, ln, NULL);
+}
+
+static void on_file_done(void * user, const char * fpath)
+{
+    MACRO_STREAM_WRITER * writer = user;
+
+    (void)fpath;
+
+    if (writer->per_file && writer->w.len > 0) {
+        macro_writer_flush(&writer->w);
+    }
+}
+
+/* all of 'str', however long, with tab, newline and backslash escaped */
+static void put_escaped(MACRO_WRITER * w, const char * str)
+{
+    const char * run = str;
+    char esc[2] = { '\\', 0 };
+
+    for (; *str != '\0'; str++) {
+        switch (*str) {
+        case '\t':
+            esc[1] = 't';
+            break;
+        case '\n':
+            esc[1] = 'n';
+            break;
+        case '\\':
+            esc[1] = '\\';
+            break;
+        default:
+            continue;
+        }
+
+        macro_writer_put(w, run, str - run);
+        macro_writer_put(w, esc, 2);
+        run = str + 1;
+    }
+
+    macro_writer_put(w, run, str - run);
+}
@@ -0,0 +1,61 @@
+/*
+ * macro_stream - write every define and found-from event as soon as the scanner sees it
+ *
+ * The writer is hooked into the scan callbacks of a context created without
+ * MACRO_SCAN_BUILD_MATRIX, so no macro table is built and memory does not grow with the tree.
+ * Records go through a fixed buffer that is written out each time it fills up. When the output
+ * is not a regular file(a pipe, a terminal) the buffer is also written out after every file,
+ * so a consumer on the other end starts getting records after the first file. The output is
+ * made unbuffered, stdio does not hold the records a second time.
+ *
+ * One record per line, fields separated by a tab:
+ *
+ *     D <tab> NAME <tab> path <tab> line <tab> value      '#define NAME value', value may be empty
+ *     F <tab> NAME <tab> path <tab> line <tab>            '#ifdef NAME' or '#ifndef NAME'
+ *
+ * Names, paths and values are written in full, however long; a tab, newline or backslash
+ * inside them is written as \t, \n or \\.
+ *
+ * Example:
+ *
+ *     MACRO_STREAM_WRITER writer;
+ *     MACRO_SCAN_CALLBACKS cb;
+ *
+ *     macro_stream_init(&writer, stdout, &cb);
+ *     ctx = macro_scan_create(&cb, 0);
+ *     macro_scan_tree(ctx, "/path/to/project");
+ *     macro_stream_flush(&writer);
+ */
+
+#ifndef MACRO_STREAM_H
+#define MACRO_STREAM_H
+
+#include <stdio.h>
+
+#include "macro_scan.h"
+#include "macro_writer.h"
+
+#define MACRO_STREAM_KIND_DEFINE 'D'
+#define MACRO_STREAM_KIND_FOUND  'F'
+
+typedef struct MACRO_STREAM_WRITER {
+
+   MACRO_WRITER    w;                              /* later records are dropped after a write error */
+   unsigned long   record_nums;
+   int             per_file;                       /* write out after every file, see above */
+
+}MACRO_STREAM_WRITER;
+
+/*
+ * set up 'writer' on 'out' and fill 'cb' with the callbacks that feed it. Call it before
+ * anything else is written to 'out', it turns off the stdio buffering of 'out'.
+ */
+void macro_stream_init(MACRO_STREAM_WRITER * writer, FILE * out, MACRO_SCAN_CALLBACKS * cb);
+
+/* append one record, 'value' may be NULL */
+void macro_stream_write(MACRO_STREAM_WRITER * writer, int kind, const char * name, const char * fpath, unsigned int ln, const char * value);
+
+/* write out what is buffered. returns 0 on success, -1 if any write failed */
+int macro_stream_flush(MACRO_STREAM_WRITER * writer);
+
+#endif /* MACRO_STREAM_H */
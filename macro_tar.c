@@ -0,0 +1,510 @@
+/*
+ * macro_tar - scan the members of a tar archive without extracting it, see macro_tar.h
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "macro_tar.h"
+
+#define TAR_BLOCK 512
+
+/* how much of the archive is read between two drops of its pages, with a budget */
+#define TAR_DROP_BYTES (1024 * 1024)
+
+/* where the fields are in a header block */
+#define TAR_NAME      0
+#define TAR_NAME_LEN  100
+#define TAR_SIZE      124
+#define TAR_SIZE_LEN  12
+#define TAR_CHKSUM    148
+#define TAR_CHKSUM_LEN 8
+#define TAR_TYPE      156
+#define TAR_MAGIC     257
+#define TAR_PREFIX    345
+#define TAR_PREFIX_LEN 155
+
+/* a member read by the reader thread, waiting to be scanned */
+typedef struct TAR_MEMBER {
+
+   char                path[MAX_PATH_LEN];
+   char              * buf;
+   size_t              len;
+   struct TAR_MEMBER * next;
+
+}TAR_MEMBER;
+
+/* what the reader thread and the scanning thread share */
+typedef struct TAR_QUEUE {
+
+   pthread_mutex_t     lock;
+   pthread_cond_t      not_empty;
+   pthread_cond_t      not_full;
+
+   TAR_MEMBER        * head;
+   TAR_MEMBER        * tail;
+   size_t              bytes;       /* member data in the queue */
+
+   int                 done;        /* the reader has finished, see error */
+   int                 error;       /* errno of the reader, 0 if the archive was read to its end */
+   int                 stop;        /* the scanner gave up, the reader should too */
+
+   gzFile              gz;
+   int                 fd;          /* under gz, for the page cache */
+
+   MACRO_BUDGET      * budget;      /* the scan's budget or NULL */
+   z_off_t             charged;     /* archive bytes taken from the budget so far */
+   z_off_t             dropped;     /* archive bytes dropped from the page cache so far */
+
+}TAR_QUEUE;
+
+static void * read_archive(void * arg);
+static int  read_members(TAR_QUEUE * queue);
+static void pace_reading(TAR_QUEUE * queue);
+static void stop_reader(TAR_QUEUE * queue);
+static int  push_member(TAR_QUEUE * queue, TAR_MEMBER * member);
+static TAR_MEMBER * pop_member(TAR_QUEUE * queue);
+static int  read_full(gzFile gz, void * buf, size_t len);
+static int  skip_bytes(gzFile gz, unsigned long long len);
+static int  parse_size(const unsigned char * field, unsigned long long * size);
+static int  check_header(const unsigned char * block);
+static int  parse_pax_path(const char * data, size_t len, char * path);
+
+int macro_scan_tar(MACRO_SCAN_CTX * ctx, const char * archive)
+{
+    TAR_QUEUE queue;
+    TAR_MEMBER * member;
+    pthread_t reader;
+    int fd;
+    int ret = 0;
+    int err = 0;
+
+    assert(ctx     != NULL);
+    assert(archive != NULL);
+
+    memset(&queue, 0, sizeof(TAR_QUEUE));
+    queue.budget = ctx->budget;
+
+    if (queue.budget != NULL) {
+        macro_budget_open(queue.budget);
+    }
+
+    if (strcmp(archive, "-") == 0) {
+        fd = dup(STDIN_FILENO);
+    } else {
+        fd = open(archive, O_RDONLY);
+    }
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    if ((queue.gz = gzdopen(fd, "rb")) == NULL) {
+        close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    queue.fd = fd;
+
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.not_empty, NULL);
+    pthread_cond_init(&queue.not_full, NULL);
+
+    if ((err = pthread_create(&reader, NULL, read_archive, &queue)) != 0) {
+        goto DONE;
+    }
+
+    /* scan what the reader hands over until it is done */
+    while ((member = pop_member(&queue)) != NULL) {
+
+        /* an interrupted budgeted scan leaves the rest of the archive alone, without error */
+        if (ret == 0 && queue.budget != NULL && macro_budget_interrupted()) {
+            ret = 1;
+            stop_reader(&queue);
+        }
+
+        if (ret == 0 && macro_scan_buffer(ctx, member->path, member->buf, member->len) != 0) {
+            err = errno;
+            ret = -1;
+            stop_reader(&queue);
+        }
+
+        free(member->buf);
+        free(member);
+    }
+
+    pthread_join(reader, NULL);
+
+    if (ret == 0 && queue.error != 0) {
+        err = queue.error;
+    }
+
+DONE:
+    if (queue.budget != NULL) {
+        macro_budget_drop_cache(queue.fd);
+    }
+    gzclose(queue.gz);
+    pthread_cond_destroy(&queue.not_full);
+    pthread_cond_destroy(&queue.not_empty);
+    pthread_mutex_destroy(&queue.lock);
+
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void * read_archive(void * arg)
+{
+    TAR_QUEUE * queue = arg;
+    int error = 0;
+
+    if (read_members(queue) != 0) {
+        error = errno != 0 ? errno : EIO;
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    queue->done  = 1;
+    queue->error = error;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+
+    return NULL;
+}
+
+/* unpack the archive into the queue. returns 0 at its end or when stopped, -1 with errno set */
+static int read_members(TAR_QUEUE * queue)
+{
+    unsigned char block[TAR_BLOCK];
+    char long_name[MAX_PATH_LEN] = {0};  /* name for the next member from a 'L' or pax header */
+    char * data;
+    unsigned long long size;
+    unsigned long long padded;
+    TAR_MEMBER * member;
+    size_t len;
+    int type;
+
+    for (;;) {
+        if (queue->budget != NULL) {
+            pace_reading(queue);
+        }
+
+        /* a zero block ends the archive, some writers just stop after the last member */
+        if (gzeof(queue->gz)) {
+            return 0;
+        }
+
+        if (read_full(queue->gz, block, TAR_BLOCK) != 0) {
+            return gzeof(queue->gz) && gztell(queue->gz) % TAR_BLOCK == 0 ? 0 : -1;
+        }
+
+        if (block[0] == '\0' && memcmp(block, block + 1, TAR_BLOCK - 1) == 0) {
+            return 0;
+        }
+
+        if (check_header(block) != 0 || parse_size(block + TAR_SIZE, &size) != 0) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        type   = block[TAR_TYPE];
+        padded = (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+
+        if (type == 'L' || type == 'x') {
+            if (size > 64 * 1024) {
+                errno = EINVAL;
+                return -1;
+            }
+
+            if ((data = malloc((size_t)padded + 1)) == NULL) {
+                errno = ENOMEM;
+                return -1;
+            }
+
+            if (read_full(queue->gz, data, (size_t)padded) != 0) {
+                free(data);
+                return -1;
+            }
+            data[size] = '\0';
+
+            if (type == 'L') {
+                /* names too long for the scanner are dropped with their member */
+                snprintf(long_name, sizeof(long_name), "%s", strlen(data) < MAX_PATH_LEN ? data : "");
+            } else if (parse_pax_path(data, (size_t)size, long_name) != 0) {
+                long_name[0] = '\0';
+            }
+
+            free(data);
+            continue;
+        }
+
+        member = NULL;
+        if (type == '0' || type == '\0' || type == '7') {
+            if ((member = calloc(1, sizeof(TAR_MEMBER))) == NULL) {
+                errno = ENOMEM;
+                return -1;
+            }
+
+            if (long_name[0] != '\0') {
+                len = snprintf(member->path, sizeof(member->path), "%s", long_name);
+            } else if (memcmp(block + TAR_MAGIC, "ustar", 5) == 0 && block[TAR_PREFIX] != '\0') {
+                len = snprintf(member->path, sizeof(member->path), "%.*s/%.*s",
+                               TAR_PREFIX_LEN, (const char *)block + TAR_PREFIX, TAR_NAME_LEN, (const char *)block + TAR_NAME);
+            } else {
+                len = snprintf(member->path, sizeof(member->path), "%.*s", TAR_NAME_LEN, (const char *)block + TAR_NAME);
+            }
+
+            if (len >= sizeof(member->path) || member->path[0] == '\0' || !macro_scan_path_is_wanted(member->path)) {
+                free(member);
+                member = NULL;
+            }
+        }
+        long_name[0] = '\0';
+
+        if (member == NULL) {
+            if (skip_bytes(queue->gz, padded) != 0) {
+                return -1;
+            }
+            continue;
+        }
+
+        if ((member->buf = malloc((size_t)padded + 1)) == NULL) {
+            free(member);
+            errno = ENOMEM;
+            return -1;
+        }
+        member->len = (size_t)size;
+
+        if (read_full(queue->gz, member->buf, (size_t)padded) != 0) {
+            free(member->buf);
+            free(member);
+            return -1;
+        }
+
+        if (push_member(queue, member) != 0) {
+            free(member->buf);
+            free(member);
+            return 0;
+        }
+    }
+}
+
+/*
+ * take what has been read of the archive since the last call from the budget, the compressed
+ * bytes for a gzip archive, and drop it from the page cache every TAR_DROP_BYTES
+ */
+static void pace_reading(TAR_QUEUE * queue)
+{
+    z_off_t offset = gzoffset(queue->gz);
+
+    if (offset < 0) {
+        return;
+    }
+
+    if (offset > queue->charged) {
+        macro_budget_read(queue->budget, (unsigned long long)(offset - queue->charged));
+        queue->charged = offset;
+    }
+
+    if (offset - queue->dropped >= TAR_DROP_BYTES) {
+        macro_budget_drop_cache(queue->fd);
+        queue->dropped = offset;
+    }
+}
+
+/* tell the reader thread to give up, it may be waiting for room in the queue */
+static void stop_reader(TAR_QUEUE * queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->stop = 1;
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/* returns 0, or -1 if the scanner stopped and the member was not taken */
+static int push_member(TAR_QUEUE * queue, TAR_MEMBER * member)
+{
+    pthread_mutex_lock(&queue->lock);
+
+    /* a member bigger than the whole queue still goes in once the queue is empty */
+    while (!queue->stop && queue->head != NULL && queue->bytes + member->len > MACRO_TAR_QUEUE_BYTES) {
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+
+    if (queue->stop) {
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
+    }
+
+    if (queue->tail != NULL) {
+        queue->tail->next = member;
+    } else {
+        queue->head = member;
+    }
+    queue->tail   = member;
+    queue->bytes += member->len;
+
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+
+    return 0;
+}
+
+/* returns the next member, or NULL once the reader is done and the queue is empty */
+static TAR_MEMBER * pop_member(TAR_QUEUE * queue)
+{
+    TAR_MEMBER * member;
+
+    pthread_mutex_lock(&queue->lock);
+
+    while (queue->head == NULL && !queue->done) {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+
+    if ((member = queue->head) != NULL) {
+        if ((queue->head = member->next) == NULL) {
+            queue->tail = NULL;
+        }
+        queue->bytes -= member->len;
+        pthread_cond_signal(&queue->not_full);
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+
+    return member;
+}
+
+/* returns 0, or -1 with errno set, EINVAL if the archive ends early */
+static int read_full(gzFile gz, void * buf, size_t len)
+{
+    unsigned char * p = buf;
+    unsigned int chunk;
+    int n;
+    int errnum;
+
+    while (len > 0) {
+        chunk = len > (1U << 30) ? (1U << 30) : (unsigned int)len;
+
+        if ((n = gzread(gz, p, chunk)) <= 0) {
+            gzerror(gz, &errnum);
+            if (n < 0 && errnum == Z_ERRNO) {
+                return -1;
+            }
+            errno = n < 0 && errnum == Z_MEM_ERROR ? ENOMEM : EINVAL;
+            return -1;
+        }
+
+        p   += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+static int skip_bytes(gzFile gz, unsigned long long len)
+{
+    unsigned char buf[16 * TAR_BLOCK];
+    size_t chunk;
+
+    while (len > 0) {
+        chunk = len > sizeof(buf) ? sizeof(buf) : (size_t)len;
+        if (read_full(gz, buf, chunk) != 0) {
+            return -1;
+        }
+        len -= chunk;
+    }
+
+    return 0;
+}
+
+/* octal, or base-256 with the high bit of the first byte set(GNU, for members over 8GB) */
+static int parse_size(const unsigned char * field, unsigned long long * size)
+{
+    unsigned int k = 0;
+
+    *size = 0;
+
+    if (field[0] & 0x80) {
+        *size = field[0] & 0x7f;
+        for (k = 1; k < TAR_SIZE_LEN; k++) {
+            *size = (*size << 8) | field[k];
+        }
+        return 0;
+    }
+
+    while (k < TAR_SIZE_LEN && field[k] == ' ') {
+        k++;
+    }
+
+    for (; k < TAR_SIZE_LEN && field[k] >= '0' && field[k] <= '7'; k++) {
+        *size = *size * 8 + (field[k] - '0');
+    }
+
+    return (k == TAR_SIZE_LEN || field[k] == '\0' || field[k] == ' ') ? 0 : -1;
+}
+
+/* the checksum is the sum of the header bytes with the checksum field read as spaces */
+static int check_header(const unsigned char * block)
+{
+    unsigned long sum = 0;
+    unsigned long expected = 0;
+    unsigned int k;
+
+    for (k = 0; k < TAR_BLOCK; k++) {
+        sum += (k >= TAR_CHKSUM && k < TAR_CHKSUM + TAR_CHKSUM_LEN) ? ' ' : block[k];
+    }
+
+    for (k = TAR_CHKSUM; k < TAR_CHKSUM + TAR_CHKSUM_LEN && block[k] == ' '; k++) {
+    }
+    for (; k < TAR_CHKSUM + TAR_CHKSUM_LEN && block[k] >= '0' && block[k] <= '7'; k++) {
+        expected = expected * 8 + (block[k] - '0');
+    }
+
+    return sum == expected ? 0 : -1;
+}
+
+/* find the "NN path=VALUE\n" record of a pax header. returns 0 and the value, or -1 */
+static int parse_pax_path(const char * data, size_t len, char * path)
+{
+    const char * p = data;
+    const char * end = data + len;
+    const char * key;
+    const char * value;
+    unsigned long record;
+    char * digits_end;
+
+    while (p < end) {
+        record = strtoul(p, &digits_end, 10);
+        if (record == 0 || (size_t)(end - p) < record || *digits_end != ' ') {
+            return -1;
+        }
+
+        key = digits_end + 1;
+        value = memchr(key, '=', p + record - key);
+        if (value != NULL && value - key == 4 && memcmp(key, "path", 4) == 0) {
+            value++;
+            /* the record ends with '\n' */
+            if ((size_t)(p + record - 1 - value) >= MAX_PATH_LEN) {
+                return -1;
+            }
+            memcpy(path, value, p + record - 1 - value);
+            path[p + record - 1 - value] = '\0';
+            return 0;
+        }
+
+        p += record;
+    }
+
+    return -1;
+}
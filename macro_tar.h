@@ -0,0 +1,31 @@
+/*
+ * macro_tar - scan the members of a tar archive without extracting it
+ *
+ * The archive is read sequentially, plain or gzip compressed(told apart by zlib), so it can
+ * come from a pipe. Members go through the same filter as macro_scan_tree()(see
+ * macro_scan_path_is_wanted()) and are scanned under their member path, e.g.
+ * "linux-6.1/include/linux/kernel.h".
+ *
+ * A reader thread decompresses and unpacks the archive while the calling thread scans the
+ * members it has already handed over, through a queue holding at most MACRO_TAR_QUEUE_BYTES
+ * of member data. The scan context is only ever touched by the calling thread. With a budget
+ * (see macro_scan_set_budget()) the reader paces itself by the archive bytes it has read.
+ *
+ * Understood: ustar and old style headers, GNU long names('L') and pax 'path' records.
+ * Links, devices and directories are skipped.
+ */
+
+#ifndef MACRO_TAR_H
+#define MACRO_TAR_H
+
+#include "macro_scan.h"
+
+#define MACRO_TAR_QUEUE_BYTES (32 * 1024 * 1024)
+
+/*
+ * scan every wanted member of 'archive', "-" is the standard input.
+ * returns 0 on success, -1 with errno set on read error, bad archive(EINVAL) or out of memory.
+ */
+int macro_scan_tar(MACRO_SCAN_CTX * ctx, const char * archive);
+
+#endif /* MACRO_TAR_H */
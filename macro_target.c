@@ -0,0 +1,212 @@
+/*
+ * macro_target - find every use of a given set of macro names in one pass, see macro_target.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include "macro_target.h"
+#include "macro_scan.h"
+
+#define CLASS_NONE   (-1)   /* the byte ends an identifier */
+#define CLASS_OTHER  0      /* an identifier character used by no name */
+
+#define TRIE_SINK    0      /* the identifier is no name and no prefix of one */
+#define TRIE_ROOT    1
+
+static int is_ident_char(int c);
+static void free_trie(MACRO_TARGETS * targets);
+
+void macro_targets_init(MACRO_TARGETS * targets)
+{
+    memset(targets, 0, sizeof(MACRO_TARGETS));
+    str_pool_init(&targets->names);
+}
+
+void macro_targets_free(MACRO_TARGETS * targets)
+{
+    if (targets == NULL) {
+        return;
+    }
+
+    free_trie(targets);
+    str_pool_free(&targets->names);
+}
+
+int macro_targets_add(MACRO_TARGETS * targets, const char * name, size_t len)
+{
+    unsigned int id;
+    size_t k;
+
+    if (len == 0 || len >= MAX_MACRO_NAME_LEN || isdigit((unsigned char)name[0])) {
+        return 1;
+    }
+
+    for (k = 0; k < len; k++) {
+        if (!is_ident_char((unsigned char)name[k])) {
+            return 1;
+        }
+    }
+
+    return str_pool_intern(&targets->names, name, len, &id) != 0 ? -1 : 0;
+}
+
+int macro_targets_read(MACRO_TARGETS * targets, FILE * in)
+{
+    char line[MAX_LINE_LEN];
+    char * name;
+    size_t len;
+    int ret;
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+
+        for (name = line; isspace((unsigned char)*name); name++) {
+        }
+
+        for (len = strlen(name); len > 0 && isspace((unsigned char)name[len - 1]); len--) {
+        }
+
+        if (len == 0 || name[0] == '#') {
+            continue;
+        }
+
+        if ((ret = macro_targets_add(targets, name, len)) < 0) {
+            return -1;
+        }
+
+        if (ret > 0) {
+            fprintf(stderr, "Not a macro name, skipped: %.*s\n", (int)len, name);
+        }
+    }
+
+    return ferror(in) ? -1 : 0;
+}
+
+int macro_targets_compile(MACRO_TARGETS * targets)
+{
+    unsigned int nums = str_pool_nums(&targets->names);
+    unsigned int max_states = TRIE_ROOT + 1;
+    unsigned int state;
+    unsigned int child;
+    unsigned int id;
+    unsigned int c;
+    const unsigned char * p;
+
+    free_trie(targets);
+
+    /* Step 1. a class for every character some name uses, the other identifier characters share one */
+    targets->class_nums = CLASS_OTHER + 1;
+    for (c = 0; c < 256; c++) {
+        targets->char_class[c] = is_ident_char(c) ? CLASS_OTHER : CLASS_NONE;
+    }
+
+    for (id = 0; id < nums; id++) {
+        for (p = (const unsigned char *)str_pool_get(&targets->names, id); *p != '\0'; p++) {
+            if (targets->char_class[*p] == CLASS_OTHER) {
+                targets->char_class[*p] = (signed char)targets->class_nums++;
+            }
+            max_states++;
+        }
+    }
+
+    targets->next   = calloc((size_t)max_states * targets->class_nums, sizeof(unsigned int));
+    targets->target = calloc(max_states, sizeof(unsigned int));
+    if (targets->next == NULL || targets->target == NULL) {
+        free_trie(targets);
+        return -1;
+    }
+
+    /* Step 2. the trie, a missing child is a transition to the sink(0), which all of its own go back to */
+    targets->state_nums = TRIE_ROOT + 1;
+    for (id = 0; id < nums; id++) {
+        state = TRIE_ROOT;
+        for (p = (const unsigned char *)str_pool_get(&targets->names, id); *p != '\0'; p++) {
+            c = targets->char_class[*p];
+            if (targets->next[state * targets->class_nums + c] == TRIE_SINK) {
+                child = targets->state_nums++;
+                targets->next[state * targets->class_nums + c] = child;
+            }
+            state = targets->next[state * targets->class_nums + c];
+        }
+        targets->target[state] = id + 1;
+    }
+
+    return 0;
+}
+
+void macro_target_iter_init(MACRO_TARGET_ITER * iter, const MACRO_TARGETS * targets, const char * buf, size_t len)
+{
+    assert(targets->next != NULL);
+
+    iter->targets = targets;
+    iter->pcursor = buf;
+    iter->pend    = buf + len;
+    iter->line    = buf;
+    iter->ln      = 1;
+}
+
+int macro_target_iter_next(MACRO_TARGET_ITER * iter, unsigned int * target, unsigned int * ln, const char ** line, size_t * offset)
+{
+    const MACRO_TARGETS * targets = iter->targets;
+    const unsigned char * p = (const unsigned char *)iter->pcursor;
+    const unsigned char * pend = (const unsigned char *)iter->pend;
+    const unsigned char * start = NULL;   /* start of the identifier being read */
+    unsigned int state = TRIE_SINK;
+    int c;
+
+    /* always called on an identifier boundary: the start of the buffer or the byte after a name */
+    for (; p < pend; p++) {
+        c = targets->char_class[*p];
+
+        if (c != CLASS_NONE) {
+            if (start == NULL) {
+                start = p;
+                state = TRIE_ROOT;
+            }
+            state = targets->next[state * targets->class_nums + c];
+            continue;
+        }
+
+        /* end of an identifier, the trie walk from the root spelled a whole name or ended in the sink */
+        if (start != NULL && targets->target[state] != 0) {
+            break;
+        }
+
+        start = NULL;
+        if (*p == '\n') {
+            iter->ln++;
+            iter->line = (const char *)p + 1;
+        }
+    }
+
+    iter->pcursor = (const char *)p;
+
+    /* p is on the byte after the name, or at the end of the buffer */
+    if (start != NULL && targets->target[state] != 0) {
+        *target = targets->target[state] - 1;
+        *ln     = iter->ln;
+        *line   = iter->line;
+        *offset = (const char *)start - iter->line;
+        return 1;
+    }
+
+    return 0;
+}
+
+static int is_ident_char(int c)
+{
+    return isalnum(c) || c == '_';
+}
+
+static void free_trie(MACRO_TARGETS * targets)
+{
+    free(targets->next);
+    free(targets->target);
+
+    targets->next       = NULL;
+    targets->target     = NULL;
+    targets->state_nums = 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * macro_target - find every use of a given set of macro names in one pass
+ *
+ * The names are compiled into a trie kept as a transition table, and every identifier of a
+ * file is walked down it from the root, so each byte costs one table lookup no matter how
+ * many names there are. A byte the trie has no transition for leads to a sink state that
+ * stays there until the identifier ends. A name matches only when the whole identifier is
+ * that name, so FOO does not match in FOO_BAR or MY_FOO; there is no need for the failure
+ * links of Aho-Corasick, which find names inside other words.
+ *
+ * Identifier characters that appear in no name share one character class, which keeps the
+ * table at (states x distinct characters used) entries.
+ *
+ * Comments and string literals are not skipped, every spelling of a name is reported.
+ */
+
+#ifndef MACRO_TARGET_H
+#define MACRO_TARGET_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "str_pool.h"
+
+typedef struct MACRO_TARGETS {
+
+   STR_POOL         names;          /* the names looked for, the id is the target id */
+
+   signed char      char_class[256];/* byte -> character class, -1 for a byte that ends an identifier */
+   unsigned int     class_nums;
+
+   unsigned int   * next;           /* state * class_nums + class -> state, 0 is the sink, 1 the root */
+   unsigned int   * target;         /* state -> target id + 1 if a name ends there, 0 otherwise */
+   unsigned int     state_nums;
+
+}MACRO_TARGETS;
+
+/* where macro_targets_next() is in a buffer */
+typedef struct MACRO_TARGET_ITER {
+
+   const MACRO_TARGETS * targets;
+   const char          * pcursor;
+   const char          * pend;
+   const char          * line;      /* start of the current line */
+   unsigned int          ln;        /* current line number, from 1 */
+
+}MACRO_TARGET_ITER;
+
+void macro_targets_init(MACRO_TARGETS * targets);
+void macro_targets_free(MACRO_TARGETS * targets);
+
+/*
+ * add one name, it must be a C identifier shorter than MAX_MACRO_NAME_LEN. Adding the same
+ * name twice is harmless. macro_targets_compile() has to be called again after adding.
+ * returns 0 on success, 1 if the name is not an identifier(nothing is added), -1 if out of memory.
+ */
+int macro_targets_add(MACRO_TARGETS * targets, const char * name, size_t len);
+
+/*
+ * add the names listed in 'in', one per line. Blank lines and lines starting with '#' are
+ * skipped, names that are not identifiers are reported on stderr and skipped.
+ * returns 0 on success, -1 on read error or if out of memory.
+ */
+int macro_targets_read(MACRO_TARGETS * targets, FILE * in);
+
+/* build the trie from the names added so far. returns 0, or -1 if out of memory */
+int macro_targets_compile(MACRO_TARGETS * targets);
+
+#define macro_targets_nums(targets)     str_pool_nums(&(targets)->names)
+#define macro_targets_name(targets, id) str_pool_get(&(targets)->names, (id))
+
+void macro_target_iter_init(MACRO_TARGET_ITER * iter, const MACRO_TARGETS * targets, const char * buf, size_t len);
+
+/*
+ * find the next use of any name in the buffer. returns 1 and the target id, the line number,
+ * the start of that line and the offset of the name in the line, or 0 at the end of the buffer.
+ */
+int macro_target_iter_next(MACRO_TARGET_ITER * iter, unsigned int * target, unsigned int * ln, const char ** line, size_t * offset);
+
+#endif /* MACRO_TARGET_H */
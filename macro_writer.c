@@ -0,0 +1,77 @@
+/*
+ * macro_writer - buffered output shared by the stream records and the exporters,
+ * see macro_writer.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "macro_writer.h"
+
+void macro_writer_init(MACRO_WRITER * w, FILE * out)
+{
+    assert(w   != NULL);
+    assert(out != NULL);
+
+    w->out    = out;
+    w->len    = 0;
+    w->failed = 0;
+}
+
+void macro_writer_put(MACRO_WRITER * w, const char * bytes, size_t len)
+{
+    size_t n;
+
+    while (len > 0 && !w->failed) {
+        if (w->len == MACRO_WRITER_BUF_SIZE) {
+            if (fwrite(w->buf, 1, w->len, w->out) != w->len) {
+                w->failed = 1;
+            }
+            w->len = 0;
+        }
+
+        n = MACRO_WRITER_BUF_SIZE - w->len;
+        if (n > len) {
+            n = len;
+        }
+
+        memcpy(w->buf + w->len, bytes, n);
+        w->len += n;
+        bytes  += n;
+        len    -= n;
+    }
+}
+
+void macro_writer_put_str(MACRO_WRITER * w, const char * str)
+{
+    macro_writer_put(w, str, strlen(str));
+}
+
+void macro_writer_put_uint(MACRO_WRITER * w, unsigned int v)
+{
+    char digits[10];
+    int n = sizeof(digits);
+
+    do {
+        digits[--n] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+
+    macro_writer_put(w, digits + n, sizeof(digits) - n);
+}
+
+int macro_writer_flush(MACRO_WRITER * w)
+{
+    if (!w->failed && w->len > 0 && fwrite(w->buf, 1, w->len, w->out) != w->len) {
+        w->failed = 1;
+    }
+
+    w->len = 0;
+
+    if (!w->failed && fflush(w->out) != 0) {
+        w->failed = 1;
+    }
+
+    return w->failed ? -1 : 0;
+}
@@ -0,0 +1,35 @@
+/*
+ * macro_writer - buffered output shared by the stream records and the exporters
+ *
+ * Bytes are collected in a fixed buffer that is handed to the output with one fwrite() each
+ * time it fills up and on macro_writer_flush(). The first write error is remembered and
+ * everything after it is dropped, so callers check once at the end.
+ */
+
+#ifndef MACRO_WRITER_H
+#define MACRO_WRITER_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define MACRO_WRITER_BUF_SIZE (64 * 1024)
+
+typedef struct MACRO_WRITER {
+
+   FILE          * out;
+   size_t          len;                            /* bytes waiting in buf */
+   int             failed;                         /* set on the first write error, later output is dropped */
+   char            buf[MACRO_WRITER_BUF_SIZE];
+
+}MACRO_WRITER;
+
+void macro_writer_init(MACRO_WRITER * w, FILE * out);
+
+void macro_writer_put(MACRO_WRITER * w, const char * bytes, size_t len);
+void macro_writer_put_str(MACRO_WRITER * w, const char * str);
+void macro_writer_put_uint(MACRO_WRITER * w, unsigned int v);
+
+/* write out what is buffered and flush 'out'. returns 0 on success, -1 if any write failed */
+int  macro_writer_flush(MACRO_WRITER * w);
+
+#endif /* MACRO_WRITER_H */
@@ -13,8 +13,59 @@
  *              $ISA_SW_TOP/common_sw/adaptation_isa_sw/baseband_components/memory/nvd/nvd_srv.c
  *
  *
+ * Usage:
+ *       list_macros [options] [dir|file ...]     scan the given paths, or the current directory
+ *       list_macros diff OLD NEW                 compare two files written by --save(see macro_diff.h)
+ *
+ *       (no option)                 dump every macro with its define and found-from sites
+ *       --sort                      dump in a deterministic order: macros by name, sites by (path, line),
+ *                                   so the output of two runs can be diffed
+ *       --stream                    write each define/found-from site as a tab separated record the moment it
+ *                                   is found(see macro_stream.h), without building the macro table
+ *       --tar=ARCHIVE               also scan the members of a tar archive, plain or gzip compressed, "-" for
+ *                                   the standard input(see macro_tar.h). Repeatable
+ *       --targets=FILE              only look for the macro names listed in FILE(one per line), but everywhere:
+ *                                   '#if' expressions, code and macro arguments too(see macro_target.h).
+ *                                   Works with the dump, --sort, --stream, --save, --ctags, --index and --report=dead
+ *       --sample=FRACTION           estimate the totals and the most used macros from a random sample of the
+ *                                   files, e.g. 0.05 or 5%(see macro_sample.h) instead of scanning all of them.
+ *                                   Only takes dirs, the other outputs and --tar can not be used with it
+ *         [--seed=N]                draw the same sample again
+ *         [--top=N]                 how many of the most used macros to list, 20 by default
+ *       --max-read=RATE             read at most RATE bytes per second, K, M or G may follow(see macro_budget.h)
+ *       --max-opens=N               open at most N files per second
+ *       --cpu-share=FRACTION        use at most that share of one CPU, e.g. 0.25 or 25%
+ *       --progress=SECONDS          how often the progress of a budgeted scan is written to stderr, 5 by default.
+ *                                   Any of these four runs a budgeted scan: read pages are dropped from the page
+ *                                   cache, and the first Ctrl-C stops the scan but still writes what was found
+ *       --save=FILE                 write the scan result as a compact snapshot file(see macro_snapshot.h)
+ *                                   instead of dumping it as text
+ *       --ctags=FILE                write the '#define' sites as a sorted ctags file(see macro_export.h), so
+ *                                   editors jump from a name to its defines without scanning again
+ *       --index=FILE                write the define and found-from sites as a JSON index(see macro_export.h)
+ *       --visible-from=FILE         list the '#define' sites that reach FILE through its '#include' chain
+ *         [--macro=NAME]            only for macro NAME
+ *         [-I DIR ...]              where '#include' names are looked for, after the includer's directory
+ *       --report=dead               list macros that are defined but never tested(dead) and
+ *                                   macros that are tested but never defined(dangling)
+ *       --report=conflicts          list macros defined with different values in different places, e.g. 1 in
+ *                                   one header and 0 in another, with the define sites of each value
+ *       --report=dirs               list directories by the sites in their subtree(see macro_dir.h)
+ *         [--depth=N]               only the directories N levels below the common top directory
+ *         [--by=uses|defines|files] what to sort by, uses by default
+ *       --report=gated              list macros that guard code, by how many lines they control
+ *       --gated=NAME                list the '#ifdef NAME'/'#ifndef NAME' regions and the lines they control
+ *         [--in=FILE]               only in FILE, spelled as it was scanned
+ *
+ * Build:
+ *       make               builds list_macros, 'make test' also runs the checks in tests/
+ *   or
+ *       cc -std=c99 -pthread -o list_macros main.c macro_scan.c macro_postings.c macro_snapshot.c macro_include.c macro_region.c macro_stream.c macro_target.c macro_dir.c macro_diff.c macro_export.c macro_budget.c macro_tar.c macro_sample.c macro_sort.c macro_writer.c str_pool.c -lz -lm
+ *
+ * The scanning itself lives in macro_scan.c(see macro_scan.h) so it can be linked into other tools,
+ * this file only parses the command line and prints the results.
+ *
  * TODO:
- *       - scan just one time to get both define-in and found-from info...
  *       - support this format: #if define(xxx) and #if !define(xxx).Currently only support #ifdef and #ifndef
  *       - move skip_files stuff into an individual file for easy adding by user
  *       - support * in skip_files,like 'test_*' - skip all files begin with 'test_'
@@ -27,145 +78,468 @@
  *     1.1 Include Files
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
-#include <assert.h>
-#include <ctype.h>
-#include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
-#include <time.h>
 #include <errno.h>
-#include <sys/types.h>
+#include <limits.h>
+#include <getopt.h>
+#include <time.h>
 #include <sys/param.h>
-#include <sys/stat.h>
-
-/*  1   GLOBAL */
-unsigned long g_file_nums;  /* how many files be processed. for outputting summary information only */
-unsigned long g_macro_nums; /* how many macros we found. for outputting summary information only */
 
+#include "macro_scan.h"
+#include "macro_budget.h"
+#include "macro_include.h"
+#include "macro_diff.h"
+#include "macro_export.h"
+#include "macro_region.h"
+#include "macro_sample.h"
+#include "macro_snapshot.h"
+#include "macro_stream.h"
+#include "macro_tar.h"
+#include "macro_sort.h"
 
 /*  2   LOCAL CONSTANTS AND MACROS  */
-//#define DEBUG
-#define MAX_PATH_LEN 512
-#define MAX_LINE_LEN 512*2
 
-#define MAX_MACRO_NAME_LEN  512
-#define MAX_MACRO_VALUE_LEN 512
-#define MAX_CHARACTER_NUMS ('Z'-'A'+1+1)
+/* what main() prints after the matrix has been built */
+#define OUTPUT_MODE_DUMP        0   /* the full macro matrix, see macro_scan_dump() */
+#define OUTPUT_MODE_REPORT_DEAD 1   /* dead and dangling macros, see macro_scan_report_dead() */
+#define OUTPUT_MODE_VISIBLE     2   /* defines visible from one file, see macro_include_report_visible() */
+#define OUTPUT_MODE_GATED_RANK  3   /* macros by lines they control, see macro_region_report_ranked() */
+#define OUTPUT_MODE_GATED       4   /* regions of one macro, see macro_region_report_macro() */
+#define OUTPUT_MODE_STREAM      5   /* records written while scanning, see macro_stream.h */
+#define OUTPUT_MODE_DIRS        6   /* counts per directory, see macro_dir_report() */
+#define OUTPUT_MODE_CONFLICTS   7   /* macros defined with different values, see macro_scan_report_conflicts() */
 
-/* put all illegal characters contains in the macro name here...MUST END BY '\0' */
-const char _illegal_chars[] = {'(',')','\\','"','#','*','{','}','\0'};
+/*  3   MODULE CODE */
 
-const char * _skip_files[] = { "testscript_dodo.c",
-                               NULL };
+/* --sample: only a part of the files below 'roots'(or the current directory) is scanned */
+static int sample_main(double fraction, unsigned long long seed, unsigned int top, char * const * roots, int root_nums)
+{
+   char cwd[MAXPATHLEN] = {0};
+   MACRO_SAMPLE sample;
+   int k;
 
-/*  3   MODULE DATA STRUCTURES      */
-typedef struct FILE_INFO_NODE {
+   if (macro_sample_init(&sample, fraction, seed, top) != 0) {
+      fprintf(stderr, "Out of memory\n");
+      exit(0);
+   }
 
-   char                    path[MAX_PATH_LEN];
-   struct FILE_INFO_NODE * next;
+   if (root_nums == 0) {
+      if (getcwd(cwd, sizeof(cwd)) == NULL) {
+         fprintf(stderr, "Can not get current directory:%s\n", strerror(errno));
+         exit(0);
+      }
 
-}FILE_INFO_NODE;
+      if (macro_sample_add_root(&sample, cwd) != 0) {
+         fprintf(stderr, "List %s failed:%s\n", cwd, strerror(errno));
+         exit(0);
+      }
+   }
 
-typedef struct DEFINE_INFO_NODE {
+   for (k = 0; k < root_nums; k++) {
+      if (macro_sample_add_root(&sample, roots[k]) != 0) {
+         fprintf(stderr, "List %s failed:%s\n", roots[k], strerror(errno));
+         exit(0);
+      }
+   }
 
-   char       * fpath;     /* the path of the file that defined the macro */
-   char       * value;     /* value of the macro. e.g. #define MAX_PATH 256, the value is 256 */
-   unsigned int ln;        /* line number */
+   if (macro_sample_run(&sample) != 0) {
+      fprintf(stderr, "Sampling failed:%s\n", strerror(errno));
+      exit(0);
+   }
 
-   struct DEFINE_INFO_NODE * next;
+   macro_sample_report(&sample, top, stdout);
+   macro_sample_free(&sample);
 
-}DEFINE_INFO_NODE;
+   return 1;
+}
 
-typedef struct FOUND_INFO_NODE {
+/* "10M" -> 10485760, returns 0 or -1 if 'arg' is not a positive number with an optional K, M or G */
+static int parse_rate(const char * arg, double * rate)
+{
+   char * end;
+
+   *rate = strtod(arg, &end);
+
+   switch (*end) {
+   case 'G': case 'g':
+      *rate *= 1024;
+      /* fall through */
+   case 'M': case 'm':
+      *rate *= 1024;
+      /* fall through */
+   case 'K': case 'k':
+      *rate *= 1024;
+      end++;
+      break;
+   default:
+      break;
+   }
 
-   char       * fpath;     /* the path of the file that used the macro */
-   unsigned int ln;        /* line number */
+   return *end == '\0' && *rate > 0 ? 0 : -1;
+}
 
-   struct FOUND_INFO_NODE * next;
+/* "12" -> 12, returns 0 or -1 if 'arg' is not a whole decimal number from 0 to 'max' */
+static int parse_count(const char * arg, unsigned long max, unsigned long * count)
+{
+   char * end;
 
-}FOUND_INFO_NODE;
+   if (*arg < '0' || *arg > '9') {
+      return -1;
+   }
 
-typedef struct MACRO_INFO_NODE {
+   errno  = 0;
+   *count = strtoul(arg, &end, 10);
 
-   char               name[MAX_MACRO_NAME_LEN];  /* macro name */
-   DEFINE_INFO_NODE * di;        /* the macro defined in where and its value,line number */
-   FOUND_INFO_NODE  * fi;        /* the macro found from where and its line number */
+   return *end == '\0' && errno == 0 && *count <= max ? 0 : -1;
+}
 
-   struct MACRO_INFO_NODE * next;
+/* --ctags, --index: write 'path' with one of the exporters of macro_export.h */
+static void export_file(const MACRO_SCAN_CTX * ctx, const char * path, int (*export_fn)(const MACRO_SCAN_CTX *, FILE *, unsigned int))
+{
+   FILE * fd;
 
-}MACRO_INFO_NODE,* PMACRO_INFO_NODE;
+   if ((fd = fopen(path, "w")) == NULL) {
+      fprintf(stderr, "Open %s failed:%s\n", path, strerror(errno));
+      exit(0);
+   }
 
-typedef struct MACRO_MATRIX_ELEMENT {
+   if (export_fn(ctx, fd, macro_sort_default_threads()) != 0) {
+      fprintf(stderr, "Write %s failed:%s\n", path, strerror(errno));
+      exit(0);
+   }
 
-  MACRO_INFO_NODE * header;  /* point to the first node of macro infor linker(see MACRO_INFO_NODE) */
-  // MACRO_INFO_NODE * last;    /* point to the last node of macro infor linker(see MACRO_INFO_NODE) */
+   fclose(fd);
+}
 
-}MACRO_MATRIX_ELEMENT;
+/* list_macros diff OLD NEW */
+static int diff_main(int argc, char * argv[])
+{
+   FILE * old_fd;
+   FILE * new_fd;
 
-/*  4   Local Function Prototypes  */
-static char append_define_info_into_linker(MACRO_INFO_NODE * pheader,char * macro_name,char * hostfile,char * value,unsigned int line_number);
-static void append_define_info_into_matrix(char * single_file, MACRO_MATRIX_ELEMENT * macro_matrix);
-static char append_found_from_info_into_linker(MACRO_INFO_NODE * pheader,char * macro_name,char * hostfile,unsigned int line_number);
-static void append_found_from_info_into_matrix(char * single_file, MACRO_MATRIX_ELEMENT * macro_matrix);
-static void dump_macro_matrix(MACRO_MATRIX_ELEMENT * macro_matrix);
-static void free_macro_matrix(MACRO_MATRIX_ELEMENT * macro_matrix);
-static unsigned int macro_have_illegal_characters(char * str);
-static char * rtrim(char * str);
-static char * ltrim(char * str);
+   if (argc != 4) {
+      fprintf(stderr, "Usage: %s diff OLD NEW\n", argv[0]);
+      exit(0);
+   }
 
-/*  5   MODULE CODE */
+   if ((old_fd = fopen(argv[2], "rb")) == NULL) {
+      fprintf(stderr, "Open %s failed:%s\n", argv[2], strerror(errno));
+      exit(0);
+   }
 
-int main(int argc, char * argv[])
-{
-   FILE * fd = NULL;
-   char fpath[MAX_PATH_LEN] = {0};
+   if ((new_fd = fopen(argv[3], "rb")) == NULL) {
+      fprintf(stderr, "Open %s failed:%s\n", argv[3], strerror(errno));
+      exit(0);
+   }
 
-   FILE_INFO_NODE * pfin_header = NULL;
-   FILE_INFO_NODE * pfin_cursor = NULL;
+   if (macro_diff_snapshots(old_fd, new_fd, stdout) != 0) {
+      fprintf(stderr, "Compare %s with %s failed:%s\n", argv[2], argv[3], strerror(errno));
+      exit(0);
+   }
 
-   unsigned int idx;
-   unsigned int bcontinue;
+   fclose(old_fd);
+   fclose(new_fd);
 
-   /* A to Z plus '_', each element points to a linker header that contain all macros infor(name,defined in,found from) with same capital letter
-      macro_matrix[0] is all macros begin 'A'
-      macro_matrix[25] is all macros begin 'Z'
-      macro_matrix[26] is all macros begin '_'
-    */
-   MACRO_MATRIX_ELEMENT  macro_matrix[MAX_CHARACTER_NUMS];
+   return 1;
+}
+
+int main(int argc, char * argv[])
+{
+   char cwd[MAXPATHLEN] = {0};
+
+   MACRO_SCAN_CTX * ctx;
+   MACRO_INCLUDE_GRAPH * graph;
+   MACRO_REGION_INDEX * regions;
+   MACRO_SCAN_CALLBACKS cb = { NULL, NULL, NULL, NULL };
+   static MACRO_STREAM_WRITER writer;
+   MACRO_TARGETS targets;
+   MACRO_BUDGET budget;
+
+   unsigned int output_mode = OUTPUT_MODE_DUMP;
+   unsigned int sorted = 0;
+   unsigned int streamed = 0;
+   const char * save_path = NULL;
+   const char * ctags_path = NULL;
+   const char * index_path = NULL;
+   const char * visible_from = NULL;
+   const char * macro_name = NULL;
+   const char * gated_in = NULL;
+   const char * targets_path = NULL;
+   const char ** include_paths;
+   unsigned int include_path_nums = 0;
+   const char ** archives;
+   unsigned int archive_nums = 0;
+   unsigned int k;
+   int dir_depth = MACRO_DIR_ALL_DEPTHS;
+   int dir_by = MACRO_DIR_BY_USES;
+   double sample_fraction = 0;
+   unsigned long long sample_seed = (unsigned long long)time(NULL);
+   unsigned int sample_top = 20;
+   double read_rate = 0;
+   double open_rate = 0;
+   double cpu_share = 0;
+   double progress_every = 0;
+   unsigned int budgeted = 0;
+   char * end;
+   unsigned long count;
+   unsigned int scan_flags = MACRO_SCAN_BUILD_MATRIX;
+   unsigned int file;
+   FILE * save_fd;
+   FILE * targets_fd;
+   int opt;
+
+   static const struct option long_options[] = {
+      { "report", required_argument, NULL, 'r' },
+      { "sort",   no_argument,       NULL, 's' },
+      { "save",   required_argument, NULL, 'o' },
+      { "visible-from", required_argument, NULL, 'V' },
+      { "macro",        required_argument, NULL, 'm' },
+      { "include-path", required_argument, NULL, 'I' },
+      { "gated",        required_argument, NULL, 'g' },
+      { "in",           required_argument, NULL, 'i' },
+      { "stream",       no_argument,       NULL, 'S' },
+      { "targets",      required_argument, NULL, 't' },
+      { "tar",          required_argument, NULL, 'T' },
+      { "depth",        required_argument, NULL, 'd' },
+      { "by",           required_argument, NULL, 'b' },
+      { "sample",       required_argument, NULL, 'p' },
+      { "seed",         required_argument, NULL, 'e' },
+      { "top",          required_argument, NULL, 'n' },
+      { "ctags",        required_argument, NULL, 'c' },
+      { "index",        required_argument, NULL, 'x' },
+      { "max-read",     required_argument, NULL, 'R' },
+      { "max-opens",    required_argument, NULL, 'O' },
+      { "cpu-share",    required_argument, NULL, 'C' },
+      { "progress",     required_argument, NULL, 'P' },
+      { NULL,     0,                 NULL,  0  }
+   };
+
+   if (argc > 1 && strcmp(argv[1], "diff") == 0) {
+      return diff_main(argc, argv);
+   }
 
-   for(idx = 0; idx < MAX_CHARACTER_NUMS; idx++) {
-      macro_matrix[idx].header = NULL;
+   if ((include_paths = malloc(argc * sizeof(char *))) == NULL ||
+       (archives = malloc(argc * sizeof(char *))) == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      exit(0);
    }
 
-   /* Step 1. Find all files(*.c,*.cc,*.cpp,*.h,*.hi,*.inc) that may contain macro with full path */
-   /*------------------------------------------------------------------------------------------------*/
-   const char cmd_get_all_files[] = "find $PWD \\( -iname \"*.c\" -o -iname \"*.cc\" -o -iname \"*.cpp\" -o -iname \"*.h\" -o -iname \"*.hi\" -o -iname \"*.inc\" \\) > src_files";
-   /* const char cmd_remove_newline_character[] = "perl -p -e 's/\\s+$/ /g' src_files"; */
+   while ((opt = getopt_long(argc, argv, "r:so:V:m:I:g:i:St:T:d:b:p:e:n:c:x:R:O:C:P:", long_options, NULL)) != -1) {
+      switch (opt) {
+      case 'r':
+         if (strcmp(optarg, "dead") == 0) {
+            output_mode = OUTPUT_MODE_REPORT_DEAD;
+         } else if (strcmp(optarg, "conflicts") == 0) {
+            output_mode = OUTPUT_MODE_CONFLICTS;
+         } else if (strcmp(optarg, "dirs") == 0) {
+            output_mode = OUTPUT_MODE_DIRS;
+            scan_flags |= MACRO_SCAN_DIRS;
+         } else if (strcmp(optarg, "gated") == 0) {
+            output_mode = OUTPUT_MODE_GATED_RANK;
+            scan_flags |= MACRO_SCAN_REGIONS;
+         } else {
+            fprintf(stderr, "Unknown report '%s', supported: conflicts, dead, dirs, gated\n", optarg);
+            exit(0);
+         }
+         break;
+      case 's':
+         sorted = 1;
+         break;
+      case 'o':
+         save_path = optarg;
+         break;
+      case 'c':
+         ctags_path = optarg;
+         break;
+      case 'x':
+         index_path = optarg;
+         break;
+      case 'V':
+         visible_from = optarg;
+         output_mode  = OUTPUT_MODE_VISIBLE;
+         scan_flags  |= MACRO_SCAN_INCLUDES;
+         break;
+      case 'm':
+         macro_name = optarg;
+         break;
+      case 'I':
+         include_paths[include_path_nums++] = optarg;
+         break;
+      case 'g':
+         macro_name  = optarg;
+         output_mode = OUTPUT_MODE_GATED;
+         scan_flags |= MACRO_SCAN_REGIONS;
+         break;
+      case 'i':
+         gated_in = optarg;
+         break;
+      case 'S':
+         streamed = 1;
+         break;
+      case 't':
+         targets_path = optarg;
+         break;
+      case 'T':
+         archives[archive_nums++] = optarg;
+         break;
+      case 'd':
+         if (parse_count(optarg, INT_MAX, &count) != 0) {
+            fprintf(stderr, "Bad depth '%s', give the levels below the top directory like 2\n", optarg);
+            exit(0);
+         }
+         dir_depth = (int)count;
+         break;
+      case 'p':
+         sample_fraction = strtod(optarg, &end);
+         if (*end == '%') {
+            sample_fraction /= 100;
+            end++;
+         }
+         if (*end != '\0' || !(sample_fraction > 0 && sample_fraction <= 1)) {
+            fprintf(stderr, "Bad sample '%s', give a fraction like 0.05 or 5%%\n", optarg);
+            exit(0);
+         }
+         break;
+      case 'e':
+         errno = 0;
+         sample_seed = strtoull(optarg, &end, 10);
+         if (*optarg < '0' || *optarg > '9' || *end != '\0' || errno != 0) {
+            fprintf(stderr, "Bad seed '%s', give a whole number like 42\n", optarg);
+            exit(0);
+         }
+         break;
+      case 'n':
+         if (parse_count(optarg, UINT_MAX, &count) != 0) {
+            fprintf(stderr, "Bad top '%s', give how many macros to list like 20\n", optarg);
+            exit(0);
+         }
+         sample_top = (unsigned int)count;
+         break;
+      case 'b':
+         if (strcmp(optarg, "uses") == 0) {
+            dir_by = MACRO_DIR_BY_USES;
+         } else if (strcmp(optarg, "defines") == 0) {
+            dir_by = MACRO_DIR_BY_DEFINES;
+         } else if (strcmp(optarg, "files") == 0) {
+            dir_by = MACRO_DIR_BY_FILES;
+         } else {
+            fprintf(stderr, "Unknown order '%s', supported: uses, defines, files\n", optarg);
+            exit(0);
+         }
+         break;
+      case 'R':
+         if (parse_rate(optarg, &read_rate) != 0) {
+            fprintf(stderr, "Bad read rate '%s', give bytes per second like 500K or 20M\n", optarg);
+            exit(0);
+         }
+         budgeted = 1;
+         break;
+      case 'O':
+         if (parse_rate(optarg, &open_rate) != 0) {
+            fprintf(stderr, "Bad open rate '%s', give files per second like 200\n", optarg);
+            exit(0);
+         }
+         budgeted = 1;
+         break;
+      case 'C':
+         cpu_share = strtod(optarg, &end);
+         if (*end == '%') {
+            cpu_share /= 100;
+            end++;
+         }
+         if (*end != '\0' || !(cpu_share > 0 && cpu_share <= 1)) {
+            fprintf(stderr, "Bad CPU share '%s', give a fraction like 0.25 or 25%%\n", optarg);
+            exit(0);
+         }
+         budgeted = 1;
+         break;
+      case 'P':
+         progress_every = strtod(optarg, &end);
+         if (*end != '\0' || !(progress_every > 0)) {
+            fprintf(stderr, "Bad progress interval '%s', give seconds like 10\n", optarg);
+            exit(0);
+         }
+         budgeted = 1;
+         break;
+      default:
+         fprintf(stderr, "Usage: %s [--report=conflicts|dead|dirs|gated [--depth=N] [--by=uses|defines|files]] [--gated=NAME [--in=FILE]] [--sort] [--stream] [--targets=FILE] [--tar=ARCHIVE ...] [--sample=FRACTION [--seed=N] [--top=N]] [--max-read=RATE] [--max-opens=N] [--cpu-share=FRACTION] [--progress=SECONDS] [--save=FILE] [--ctags=FILE] [--index=FILE] [--visible-from=FILE [--macro=NAME] [-I DIR ...]] [dir|file ...]\n", argv[0]);
+         exit(0);
+      }
+   }
 
+   if (sample_fraction > 0) {
+      if (budgeted) {
+         fprintf(stderr, "--sample reads too little to need a budget\n");
+         exit(0);
+      }
+      if (output_mode != OUTPUT_MODE_DUMP || sorted || streamed || targets_path != NULL || archive_nums > 0 ||
+          save_path != NULL || ctags_path != NULL || index_path != NULL) {
+         fprintf(stderr, "--sample only writes its estimates, it can not be used with --report, --gated, --visible-from, --stream, --sort, --targets, --tar, --save, --ctags or --index\n");
+         exit(0);
+      }
+
+      free(archives);
+      free(include_paths);
+      return sample_main(sample_fraction, sample_seed, sample_top, argv + optind, argc - optind);
+   }
 
-#ifdef DEBUG
-  fprintf(stdout,"Generating input file list...\n%s\n",cmd_get_all_files);
-#endif
+   if (streamed) {
+      if (output_mode != OUTPUT_MODE_DUMP || sorted) {
+         fprintf(stderr, "--stream writes its records in scan order, it can not be used with --report, --gated, --visible-from or --sort\n");
+         exit(0);
+      }
+      if (save_path != NULL || ctags_path != NULL || index_path != NULL) {
+         fprintf(stderr, "--stream keeps nothing to --save, --ctags or --index\n");
+         exit(0);
+      }
+
+      /* the records are the output, nothing is kept */
+      macro_stream_init(&writer, stdout, &cb);
+      output_mode = OUTPUT_MODE_STREAM;
+      scan_flags  = 0;
+   }
 
-   if (system(cmd_get_all_files) != 0) {
-      fprintf(stderr, "Can not get reference file list, please check your shell or path\n");
+   if ((ctx = macro_scan_create(&cb, scan_flags)) == NULL) {
+      fprintf(stderr, "Out of memory\n");
       exit(0);
    }
 
-/*
-   Remove newline character from generated file....
+   macro_targets_init(&targets);
+   if (targets_path != NULL) {
+      if (scan_flags & (MACRO_SCAN_INCLUDES | MACRO_SCAN_REGIONS)) {
+         fprintf(stderr, "--targets does not keep '#include' directives or conditional regions\n");
+         exit(0);
+      }
+
+      if ((targets_fd = fopen(targets_path, "r")) == NULL) {
+         fprintf(stderr, "Open %s failed:%s\n", targets_path, strerror(errno));
+         exit(0);
+      }
+
+      if (macro_targets_read(&targets, targets_fd) != 0 || macro_targets_compile(&targets) != 0) {
+         fprintf(stderr, "Read %s failed:%s\n", targets_path, strerror(errno));
+         exit(0);
+      }
+
+      fclose(targets_fd);
+      macro_scan_set_targets(ctx, &targets);
+   }
 
-   if (system(cmd_remove_newline_character) != 0) {
-      fprintf(stderr, "Remove newline characters failed\n");
-      exit(0);
+   if (budgeted) {
+      macro_budget_init(&budget, read_rate, open_rate, cpu_share, stderr, progress_every);
+      macro_budget_catch_signals();
+      macro_scan_set_budget(ctx, &budget);
+      macro_budget_phase(&budget, "scan");
    }
-*/
 
-   /* Step 2. Open the file generated at the first step
-    *        build macro matrix by going though each file list in the generated file. NOTE: Each line is a file path
-    *        the macro matrix is a 2-D pointer array that contains macro infor(name,defined in,found from...) according to a-z order including '_',like
+   /* Step 1. Scan all files(*.c,*.cc,*.cpp,*.h,*.hi,*.inc) below the given paths, or the current directory,
+    *         and build the macro matrix. It's a 2-D pointer array that contains macro infor(name,defined in,found from...)
+    *         according to a-z order including '_',like
 
       'A' ABBA_ENABLE_VIDEO--->AND_X_SUPPORT--->NULL
            |
@@ -177,838 +551,147 @@ int main(int argc, char * argv[])
            |
       'E' EFFECT_C_SUPPORT--->EPROM_SUPPORT--->NULL
            |
-      'F' NULL
-           |
           ...
            |
-      'W' WTF_SUPPORT--->NULL
-           |
-          ...
       'Z' NULL
            |
       '_' _NTF_SUPPORT-->NULL
     *
     */
    /*------------------------------------------------------------------------------------------------*/
-   if ((fd = fopen("src_files","r")) == 0) {
-        fprintf(stderr,"Read src_files failed:%s\n",strerror(errno));
-        exit(0);
+   if (optind == argc && archive_nums == 0) {
+      if (getcwd(cwd, sizeof(cwd)) == NULL) {
+         fprintf(stderr, "Can not get current directory:%s\n", strerror(errno));
+         exit(0);
+      }
+
+      if (macro_scan_tree(ctx, cwd) != 0) {
+         fprintf(stderr, "Scan %s failed:%s\n", cwd, strerror(errno));
+         exit(0);
+      }
    }
 
-   /* go through the file(src_files) line by line and put each line(a file's fullpath) into a linker */
-   g_file_nums = 0;
-   while (fgets(fpath, MAX_PATH_LEN, fd) != 0) {
-
-       idx = 0;
-       bcontinue = 0;
-
-       /* make sure the file is not in skip list */
-       while (_skip_files[idx] != NULL) {
-
-           if (strstr(fpath,_skip_files[idx++]) != NULL) {
-               bcontinue = 1;
-               break;
-           }
-       }
-
-       if (bcontinue == 1)  {
-           continue;
-       }
-
-       if (pfin_header == NULL)  {
-             pfin_header = malloc(sizeof(FILE_INFO_NODE));
-             if (pfin_header == NULL) {
-                 assert(1);
-             }
-
-             strncpy(pfin_header->path,fpath,MAX_PATH_LEN);
-             pfin_header->next  = NULL;
-
-             pfin_cursor = pfin_header;
-       } else {
-             FILE_INFO_NODE * p = malloc(sizeof(FILE_INFO_NODE));
-             if (p == NULL) {
-                 assert(1);
-             }
-
-             strncpy(p->path,fpath,MAX_PATH_LEN);
-             p->next = NULL;
-
-             pfin_cursor->next = p;
-             pfin_cursor       = pfin_cursor->next;
-       }
-
-       g_file_nums++;
+   for (; optind < argc && !(budgeted && macro_budget_interrupted()); optind++) {
+      if (macro_scan_tree(ctx, argv[optind]) != 0) {
+         fprintf(stderr, "Scan %s failed:%s\n", argv[optind], strerror(errno));
+         exit(0);
+      }
    }
 
-   fclose(fd);
-
-   g_macro_nums = 0;
-
-   /* get 'found from' infor by going through the linker to process each node(a file's fullpath) */
-   pfin_cursor = pfin_header;
-   while (pfin_cursor != NULL) {
-      append_found_from_info_into_matrix(pfin_cursor->path,&macro_matrix[0]);
-      pfin_cursor = pfin_cursor->next;
+   for (k = 0; k < archive_nums && !(budgeted && macro_budget_interrupted()); k++) {
+      if (macro_scan_tar(ctx, archives[k]) != 0) {
+         fprintf(stderr, "Scan %s failed:%s\n", archives[k], strerror(errno));
+         exit(0);
+      }
    }
 
-   /* get 'define in' infot by going through the linker to process each node(a file's fullpath) */
-   pfin_cursor = pfin_header;
-   while (pfin_cursor != NULL) {
-      append_define_info_into_matrix(pfin_cursor->path,&macro_matrix[0]);
-      pfin_cursor = pfin_cursor->next;
+   if (budgeted) {
+      if (macro_budget_interrupted()) {
+         fprintf(stderr, "Interrupted after %lu files, the results are partial\n", ctx->file_nums);
+      }
+      /* only the scan is budgeted, its totals are the last progress line */
+      macro_budget_phase(&budget, NULL);
    }
 
-   /* Step 3.Dump macro matrix into local file */
+   /* Step 2.Dump macro matrix, or just the report asked for */
    /*------------------------------------------------------------------------------------------------*/
-   dump_macro_matrix(&macro_matrix[0]);
-
-   /* Step 4.Release all resources */
-   /*------------------------------------------------------------------------------------------------*/
-   /* free the memory for saving file path */
-   while (pfin_header != NULL) {
-      pfin_cursor = pfin_header;
-      pfin_header = pfin_header->next;
-      free(pfin_cursor);
+   if (save_path != NULL) {
+      if ((save_fd = fopen(save_path, "wb")) == NULL) {
+         fprintf(stderr, "Open %s failed:%s\n", save_path, strerror(errno));
+         exit(0);
+      }
+
+      if (macro_snapshot_save(ctx, save_fd, macro_sort_default_threads()) != 0) {
+         fprintf(stderr, "Write %s failed:%s\n", save_path, strerror(errno));
+         exit(0);
+      }
+
+      fclose(save_fd);
    }
 
-   free_macro_matrix(&macro_matrix[0]);
-
-   return 1;
-}
-
-static void free_macro_matrix(MACRO_MATRIX_ELEMENT * macro_matrix)
-{
-    unsigned int i;
-    MACRO_INFO_NODE * pcursor;
-
-    MACRO_INFO_NODE * free_cursor = NULL;
-    DEFINE_INFO_NODE * free_di;
-    FOUND_INFO_NODE  * free_fi;
-
-    if (macro_matrix == NULL) {
-        return;
-    }
-
-    /*
-        go through macro matrix {
-            go through macro info linker  {
-                go through di(defined info) linker
-                go through fi(found from info) linker
-            }
-        }
-     */
-
-    /* start going through macro matrix...from A to Z and special characters,like '_' */
-    for(i = 0; i < MAX_CHARACTER_NUMS; i++) {
-
-        if (macro_matrix[i].header == NULL) {
-            continue;
-        }
-
-        pcursor = macro_matrix[i].header;
-
-        /* start going through macro info linker start... */
-        while (pcursor != NULL) {
-
-            free_cursor = pcursor;
-
-            /* free di and its value if has */
-            while (pcursor->di != NULL) {
-
-                free_di = pcursor->di;
-                pcursor->di = pcursor->di->next;
-
-                if (free_di->value != NULL) {
-                    free(free_di->value);
-                }
-                free(free_di);
-            }
-
-
-            /* free fi */
-            while (pcursor->fi != NULL) {
-
-                free_fi = pcursor->fi;
-                pcursor->fi = pcursor->fi->next;
-
-                free(free_fi);
-            }
-
-            /* next one... */
-            pcursor = pcursor->next;
-
-            free(free_cursor);
-        }
-    } /* end for */
-}
-
-/*
-    returns 0 means no illegal characters in macro name
-    otherwise returns 1
- */
-static unsigned int macro_have_illegal_characters(char * str)
-{
-    unsigned int ret = 0;
-    unsigned int i   = 0;
-
-    char * ptr = str;
-
-    assert(str != NULL);
-
-    /* space also means the macro name string is end */
-    while (*ptr != ' ' && *ptr != '\0' ) {
-        i = 0;
-
-        while( _illegal_chars[i] != '\0') {
-            if (*ptr == _illegal_chars[i++]) {
-                ret = 1;
-                goto GOOOO;
-            }
-        }
-
-       ptr++;
-    }
-
-GOOOO:
-    return ret;
-}
-
-
-static void dump_macro_matrix(MACRO_MATRIX_ELEMENT * macro_matrix)
-{
-    unsigned int i;
-    MACRO_INFO_NODE * pcursor;
-
-    assert(macro_matrix != NULL);
-
-    /*
-        go through macro matrix {
-            go through macro info linker  {
-                go through di(defined info) linker
-                go through fi(found from info) linker
-            }
-        }
-     */
-
-    /* start going through macro matrix...from A to Z and special characters,like '_' */
-    for(i = 0; i < MAX_CHARACTER_NUMS; i++) {
-
-        if (macro_matrix[i].header == NULL) {
-            continue;
-        }
-
-        pcursor = macro_matrix[i].header;
-
-        /* start going through macro info linker start... */
-        while (pcursor != NULL) {
-
-            /* Step 1. output macro name */
-            fprintf(stdout, "Macro:  %s\n",pcursor->name);
-
-            /* Step 2. output defined-in infor */
-            fprintf(stdout, "Defined in:\n");
-            while (pcursor->di != NULL) {
-
-                 fprintf(stdout,"Line%d:%s    %s\n",
-                         pcursor->di->ln,
-                         pcursor->di->fpath,
-                         (pcursor->di->value != NULL) ? pcursor->di->value : " ");
-
-                 pcursor->di = pcursor->di->next;
-            }
-            fprintf(stdout, "\n");
-
-            /* Step 3. output found-from infor */
-            fprintf(stdout, "Found from:\n");
-            while (pcursor->fi != NULL) {
-
-                 fprintf(stdout,"Line%d:%s\n",
-                         pcursor->fi->ln,
-                         pcursor->fi->fpath);
-
-                 pcursor->fi = pcursor->fi->next;
-            }
-            fprintf(stdout, "-------------------------------------------\n");
-
-            /* next one... */
-            pcursor = pcursor->next;
-        }
-    } /* end for */
-
-    /* output summary information */
-    fprintf(stdout,"\n------------------------------------------\n");
-    fprintf(stdout,"processed files:%lu\nprocessed macro:%lu\n",g_file_nums,g_macro_nums);
-}
-
-static void append_found_from_info_into_matrix(char * single_file,                      /* in     */
-                                               MACRO_MATRIX_ELEMENT  * macro_matrix)    /* in/out */
-{
-    FILE * fd = NULL;
-    char line[MAX_LINE_LEN] = {0};
-    char * pcursor;  /* the cursor for the current line we are processing */
-    unsigned int line_number = 0;
-    unsigned int bcontinue = 0;
-    char macro_mname[MAX_MACRO_NAME_LEN];
-    int idx = 0;
-
-    char * pure_path = rtrim(single_file);
-
-    if ((fd = fopen(pure_path,"r")) == 0) {
-        fprintf(stderr,"Read file(%s) failed:%s\n",pure_path,strerror(errno));
-        exit(0);
-    }
-
-#ifdef DEBUG
-    fprintf(stdout,"Scanning %s.....\n",pure_path);
-    fprintf(stdout,"-----------------------------\n");
-#endif
-
-    /* go through file line by line for searching '#ifdef' and '#ifndef' no matter how many spaces between '#' and 'if'
-       e.g. #ifdef
-            # ifdef
-            #   ifdef
-     */
-    while (fgets(line, MAX_LINE_LEN, fd) != 0) {
-
-       bcontinue = 0;
-
-       line_number++;
-
-       pcursor = ltrim(line);
-
-       if (*pcursor++ != '#') {
-           /* illegal: '#' is not the first available character */
-           continue;
-       }
-
-       if (*pcursor != 'i' &&
-           !isspace((int)*pcursor)) {
-           /* illegal: only space or character 'i' can follow '#' */
-           continue;
-       }
-
-       /* ignore spaces behind '#' */
-       while (isspace((int)*pcursor)) {
-           pcursor++;
-       }
-
-       if ((pcursor = strstr(line,"ifdef")) == NULL &&
-           (pcursor = strstr(line,"ifndef")) == NULL ) {
-           /* illegal: no 'ifdef' and 'ifndef' follow '#' */
-           continue;
-       }
-
-       if ((pcursor = strchr(pcursor,' ')) == NULL) {
-           /* illegal: no space(s) follow #ifdef or #ifndef */
-           continue;
-       }
-
-       /* ignore spaces between ifdef/ifndef and macro name */
-       while (isspace((int)*pcursor)) {
-           pcursor++;
-       }
-
-       /* get macro name...
-
-          continue if the macro is for header file protection only,like
-          #ifnde  FOO_H
-          #define FOO_H
-          or
-          #ifnde  FOO_H_
-          #define FOO_H_
-        */
-       memset(macro_mname,0x0,MAX_MACRO_NAME_LEN);
-
-       idx = 0;
-       while( pcursor != NULL && *pcursor != ' ' && *pcursor != '\0') {
-
-           if (*pcursor == '/' &&
-               (*(pcursor+1) != ' ' && *(pcursor+1) != '\0' && (*(pcursor+1) == '*' || *(pcursor+1) == '/')) )
-           {
-               /* stop seeking if meets 'slash*' and '//' in macro value */
-               break;
-           }
-
-           if (*pcursor == '_' &&
-               (*(pcursor+1) != ' ' && *(pcursor+1) != '\0' && (*(pcursor+1) == 'H' || *(pcursor+1) == 'h')) &&
-               (*(pcursor+2) == ' ' || *(pcursor+2) == 0x0A || *(pcursor+2) == 0x0D || *(pcursor+2) == '_') )
-           {
-               bcontinue = 1;
-               break;
-           }
-
-           macro_mname[idx++] = *pcursor++;
-       }
-
-       if (bcontinue == 1) {
-           continue;
-       }
-
-       /* make sure no illegal characters in macro name */
-       //if (macro_have_illegal_characters(macro_mname)) {
-       //    continue;
-       //}
-
-       /* get a valid macro name that follows ifdef or ifndef */
-#ifdef DEBUG
-       fprintf(stdout,"%s at line%d\n",rtrim(macro_mname),line_number);
-#endif
-
-       if (macro_mname[0] - 'a' >= 0 && macro_mname[0] - 'z' <= 0) {
-           idx = macro_mname[0] - 'a';
-       } else if (macro_mname[0] - 'A' >= 0 && macro_mname[0] - 'Z' <= 0) {
-           idx = macro_mname[0] - 'A';
-       } else if (macro_mname[0] == '_') {
-           idx = 26;
-       } else {
-           assert(1);
-       }
-
-       if (macro_matrix[idx].header == NULL)
-       {
-           macro_matrix[idx].header = (MACRO_INFO_NODE *)malloc(sizeof(MACRO_INFO_NODE));
-           if (macro_matrix[idx].header == NULL) {
-               assert(1);
-           }
-
-           strncpy(macro_matrix[idx].header->name,rtrim(macro_mname),MAX_MACRO_NAME_LEN);
-           macro_matrix[idx].header->di = NULL;  /* we don't know di infor yet,will be done in next phase */
-
-           macro_matrix[idx].header->fi = (FOUND_INFO_NODE *)malloc(sizeof(FOUND_INFO_NODE));
-           if (macro_matrix[idx].header->fi == NULL) {
-               assert(1);
-           }
-
-           macro_matrix[idx].header->fi->fpath = single_file;
-           macro_matrix[idx].header->fi->ln    = line_number;
-           macro_matrix[idx].header->next  = NULL;
-
-       } else {
-           append_found_from_info_into_linker(macro_matrix[idx].header,
-                                              rtrim(macro_mname),single_file,line_number);
-       }
-
-       g_macro_nums++;
-
-    } /* end while(fgets(...)) */
-
-    fclose(fd);
-}
-
-/*
- * returns 0 means the node has been inserted into linker
- * returns 1 means the node is dulicated with the existing one in the linker
- */
-static char append_found_from_info_into_linker(MACRO_INFO_NODE * pheader,   /* in, the target linker's header */
-                                               char * macro_name,           /* in, macro name */
-                                               char * hostfile,             /* in, macro in which file */
-                                               unsigned int line_number)    /* in, the line number of the macro in the hostfile */
-{
-    MACRO_INFO_NODE * pcursor = pheader;
-    MACRO_INFO_NODE * pinspos = pheader;
-
-    MACRO_INFO_NODE * newnode_min = NULL;
-    FOUND_INFO_NODE * newnode_fin = NULL;
-    FOUND_INFO_NODE * fin_cursor  = NULL;
-    FOUND_INFO_NODE * fin_inspos  = NULL;
-
-    char ret = 0;
-
-    assert(pheader    != NULL);
-    assert(macro_name != NULL);
-    assert(hostfile  != NULL);
-
-    while (pcursor != NULL && strcmp(pcursor->name, macro_name) != 0) {
-        pinspos = pcursor;
-        pcursor = pcursor->next;
-    }
-
-    if (pcursor == NULL) {
-        /* we don have the macro yet... */
-        newnode_min = (MACRO_INFO_NODE *)malloc(sizeof(MACRO_INFO_NODE));
-        if (newnode_min == NULL) {
-            assert(1);
-        }
-
-        strncpy(newnode_min->name,macro_name,MAX_MACRO_NAME_LEN);
-
-        newnode_min->fi = (FOUND_INFO_NODE *)malloc(sizeof(FOUND_INFO_NODE));
-        if (newnode_min->fi == NULL) {
-            assert(1);
-        }
-
-        newnode_min->fi->fpath = hostfile;
-        newnode_min->fi->ln    = line_number;
-        newnode_min->fi->next  = NULL;
-
-        newnode_min->di   = NULL;
-        newnode_min->next = NULL;
-
-        pinspos->next = newnode_min;
-
-    } else {
-
-        if (pcursor->fi == NULL) {
-            /* we get a matched item,but its fi is empty */
-            newnode_fin = (FOUND_INFO_NODE *)malloc(sizeof(FOUND_INFO_NODE));
-            if (newnode_fin == NULL) {
-                assert(1);
-            }
-
-            newnode_fin->fpath = hostfile;
-            newnode_fin->ln    = line_number;
-            newnode_fin->next  = NULL;
-
-            pcursor->fi = newnode_fin;
-        } else {
-
-            fin_cursor = pcursor->fi;
-            /* we already have the macro in the linker. trying to insert found infor into the pcursor's fi linker */
-            while (fin_cursor != NULL &&
-                   (fin_cursor->fpath != hostfile || fin_cursor->ln != line_number) )
-            {
-                fin_inspos  = fin_cursor;
-                fin_cursor  = fin_cursor->next;
-            }
-
-            if (fin_cursor == NULL) {
-                /* we are in the end of linker... */
-                newnode_fin = (FOUND_INFO_NODE *)malloc(sizeof(FOUND_INFO_NODE));
-                if (newnode_fin == NULL) {
-                    assert(1);
-                }
-
-                newnode_fin->fpath = hostfile;
-                newnode_fin->ln    = line_number;
-                newnode_fin->next  = NULL;
-
-                fin_inspos->next = newnode_fin;
-           } else {
-                ret = 1;
-           }
-        }
-
+   if (ctags_path != NULL) {
+      export_file(ctx, ctags_path, macro_export_ctags);
    }
 
-   return ret;
-}
-
-static void append_define_info_into_matrix(char * single_file, MACRO_MATRIX_ELEMENT * macro_matrix)
-{
-    FILE * fd = NULL;
-
-    char * pcursor;  /* the cursor for the current line we are processing */
-
-    unsigned int line_number = 0;
-    unsigned int idx = 0;
-    unsigned int bcontinue = 0;
-
-    char * pure_path = rtrim(single_file);
-    char * macro_value; /* macro value. e.g. for '#define VX_SUPPORT TRUE',its value is 'TRUE' */
-
-    char macro_mname[MAX_MACRO_NAME_LEN];
-    char line[MAX_LINE_LEN] = {0};
-
-    if ((fd = fopen(pure_path,"r")) == 0) {
-        fprintf(stderr,"Read file(%s) failed:%s\n",pure_path,strerror(errno));
-        exit(0);
-    }
-
-#ifdef DEBUG
-    fprintf(stdout,"Scanning %s.....\n",pure_path);
-    fprintf(stdout,"-----------------------------\n");
-#endif
-
-    /* go through file line by line for searching '#define' no matter how many spaces between '#' and 'if'
-       e.g. #define
-            # define
-     */
-    while (fgets(line, MAX_LINE_LEN, fd) != 0) {
-
-       bcontinue = 0;
-
-       line_number++;
-
-       pcursor = ltrim(line);
-
-       if (*pcursor++ != '#') {
-           /* illegal: '#' is not the first available character */
-           continue;
-       }
-
-       if (*pcursor != 'd' &&
-           !isspace((int)*pcursor)) {
-           /* illegal: only space or character 'd' can follow '#' */
-           continue;
-       }
-
-       /* ignore spaces behind '#' */
-       while (isspace((int)*pcursor)) {
-           pcursor++;
-       }
-
-       if ((pcursor = strstr(line,"define")) == NULL) {
-           /* illegal: no 'define' follows '#' */
-           continue;
-       }
-
-       if ((pcursor = strchr(pcursor,' ')) == NULL) {
-           /* illegal: no space(s) follow '#idefine' */
-           continue;
-       }
-
-       /* ignore spaces between define and macro name */
-       while (isspace((int)*pcursor)) {
-           pcursor++;
-       }
-
-       memset(macro_mname,0x0,MAX_MACRO_NAME_LEN);
-
-       /* get macro name...
-
-          continue if the macro is for header file protection only,like
-          #ifnde  FOO_H
-          #define FOO_H
-          or
-          #ifnde  FOO_H_
-          #define FOO_H_
-        */
-
-       idx = 0;
-       while( pcursor != NULL && *pcursor != ' ' && *pcursor != '\0') {
-
-           if (*pcursor == '_' &&
-               (*(pcursor+1) != ' ' && *(pcursor+1) != '\0' && (*(pcursor+1) == 'H' || *(pcursor+1) == 'h')) &&
-               (*(pcursor+2) == ' ' || *(pcursor+2) == 0x0A || *(pcursor+2) == 0x0D || *(pcursor+2) == '_') )
-           {
-               bcontinue = 1;
-               break;
-           }
-
-           macro_mname[idx++] = *pcursor++;
-       }
-
-       if (bcontinue == 1) {
-           continue;
-       }
-
-       /* make sure no illegal characters in macro name */
-       if (macro_have_illegal_characters(macro_mname)) {
-           continue;
-       }
-
-       /* ignore spaces between macro name and its value */
-       while (isspace((int)*pcursor)) {
-           pcursor++;
-       }
-
-       /* get macro value name */
-       idx = 0;
-       macro_value = malloc(MAX_MACRO_VALUE_LEN);
-       if (macro_value == NULL) {
-           assert(1);
-       }
-
-       memset(macro_value,'\0',MAX_MACRO_VALUE_LEN);
-
-       while( pcursor != NULL && *pcursor != ' ' && *pcursor != '\0') {
-
-           if (*pcursor == '/' &&
-               (*(pcursor+1) != ' ' && *(pcursor+1) != '\0' && (*(pcursor+1) == '*' || *(pcursor+1) == '/')) )
-           {
-               /* stop seeking if meets 'slash*' and '//' in macro value */
-               break;
-           }
-
-           macro_value[idx++] = *pcursor++;
-       }
-
-       if (idx == 0) {
-           free(macro_value);
-           macro_value = NULL;
-       } else if (idx > MAX_MACRO_VALUE_LEN) {
-           /* memory overwrite,please consider increase MAX_MACRO_VALUE_LEN */
-           assert(1);
-       }
-
-       /* make sure no illegal characters in macro value */
-       if (macro_value != NULL && macro_have_illegal_characters(macro_value)) {
-           free(macro_value);
-           macro_value = NULL;
-           continue;
-       }
-
-       /* get a valid macro name that follows define */
-#ifdef DEBUG
-       fprintf(stdout,">>%s,%s,%d\n",rtrim(macro_mname),macro_value == NULL?"":rtrim(macro_value),line_number);
-#endif
-
-       if (macro_mname[0] - 'a' >= 0 && macro_mname[0] - 'z' <= 0) {
-           idx = macro_mname[0] - 'a';
-       } else if (macro_mname[0] - 'A' >= 0 && macro_mname[0] - 'Z' <= 0) {
-           idx = macro_mname[0] - 'A';
-       } else if (macro_mname[0] == '_') {
-           idx = 26;
-       } else {
-           assert(1);
-       }
-
-       if (macro_matrix[idx].header == NULL)
-       {
-           macro_matrix[idx].header = (MACRO_INFO_NODE *)malloc(sizeof(MACRO_INFO_NODE));
-           if (macro_matrix[idx].header == NULL) {
-               assert(1);
-           }
-
-           strncpy(macro_matrix[idx].header->name,rtrim(macro_mname),MAX_MACRO_NAME_LEN);
-           macro_matrix[idx].header->fi = NULL;  /* not in this phase */
-
-           macro_matrix[idx].header->di = (DEFINE_INFO_NODE *)malloc(sizeof(DEFINE_INFO_NODE));
-           if (macro_matrix[idx].header->di == NULL) {
-               assert(1);
-           }
-
-           macro_matrix[idx].header->di->fpath = single_file;
-           macro_matrix[idx].header->di->value = macro_value;
-           macro_matrix[idx].header->di->ln    = line_number;
-           macro_matrix[idx].header->di->next  = NULL;
-
-           macro_matrix[idx].header->next = NULL;
-       } else {
-           append_define_info_into_linker(macro_matrix[idx].header,
-                                          rtrim(macro_mname),single_file,macro_value == NULL?NULL:rtrim(macro_value),line_number);
-       }
-
-       g_macro_nums++;
-
-    } /* end while(fgets(...)) */
-
-    fclose(fd);
-
-}
-
-static char append_define_info_into_linker(MACRO_INFO_NODE * pheader,   /* in, the target linker's header */
-                                           char * macro_name,           /* in, macro name */
-                                           char * hostfile,             /* in, macro in which file */
-                                           char * value,                /* in, macro value, can be NULL */
-                                           unsigned int line_number)    /* in, the line number of the macro in the hostfile */
-{
-    MACRO_INFO_NODE * pcursor = pheader;
-    MACRO_INFO_NODE * pinspos = pheader;
-    MACRO_INFO_NODE  * newnode_min = NULL;
-
-    DEFINE_INFO_NODE * newnode_din = NULL;
-    DEFINE_INFO_NODE * din_cursor  = NULL;
-    DEFINE_INFO_NODE * din_inspos  = NULL;
-
-    char ret = 0;
-
-    assert(pheader    != NULL);
-    assert(macro_name != NULL);
-    assert(hostfile  != NULL);
-
-    while (pcursor != NULL && strcmp(pcursor->name, macro_name) != 0) {
-        pinspos = pcursor;
-        pcursor = pcursor->next;
-    }
-
-    if (pcursor == NULL) {
-        /* we are in the end of linker... */
-        newnode_min = (MACRO_INFO_NODE *)malloc(sizeof(MACRO_INFO_NODE));
-        if (newnode_min == NULL) {
-            assert(1);
-        }
-
-        strncpy(newnode_min->name,macro_name,MAX_MACRO_NAME_LEN);
-
-        newnode_min->di = (DEFINE_INFO_NODE *)malloc(sizeof(DEFINE_INFO_NODE));
-        if (newnode_min->di == NULL) {
-            assert(1);
-        }
-
-        newnode_min->di->fpath = hostfile;
-        newnode_min->di->ln    = line_number;
-        newnode_min->di->value = value;
-        newnode_min->di->next  = NULL;
-
-        newnode_min->fi   = NULL;
-        newnode_min->next = NULL;
-
-        pinspos->next = newnode_min;
-
-    } else {
-
-        if (pcursor->di == NULL) {
-            /* we get a matched item,but its di is empty */
-            newnode_din = (DEFINE_INFO_NODE *)malloc(sizeof(DEFINE_INFO_NODE));
-            if (newnode_din == NULL) {
-                assert(1);
-            }
-
-            newnode_din->fpath = hostfile;
-            newnode_din->value = value;
-            newnode_din->ln    = line_number;
-            newnode_din->next  = NULL;
-
-            pcursor->di = newnode_din;
-
-        } else {
-
-            din_cursor = pcursor->di;
-            /* we already have the macro in the linker. trying to insert define infor into the pcursor's di linker */
-            while (din_cursor != NULL &&
-                   (din_cursor->fpath != hostfile || din_cursor->ln != line_number || (din_cursor->value != NULL && din_cursor->value == value) ))
-            {
-                din_inspos = din_cursor;
-                din_cursor = din_cursor->next;
-            }
-
-            if (din_cursor == NULL) {
-                /* we are in the end of linker... */
-                newnode_din = (DEFINE_INFO_NODE *)malloc(sizeof(DEFINE_INFO_NODE));
-                if (newnode_din == NULL) {
-                    assert(1);
-                }
-
-                newnode_din->fpath = hostfile;
-                newnode_din->value = value;
-                newnode_din->ln    = line_number;
-                newnode_din->next  = NULL;
-
-                din_inspos->next = newnode_din;
-           } else {
-                ret = 1;
-           }
-        }
-    }
-
-    return ret;
-}
-
-
-static char * rtrim(char *str)
-{
-    char *ptr;
-    int   len;
-
-    len = strlen(str);
-    for (ptr = str + len - 1; ptr >= str && isspace((int)*ptr ); --ptr);
-
-    ptr[1] = '\0';
-
-    return str;
-}
+   if (index_path != NULL) {
+      export_file(ctx, index_path, macro_export_json);
+   }
 
-static char * ltrim(char *str)
-{
-    char *ptr;
-    int  len;
+   if (output_mode == OUTPUT_MODE_STREAM) {
+      if (macro_stream_flush(&writer) != 0) {
+         fprintf(stderr, "Write records failed:%s\n", strerror(errno));
+         exit(0);
+      }
+   } else if (output_mode == OUTPUT_MODE_DIRS) {
+      if (macro_dir_report(&ctx->dirs, dir_depth, dir_by, stdout) != 0) {
+         fprintf(stderr, "Out of memory while ranking directories\n");
+         exit(0);
+      }
+   } else if (output_mode == OUTPUT_MODE_REPORT_DEAD) {
+      if (macro_scan_report_dead(ctx, stdout, macro_sort_default_threads()) != 0) {
+         fprintf(stderr, "Build the dead macro report failed:%s\n", strerror(errno));
+         exit(0);
+      }
+   } else if (output_mode == OUTPUT_MODE_CONFLICTS) {
+      if (macro_scan_report_conflicts(ctx, stdout, macro_sort_default_threads()) != 0) {
+         fprintf(stderr, "Out of memory while looking for conflicting values\n");
+         exit(0);
+      }
+   } else if (output_mode == OUTPUT_MODE_VISIBLE) {
+      if ((graph = macro_include_graph_build(ctx, include_paths, include_path_nums)) == NULL) {
+         fprintf(stderr, "Out of memory while building the include graph\n");
+         exit(0);
+      }
+
+      if (macro_include_find_file(graph, visible_from, &file) != 0) {
+         fprintf(stderr, "%s was not scanned\n", visible_from);
+         exit(0);
+      }
+
+      if (macro_include_report_visible(graph, file, macro_name, stdout, macro_sort_default_threads()) != 0) {
+         fprintf(stderr, "Out of memory while listing visible defines\n");
+         exit(0);
+      }
+
+      macro_include_graph_free(graph);
+   } else if (output_mode == OUTPUT_MODE_GATED_RANK || output_mode == OUTPUT_MODE_GATED) {
+      if ((regions = macro_region_index_build(ctx, macro_sort_default_threads())) == NULL) {
+         fprintf(stderr, "Out of memory while indexing conditional regions\n");
+         exit(0);
+      }
+
+      if (output_mode == OUTPUT_MODE_GATED_RANK) {
+         if (macro_region_report_ranked(regions, stdout) != 0) {
+            fprintf(stderr, "Out of memory while ranking gating macros\n");
+            exit(0);
+         }
+      } else if (macro_region_report_macro(regions, macro_name, gated_in, stdout) != 0) {
+         fprintf(stderr, "%s was not found\n", gated_in != NULL ? gated_in : macro_name);
+         exit(0);
+      }
+
+      macro_region_index_free(regions);
+   } else if (save_path != NULL || ctags_path != NULL || index_path != NULL) {
+      /* the snapshot or the exported files replace the text dump */
+   } else if (sorted) {
+      if (macro_scan_dump_sorted(ctx, stdout, macro_sort_default_threads()) != 0) {
+         fprintf(stderr, "Sort the output failed:%s\n", strerror(errno));
+         exit(0);
+      }
+   } else {
+      macro_scan_dump(ctx, stdout);
+   }
 
-    for (ptr = str; *ptr && isspace((int)*ptr); ++ptr);
+   if (budgeted) {
+      macro_budget_free(&budget);
+   }
 
-    len = strlen(ptr);
-    memmove(str, ptr, len + 1);
+   /* Step 3.Release all resources */
+   /*------------------------------------------------------------------------------------------------*/
+   macro_scan_destroy(ctx);
+   macro_targets_free(&targets);
+   free(archives);
+   free(include_paths);
 
-    return str;
+   return 1;
 }
@@ -0,0 +1,211 @@
+/*
+ * str_pool - interned strings, see str_pool.h
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "str_pool.h"
+
+#define STR_POOL_CHUNK_SIZE   (64 * 1024)
+#define STR_POOL_FIRST_SLOTS  1024
+
+static int  str_pool_grow_slots(STR_POOL * pool);
+static int  str_pool_find_slot(const STR_POOL * pool, const char * str, size_t len, unsigned int hash, unsigned int * slot);
+static char * str_pool_store(STR_POOL * pool, const char * str, size_t len);
+
+void str_pool_init(STR_POOL * pool)
+{
+    assert(pool != NULL);
+
+    memset(pool, 0, sizeof(STR_POOL));
+}
+
+void str_pool_free(STR_POOL * pool)
+{
+    STR_POOL_CHUNK * chunk;
+
+    if (pool == NULL) {
+        return;
+    }
+
+    while (pool->chunks != NULL) {
+        chunk = pool->chunks;
+        pool->chunks = chunk->next;
+        free(chunk);
+    }
+
+    free(pool->strs);
+    free(pool->hashes);
+    free(pool->slots);
+
+    memset(pool, 0, sizeof(STR_POOL));
+}
+
+unsigned int str_pool_hash(const char * str, size_t len)
+{
+    unsigned int hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+int str_pool_intern(STR_POOL * pool, const char * str, size_t len, unsigned int * id)
+{
+    unsigned int hash = str_pool_hash(str, len);
+    unsigned int slot;
+    void * p;
+
+    assert(pool != NULL);
+    assert(str  != NULL);
+
+    /* keep the table at most half full */
+    if ((pool->nums + 1) * 2 > pool->slot_nums && str_pool_grow_slots(pool) != 0) {
+        return -1;
+    }
+
+    if (str_pool_find_slot(pool, str, len, hash, &slot) == 0) {
+        if (id != NULL) {
+            *id = pool->slots[slot] - 1;
+        }
+        return 0;
+    }
+
+    if (pool->nums == pool->cap) {
+        unsigned int cap = pool->cap == 0 ? 256 : pool->cap * 2;
+
+        if ((p = realloc(pool->strs, cap * sizeof(char *))) == NULL) {
+            return -1;
+        }
+        pool->strs = p;
+
+        if ((p = realloc(pool->hashes, cap * sizeof(unsigned int))) == NULL) {
+            return -1;
+        }
+        pool->hashes = p;
+
+        pool->cap = cap;
+    }
+
+    if ((pool->strs[pool->nums] = str_pool_store(pool, str, len)) == NULL) {
+        return -1;
+    }
+    pool->hashes[pool->nums] = hash;
+    pool->slots[slot] = pool->nums + 1;
+
+    if (id != NULL) {
+        *id = pool->nums;
+    }
+    pool->nums++;
+
+    return 0;
+}
+
+int str_pool_lookup(const STR_POOL * pool, const char * str, unsigned int * id)
+{
+    size_t len;
+    unsigned int slot;
+
+    assert(pool != NULL);
+    assert(str  != NULL);
+
+    if (pool->slot_nums == 0) {
+        return -1;
+    }
+
+    len = strlen(str);
+    if (str_pool_find_slot(pool, str, len, str_pool_hash(str, len), &slot) != 0) {
+        return -1;
+    }
+
+    if (id != NULL) {
+        *id = pool->slots[slot] - 1;
+    }
+
+    return 0;
+}
+
+/*
+ * linear probing. returns 0 and the slot holding 'str', or -1 and the empty slot where it
+ * should go.
+ */
+static int str_pool_find_slot(const STR_POOL * pool, const char * str, size_t len, unsigned int hash, unsigned int * slot)
+{
+    unsigned int mask = pool->slot_nums - 1;
+    unsigned int i    = hash & mask;
+    unsigned int id;
+
+    while (pool->slots[i] != 0) {
+        id = pool->slots[i] - 1;
+
+        if (pool->hashes[id] == hash &&
+            strncmp(pool->strs[id], str, len) == 0 && pool->strs[id][len] == '\0') {
+            *slot = i;
+            return 0;
+        }
+
+        i = (i + 1) & mask;
+    }
+
+    *slot = i;
+    return -1;
+}
+
+static int str_pool_grow_slots(STR_POOL * pool)
+{
+    unsigned int slot_nums = pool->slot_nums == 0 ? STR_POOL_FIRST_SLOTS : pool->slot_nums * 2;
+    unsigned int * slots;
+    unsigned int mask = slot_nums - 1;
+    unsigned int id;
+    unsigned int i;
+
+    if ((slots = calloc(slot_nums, sizeof(unsigned int))) == NULL) {
+        return -1;
+    }
+
+    for (id = 0; id < pool->nums; id++) {
+        i = pool->hashes[id] & mask;
+        while (slots[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = id + 1;
+    }
+
+    free(pool->slots);
+    pool->slots     = slots;
+    pool->slot_nums = slot_nums;
+
+    return 0;
+}
+
+static char * str_pool_store(STR_POOL * pool, const char * str, size_t len)
+{
+    STR_POOL_CHUNK * chunk = pool->chunks;
+    char * p;
+
+    if (chunk == NULL || chunk->size - chunk->used < len + 1) {
+        size_t size = len + 1 > STR_POOL_CHUNK_SIZE ? len + 1 : STR_POOL_CHUNK_SIZE;
+
+        if ((chunk = malloc(sizeof(STR_POOL_CHUNK) + size)) == NULL) {
+            return NULL;
+        }
+
+        chunk->used = 0;
+        chunk->size = size;
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
+    }
+
+    p = chunk->data + chunk->used;
+    memcpy(p, str, len);
+    p[len] = '\0';
+    chunk->used += len + 1;
+
+    return p;
+}
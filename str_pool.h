@@ -0,0 +1,55 @@
+/*
+ * str_pool - interned strings
+ *
+ * Every distinct string added to a pool gets a small dense id(0,1,2...) in insertion order.
+ * The string bytes are kept in large chunks that never move, so the pointer returned by
+ * str_pool_get() stays valid until str_pool_free().
+ */
+
+#ifndef STR_POOL_H
+#define STR_POOL_H
+
+#include <stddef.h>
+
+typedef struct STR_POOL_CHUNK {
+
+   struct STR_POOL_CHUNK * next;
+   size_t                  used;      /* bytes used in data[] */
+   size_t                  size;      /* bytes available in data[] */
+   char                    data[1];
+
+}STR_POOL_CHUNK;
+
+typedef struct STR_POOL {
+
+   char          ** strs;        /* id -> string */
+   unsigned int   * hashes;      /* id -> hash of the string, see str_pool_hash() */
+   unsigned int     nums;        /* how many strings are in the pool */
+   unsigned int     cap;         /* capacity of strs[] and hashes[] */
+
+   unsigned int   * slots;       /* open addressing hash table, each slot is id+1 or 0 if empty */
+   unsigned int     slot_nums;   /* always a power of two */
+
+   STR_POOL_CHUNK * chunks;      /* string storage, newest first */
+
+}STR_POOL;
+
+#define str_pool_get(pool, id)   ((const char *)(pool)->strs[(id)])
+#define str_pool_nums(pool)      ((pool)->nums)
+
+void str_pool_init(STR_POOL * pool);
+void str_pool_free(STR_POOL * pool);
+
+/* 32 bits FNV-1a */
+unsigned int str_pool_hash(const char * str, size_t len);
+
+/*
+ * add 'len' bytes of 'str' into the pool(a '\0' is appended) and store its id in 'id'.
+ * returns 0 on success, -1 if out of memory.
+ */
+int str_pool_intern(STR_POOL * pool, const char * str, size_t len, unsigned int * id);
+
+/* returns 0 and stores the id in 'id' if the '\0' terminated 'str' is in the pool, otherwise -1 */
+int str_pool_lookup(const STR_POOL * pool, const char * str, unsigned int * id);
+
+#endif /* STR_POOL_H */
@@ -0,0 +1,776 @@
+/*
+ * test_main - behaviour checks for the list_macros library
+ *
+ * Every check scans small in-memory buffers with macro_scan_buffer() and looks at what the
+ * library builds or prints; only the tar test needs a file, it writes one with mkstemp().
+ * Printed reports are captured through tmpfile() and read back as one string.
+ *
+ * Build and run it with 'make test', it prints one line per test and exits 1 if any failed.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "../macro_scan.h"
+#include "../macro_postings.h"
+#include "../macro_snapshot.h"
+#include "../macro_include.h"
+#include "../macro_region.h"
+#include "../macro_target.h"
+#include "../macro_diff.h"
+#include "../macro_tar.h"
+#include "../macro_export.h"
+#include "../macro_stream.h"
+#include "../str_pool.h"
+
+#define CAPTURE_MAX (64 * 1024)
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "  %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            _failures++; \
+        } \
+    } while (0)
+
+/* 'needle' is in the captured 'text' */
+#define CHECK_HAS(text, needle)     CHECK(strstr((text), (needle)) != NULL)
+#define CHECK_HAS_NOT(text, needle) CHECK(strstr((text), (needle)) == NULL)
+
+/* 'first' is in 'text' and comes before 'second' */
+#define CHECK_BEFORE(text, first, second) \
+    CHECK(strstr((text), (first)) != NULL && strstr((text), (second)) != NULL && \
+          strstr((text), (first)) < strstr((text), (second)))
+
+typedef struct TEST_CASE {
+
+   const char * name;
+   void      (* fn)(void);
+
+}TEST_CASE;
+
+static unsigned int _failures = 0;
+static char _captured[CAPTURE_MAX];
+
+static MACRO_SCAN_CTX * scan_files(unsigned int flags, const char * const * files);
+static unsigned int macro_id(const MACRO_SCAN_CTX * ctx, const char * name);
+static unsigned int file_id(const MACRO_SCAN_CTX * ctx, const char * path);
+static const char * captured(FILE * fd);
+static void put_tar_header(FILE * fd, const char * name, unsigned long size, int type);
+static void put_tar_data(FILE * fd, const char * data, size_t len);
+
+static void test_dump_sorted(void);
+static void test_postings_round_trip(void);
+static void test_snapshot_round_trip(void);
+static void test_include_cycle(void);
+static void test_regions(void);
+static void test_targets(void);
+static void test_diff(void);
+static void test_tar_members(void);
+static void test_conflicts(void);
+static void test_dead(void);
+static void test_ctags_json(void);
+static void test_stream(void);
+
+static const TEST_CASE _tests[] = {
+    { "dump_sorted",          test_dump_sorted          },
+    { "postings_round_trip",  test_postings_round_trip  },
+    { "snapshot_round_trip",  test_snapshot_round_trip  },
+    { "include_cycle",        test_include_cycle        },
+    { "regions",              test_regions              },
+    { "targets",              test_targets              },
+    { "diff",                 test_diff                 },
+    { "tar_members",          test_tar_members          },
+    { "conflicts",            test_conflicts            },
+    { "dead",                 test_dead                 },
+    { "ctags_json",           test_ctags_json           },
+    { "stream",               test_stream               },
+    { NULL,                   NULL                      }
+};
+
+int main(void)
+{
+    unsigned int failed = 0;
+    unsigned int before;
+    unsigned int k;
+
+    for (k = 0; _tests[k].name != NULL; k++) {
+        before = _failures;
+        _tests[k].fn();
+
+        printf("%s %s\n", _failures == before ? "ok  " : "FAIL", _tests[k].name);
+        if (_failures != before) {
+            failed++;
+        }
+    }
+
+    printf("\n%u of %u tests failed\n", failed, k);
+
+    return failed == 0 ? 0 : 1;
+}
+
+/* the two files most tests scan, b.c first so scan order and sorted order differ */
+static const char * const _two_files[] = {
+    "tt/b.c", "#define B_MAC 2\n#ifdef A_MAC\n#endif\n",
+    "tt/a.h", "#define A_MAC 1\n#ifdef B_MAC\n#ifndef A_MAC\n#endif\n#endif\n",
+    NULL
+};
+
+static void test_dump_sorted(void)
+{
+    MACRO_SCAN_CTX * ctx = scan_files(MACRO_SCAN_BUILD_MATRIX, _two_files);
+    FILE * fd = tmpfile();
+    const char * text;
+
+    CHECK(ctx != NULL && fd != NULL);
+    if (ctx == NULL || fd == NULL) {
+        return;
+    }
+
+    CHECK(macro_scan_dump_sorted(ctx, fd, 2) == 0);
+    text = captured(fd);
+
+    /* macros by name, sites by (path, line) whatever the scan order was */
+    CHECK_BEFORE(text, "Macro:  A_MAC", "Macro:  B_MAC");
+    CHECK_BEFORE(text, "Line3:tt/a.h", "Line2:tt/b.c");
+    CHECK_HAS(text, "Line1:tt/a.h");
+    CHECK_HAS(text, "processed files:2\nprocessed macro:5\n");
+
+    /* a path already scanned is skipped, not an error */
+    CHECK(macro_scan_buffer(ctx, "tt/a.h", "#define OTHER\n", 14) == 0);
+    CHECK(ctx->file_nums == 2);
+    CHECK(str_pool_lookup(&ctx->names, "OTHER", &(unsigned int){0}) != 0);
+
+    macro_scan_destroy(ctx);
+}
+
+static void test_postings_round_trip(void)
+{
+    static const unsigned int edges[] = { 0, 1, 127, 128, 16383, 16384, UINT_MAX };
+    unsigned char buf[5];
+    const unsigned char * p;
+    unsigned int v;
+    unsigned int len;
+    unsigned int k;
+    MACRO_POSTINGS pst;
+    MACRO_POSTINGS_ITER it;
+    const MACRO_SITE * site;
+
+    for (k = 0; k < sizeof(edges) / sizeof(edges[0]); k++) {
+        len = macro_varint_put(buf, edges[k]);
+        p = buf;
+        CHECK(macro_varint_get(&p, buf + len, &v) == 0 && v == edges[k] && p == buf + len);
+        p = buf;
+        CHECK(len < 2 || macro_varint_get(&p, buf + len - 1, &v) != 0);
+    }
+
+    /* more sites than one decoded block, with file changes and big line jumps */
+    macro_postings_init(&pst);
+    for (k = 0; k < 3 * MACRO_POSTINGS_BLOCK + 5; k++) {
+        CHECK(macro_postings_add(&pst, k / 10, (k % 10) * 1000 + 1, 1, k % 3) == 0);
+    }
+    CHECK(macro_postings_add(&pst, (k - 1) / 10, ((k - 1) % 10) * 1000 + 1, 1, 0) == 1);
+    CHECK(macro_postings_add(&pst, 0, 1, 1, 0) == -1);
+    CHECK(pst.nums == k);
+
+    macro_postings_iter_init(&it, pst.data, pst.len, 1);
+    for (k = 0; (site = macro_postings_iter_next(&it)) != NULL; k++) {
+        CHECK(site->file == k / 10 && site->ln == (k % 10) * 1000 + 1 && site->value == k % 3);
+    }
+    CHECK(k == pst.nums);
+
+    macro_postings_free(&pst);
+}
+
+static void test_snapshot_round_trip(void)
+{
+    MACRO_SCAN_CTX * ctx = scan_files(MACRO_SCAN_BUILD_MATRIX, _two_files);
+    MACRO_SNAPSHOT snap;
+    MACRO_POSTINGS_ITER it;
+    const MACRO_SITE * site;
+    FILE * fd = tmpfile();
+    unsigned int id;
+
+    CHECK(ctx != NULL && fd != NULL);
+    if (ctx == NULL || fd == NULL) {
+        return;
+    }
+
+    CHECK(str_pool_intern(&ctx->roots, "tt", 2, &id) == 0);
+    CHECK(macro_snapshot_save(ctx, fd, 2) == 0);
+    rewind(fd);
+
+    CHECK(macro_snapshot_open(&snap, fd) == 0);
+    CHECK(str_pool_nums(&snap.roots) == 1 && strcmp(str_pool_get(&snap.roots, 0), "tt") == 0);
+    CHECK(str_pool_nums(&snap.paths) == 2);
+    CHECK(strcmp(str_pool_get(&snap.paths, 0), "tt/a.h") == 0);
+    CHECK(strcmp(str_pool_get(&snap.paths, 1), "tt/b.c") == 0);
+    CHECK(snap.macro_nums == 2);
+
+    /* file ids are path ranks, a.h is 0 although it was scanned second */
+    CHECK(macro_snapshot_next(&snap) == 1);
+    CHECK(strcmp(snap.name, "A_MAC") == 0 && snap.di_nums == 1 && snap.fi_nums == 2);
+    macro_postings_iter_init(&it, snap.di, snap.di_len, 1);
+    site = macro_postings_iter_next(&it);
+    CHECK(site != NULL && site->file == 0 && site->ln == 1 && site->value != 0 &&
+          strcmp(str_pool_get(&snap.values, site->value - 1), "1") == 0);
+    macro_postings_iter_init(&it, snap.fi, snap.fi_len, 0);
+    site = macro_postings_iter_next(&it);
+    CHECK(site != NULL && site->file == 0 && site->ln == 3);
+    site = macro_postings_iter_next(&it);
+    CHECK(site != NULL && site->file == 1 && site->ln == 2);
+
+    CHECK(macro_snapshot_next(&snap) == 1);
+    CHECK(strcmp(snap.name, "B_MAC") == 0 && snap.di_nums == 1 && snap.fi_nums == 1);
+    CHECK(macro_snapshot_next(&snap) == 0);
+    macro_snapshot_close(&snap);
+    fclose(fd);
+
+    /* anything that is not a snapshot is refused */
+    fd = tmpfile();
+    CHECK(fd != NULL);
+    if (fd != NULL) {
+        fputs("LMSNAP99", fd);
+        rewind(fd);
+        CHECK(macro_snapshot_open(&snap, fd) == -1);
+        fclose(fd);
+    }
+
+    macro_scan_destroy(ctx);
+}
+
+static void test_include_cycle(void)
+{
+    static const char * const files[] = {
+        "inc/a.h", "#include \"b.h\"\n#define FROM_A 1\n",
+        "inc/b.h", "#include \"a.h\"\n#include \"c.h\"\n",
+        "inc/c.h", "#define FROM_C 1\n",
+        "inc/d.h", "#define FROM_D 1\n",
+        "src/m.c", "#include <a.h>\n#include <stdio.h>\n",
+        NULL
+    };
+    static const char * const include_paths[] = { "inc" };
+    MACRO_SCAN_CTX * ctx = scan_files(MACRO_SCAN_BUILD_MATRIX | MACRO_SCAN_INCLUDES, files);
+    MACRO_INCLUDE_GRAPH * graph = NULL;
+    const unsigned long * bits;
+    unsigned int a, b, c, d, m;
+
+    CHECK(ctx != NULL);
+    if (ctx == NULL) {
+        return;
+    }
+
+    graph = macro_include_graph_build(ctx, include_paths, 1);
+    CHECK(graph != NULL);
+    if (graph == NULL) {
+        macro_scan_destroy(ctx);
+        return;
+    }
+
+    CHECK(macro_include_find_file(graph, "inc/a.h", &a) == 0);
+    CHECK(macro_include_find_file(graph, "inc/./b.h", &b) == 0);
+    CHECK(macro_include_find_file(graph, "src/../inc/c.h", &c) == 0);
+    CHECK(macro_include_find_file(graph, "inc/d.h", &d) == 0);
+    CHECK(macro_include_find_file(graph, "src/m.c", &m) == 0);
+    CHECK(macro_include_find_file(graph, "inc/e.h", &(unsigned int){0}) == -1);
+    CHECK(graph->unresolved_nums == 1);
+
+    /* a.h and b.h include each other: one component */
+    CHECK(graph->scc[a] == graph->scc[b]);
+    CHECK(graph->scc[a] != graph->scc[c]);
+
+    bits = macro_include_reachable(graph, m);
+    CHECK(macro_include_test(bits, m) && macro_include_test(bits, a) &&
+          macro_include_test(bits, b) && macro_include_test(bits, c));
+    CHECK(!macro_include_test(bits, d));
+
+    bits = macro_include_reachable(graph, b);
+    CHECK(macro_include_test(bits, a) && macro_include_test(bits, b) && macro_include_test(bits, c));
+    CHECK(!macro_include_test(bits, m) && !macro_include_test(bits, d));
+
+    bits = macro_include_reachable(graph, c);
+    CHECK(macro_include_test(bits, c) && !macro_include_test(bits, a) && !macro_include_test(bits, b));
+
+    macro_include_graph_free(graph);
+    macro_scan_destroy(ctx);
+}
+
+static void test_regions(void)
+{
+    static const char * const files[] = {
+        "r/g.h",
+        "#ifndef G_H\n"          /* 1, header guard: not a region */
+        "#define G_H\n"          /* 2 */
+        "#ifdef OUTER\n"         /* 3 */
+        "int x;\n"               /* 4 */
+        "#ifndef INNER\n"        /* 5 */
+        "int y;\n"               /* 6 */
+        "#else\n"                /* 7 */
+        "int z;\n"               /* 8 */
+        "#elif 0\n"              /* 9 */
+        "#endif\n"               /* 10 */
+        "#if defined(X)\n"       /* 11, not an '#ifdef' but nested all the same */
+        "#ifdef LATE\n"          /* 12 */
+        "#endif\n"               /* 13 */
+        "#endif\n"               /* 14 */
+        "#endif\n"               /* 15 */
+        "#endif\n",              /* 16 */
+        NULL
+    };
+    MACRO_SCAN_CTX * ctx = scan_files(MACRO_SCAN_BUILD_MATRIX | MACRO_SCAN_REGIONS, files);
+    MACRO_REGION_INDEX * index;
+    const MACRO_REGION * region;
+    CHECK(ctx != NULL);
+    if (ctx == NULL) {
+        return;
+    }
+
+    /* in the order they closed: INNER, LATE, OUTER */
+    CHECK(ctx->region_nums == 3);
+    if (ctx->region_nums == 3) {
+        region = &ctx->regions[0];
+        CHECK(region->macro == macro_id(ctx, "INNER"));
+        CHECK(region->start == 5 && region->else_ln == 7 && region->end == 10 && region->negated == 1);
+
+        region = &ctx->regions[1];
+        CHECK(region->macro == macro_id(ctx, "LATE"));
+        CHECK(region->start == 12 && region->else_ln == 0 && region->end == 13 && region->negated == 0);
+
+        region = &ctx->regions[2];
+        CHECK(region->macro == macro_id(ctx, "OUTER"));
+        CHECK(region->start == 3 && region->else_ln == 0 && region->end == 15);
+    }
+
+    CHECK(str_pool_lookup(&ctx->names, "G_H", &(unsigned int){0}) != 0);
+
+    index = macro_region_index_build(ctx, 2);
+    CHECK(index != NULL);
+    if (index != NULL) {
+        CHECK(macro_region_lines(index, macro_id(ctx, "OUTER"), 0) == 11);
+        CHECK(macro_region_lines(index, macro_id(ctx, "INNER"), 0) == 4);
+        CHECK(macro_region_total(index, macro_id(ctx, "LATE")) == 0);
+        macro_region_index_free(index);
+    }
+
+    macro_scan_destroy(ctx);
+}
+
+static void test_targets(void)
+{
+    static const char * const files[] = {
+        "t/x.c",
+        "#define FOO 1\n"
+        "int x = FOOBAR + FOOX + XFOO;\n"
+        "#if FOO && defined(OTHER)\n"
+        "#endif\n"
+        "#define BAR FOO\n"
+        "/* FOOBAR FOOBAR */\n",
+        NULL
+    };
+    MACRO_TARGETS targets;
+    MACRO_TARGET_ITER iter;
+    MACRO_SCAN_CTX * ctx;
+    const char * line;
+    unsigned int target;
+    unsigned int ln;
+    unsigned int nums = 0;
+    unsigned int id;
+    size_t offset;
+
+    macro_targets_init(&targets);
+    CHECK(macro_targets_add(&targets, "FOO", 3) == 0);
+    CHECK(macro_targets_add(&targets, "FOOBAR", 6) == 0);
+    CHECK(macro_targets_add(&targets, "FOO", 3) == 0);
+    CHECK(macro_targets_add(&targets, "9X", 2) == 1);
+    CHECK(macro_targets_nums(&targets) == 2);
+    CHECK(macro_targets_compile(&targets) == 0);
+
+    /* whole identifiers only: FOOX and XFOO are not FOO */
+    macro_target_iter_init(&iter, &targets, files[1], strlen(files[1]));
+    while (macro_target_iter_next(&iter, &target, &ln, &line, &offset) == 1) {
+        CHECK(strncmp(line + offset, macro_targets_name(&targets, target), strlen(macro_targets_name(&targets, target))) == 0);
+        nums++;
+    }
+    CHECK(nums == 6);
+
+    if ((ctx = macro_scan_create(NULL, MACRO_SCAN_BUILD_MATRIX)) == NULL) {
+        CHECK(ctx != NULL);
+        macro_targets_free(&targets);
+        return;
+    }
+    macro_scan_set_targets(ctx, &targets);
+    CHECK(macro_scan_buffer(ctx, files[0], files[1], strlen(files[1])) == 0);
+
+    /* FOO: defined on line 1, found on lines 3 and 5; FOOBAR once per line */
+    CHECK(str_pool_nums(&ctx->names) == 2);
+    id = macro_id(ctx, "FOO");
+    CHECK(ctx->macros[id]->di.nums == 1 && ctx->macros[id]->fi.nums == 2);
+    id = macro_id(ctx, "FOOBAR");
+    CHECK(ctx->macros[id]->di.nums == 0 && ctx->macros[id]->fi.nums == 2);
+    CHECK(str_pool_lookup(&ctx->names, "OTHER", &id) != 0);
+    CHECK(str_pool_lookup(&ctx->names, "BAR", &id) != 0);
+
+    macro_scan_destroy(ctx);
+    macro_targets_free(&targets);
+}
+
+static void test_diff(void)
+{
+    /* the same tree checked out twice, the new one with a top-level directory more */
+    static const char * const old_files[] = {
+        "old/src/m.c", "#define X 1\n#define KEEP 1\n#ifdef KEEP\n#endif\n",
+        NULL
+    };
+    static const char * const new_files[] = {
+        "new/src/m.c",     "#define X 2\n#define KEEP 1\n#ifdef KEEP\n#endif\n#ifdef KEEP\n#endif\n",
+        "new/include/y.h", "#define Y 1\n",
+        NULL
+    };
+    MACRO_SCAN_CTX * old_ctx = scan_files(MACRO_SCAN_BUILD_MATRIX, old_files);
+    MACRO_SCAN_CTX * new_ctx = scan_files(MACRO_SCAN_BUILD_MATRIX, new_files);
+    FILE * old_fd = tmpfile();
+    FILE * new_fd = tmpfile();
+    FILE * out    = tmpfile();
+    const char * text;
+    unsigned int id;
+
+    CHECK(old_ctx != NULL && new_ctx != NULL && old_fd != NULL && new_fd != NULL && out != NULL);
+    if (old_ctx == NULL || new_ctx == NULL || old_fd == NULL || new_fd == NULL || out == NULL) {
+        return;
+    }
+
+    CHECK(str_pool_intern(&old_ctx->roots, "old", 3, &id) == 0);
+    CHECK(str_pool_intern(&new_ctx->roots, "new", 3, &id) == 0);
+    CHECK(macro_snapshot_save(old_ctx, old_fd, 1) == 0);
+    CHECK(macro_snapshot_save(new_ctx, new_fd, 1) == 0);
+    rewind(old_fd);
+    rewind(new_fd);
+
+    CHECK(macro_diff_snapshots(old_fd, new_fd, out) == 0);
+    text = captured(out);
+
+    CHECK_HAS(text, "added\tY\tdefines:1 uses:0\n");
+    CHECK_HAS(text, "redefined\tX\t1 -> 2\n");
+    CHECK_HAS(text, "+use\tKEEP\tsrc/m.c\t1->2\n");
+    CHECK_HAS_NOT(text, "define\tX");
+    CHECK_HAS(text, "old root:old\nnew root:new\n");
+    CHECK_HAS(text, "added macro:1\nremoved macro:0\nredefined macro:1\nchanged macro:1\n");
+
+    fclose(old_fd);
+    fclose(new_fd);
+    macro_scan_destroy(old_ctx);
+    macro_scan_destroy(new_ctx);
+}
+
+static void test_tar_members(void)
+{
+    static const char a_c[] = "#define TAR_A 1\n";
+    static const char b_h[] = "#ifdef TAR_B\n#endif\n";
+    static const char c_h[] = "#define TAR_C\n";
+    static const char txt[] = "#define NOT_SOURCE 1\n";
+    char long_name[200];
+    char pax[64];
+    char path[] = "/tmp/list_macros_test_XXXXXX";
+    unsigned char data[8192];
+    MACRO_SCAN_CTX * ctx = NULL;
+    FILE * fd;
+    gzFile gz;
+    size_t len;
+    int pass;
+    int tmp;
+
+    if ((tmp = mkstemp(path)) < 0 || (fd = fdopen(tmp, "w+b")) == NULL) {
+        CHECK(!"can not create a temporary archive");
+        return;
+    }
+
+    /* a ustar member, a GNU 'L' long name, a pax path and a member that is not source */
+    snprintf(long_name, sizeof(long_name), "%s/%s/b.h",
+             "a_directory_name_long_enough_to_need_a_gnu_long_name_record",
+             "and_another_one_so_the_whole_path_is_over_one_hundred_bytes");
+    snprintf(pax, sizeof(pax), "%u path=pax/c.h\n", 16u);
+
+    put_tar_header(fd, "src/a.c", sizeof(a_c) - 1, '0');
+    put_tar_data(fd, a_c, sizeof(a_c) - 1);
+    put_tar_header(fd, "././@LongLink", strlen(long_name) + 1, 'L');
+    put_tar_data(fd, long_name, strlen(long_name) + 1);
+    put_tar_header(fd, "a_directory_name_long_enough_to_need_a_gnu_long_name_record/cut", sizeof(b_h) - 1, '0');
+    put_tar_data(fd, b_h, sizeof(b_h) - 1);
+    put_tar_header(fd, "PaxHeaders/c.h", strlen(pax), 'x');
+    put_tar_data(fd, pax, strlen(pax));
+    put_tar_header(fd, "pax_member_name_is_overridden", sizeof(c_h) - 1, '0');
+    put_tar_data(fd, c_h, sizeof(c_h) - 1);
+    put_tar_header(fd, "doc/readme.txt", sizeof(txt) - 1, '0');
+    put_tar_data(fd, txt, sizeof(txt) - 1);
+    memset(data, 0, 1024);
+    fwrite(data, 1, 1024, fd);
+    fflush(fd);
+
+    /* the same archive plain and gzip compressed */
+    for (pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            rewind(fd);
+            len = fread(data, 1, sizeof(data), fd);
+            CHECK(len > 0 && len < sizeof(data));
+            gz = gzopen(path, "wb");
+            CHECK(gz != NULL && gzwrite(gz, data, (unsigned int)len) == (int)len && gzclose(gz) == Z_OK);
+        }
+
+        if ((ctx = macro_scan_create(NULL, MACRO_SCAN_BUILD_MATRIX)) == NULL) {
+            CHECK(ctx != NULL);
+            break;
+        }
+
+        CHECK(macro_scan_tar(ctx, path) == 0);
+        CHECK(ctx->file_nums == 3);
+        CHECK(file_id(ctx, "src/a.c") != UINT_MAX);
+        CHECK(file_id(ctx, long_name) != UINT_MAX);
+        CHECK(file_id(ctx, "pax/c.h") != UINT_MAX);
+        CHECK(str_pool_nums(&ctx->names) == 3);
+        CHECK(ctx->macros[macro_id(ctx, "TAR_B")]->fi.nums == 1);
+        CHECK(str_pool_lookup(&ctx->names, "NOT_SOURCE", &(unsigned int){0}) != 0);
+
+        macro_scan_destroy(ctx);
+    }
+
+    fclose(fd);
+    unlink(path);
+}
+
+static void test_conflicts(void)
+{
+    static const char * const files[] = {
+        "c/a.h", "#define FOO\n#define BAR 1\n#define BAZ 1\n",
+        "c/b.h", "#define FOO 1\n#define BAR 2\n#define BAZ 1\n#define QUX\n",
+        "c/c.h", "#define BAR\n",
+        NULL
+    };
+    MACRO_SCAN_CTX * ctx = scan_files(MACRO_SCAN_BUILD_MATRIX, files);
+    FILE * fd = tmpfile();
+    const char * text;
+
+    CHECK(ctx != NULL && fd != NULL);
+    if (ctx == NULL || fd == NULL) {
+        return;
+    }
+
+    CHECK(macro_scan_report_conflicts(ctx, fd, 2) == 0);
+    text = captured(fd);
+
+    /* two real values conflict, a define without value next to one value does not */
+    CHECK_HAS(text, "  BAR                                              values:3 defined:3\n");
+    CHECK_BEFORE(text, "    1\n      c/a.h:2\n", "    2\n      c/b.h:2\n");
+    CHECK_HAS(text, "    (no value)\n      c/c.h:1\n");
+    CHECK_HAS_NOT(text, "  FOO ");
+    CHECK_HAS_NOT(text, "  BAZ ");
+    CHECK_HAS(text, "defined macro:4\nconflicting macro:1\n");
+
+    macro_scan_destroy(ctx);
+}
+
+static void test_dead(void)
+{
+    static const char * const files[] = {
+        "d/a.h", "#define DEAD_ONE 1\n#define LIVE 1\n#ifdef LIVE\n#endif\n#ifndef NEVER_DEFINED\n#endif\n",
+        "d/b.h", "#define DEAD_ANOTHER\n",
+        NULL
+    };
+    MACRO_SCAN_CTX * ctx = scan_files(MACRO_SCAN_BUILD_MATRIX, files);
+    FILE * fd = tmpfile();
+    const char * text;
+
+    CHECK(ctx != NULL && fd != NULL);
+    if (ctx == NULL || fd == NULL) {
+        return;
+    }
+
+    CHECK(macro_scan_report_dead(ctx, fd, 2) == 0);
+    text = captured(fd);
+
+    CHECK_BEFORE(text, "  DEAD_ANOTHER ", "  DEAD_ONE ");
+    CHECK_BEFORE(text, "  DEAD_ONE ", "Dangling macros");
+    CHECK_BEFORE(text, "Dangling macros", "  NEVER_DEFINED ");
+    CHECK_HAS_NOT(text, "  LIVE ");
+    CHECK_HAS(text, "distinct macro:4\ndead macro:2\ndangling macro:1\n");
+
+    macro_scan_destroy(ctx);
+}
+
+static void test_ctags_json(void)
+{
+    static const char * const files[] = {
+        "tt/b.c", "#define B_MAC 2\n#ifdef A_MAC\n#endif\n",
+        "tt/a.h", "#define A_MAC 1\n#define NO_VALUE\n#ifdef B_MAC\n#endif\n",
+        "tt/say \"hi\".h", "#define QUOTED 7\n",
+        NULL
+    };
+    MACRO_SCAN_CTX * ctx = scan_files(MACRO_SCAN_BUILD_MATRIX, files);
+    FILE * fd = tmpfile();
+    const char * text;
+
+    CHECK(ctx != NULL && fd != NULL);
+    if (ctx == NULL || fd == NULL) {
+        return;
+    }
+
+    CHECK(macro_export_ctags(ctx, fd, 2) == 0);
+    text = captured(fd);
+
+    CHECK_HAS(text, "!_TAG_FILE_SORTED\t1");
+    CHECK_BEFORE(text, "A_MAC\ttt/a.h\t1;\"\td\n", "B_MAC\ttt/b.c\t1;\"\td\n");
+    CHECK_BEFORE(text, "B_MAC\ttt/b.c\t1;\"\td\n", "NO_VALUE\ttt/a.h\t2;\"\td\n");
+
+    fd = tmpfile();
+    CHECK(fd != NULL);
+    if (fd == NULL) {
+        macro_scan_destroy(ctx);
+        return;
+    }
+
+    CHECK(macro_export_json(ctx, fd, 2) == 0);
+    text = captured(fd);
+
+    CHECK_HAS(text, "{\"format\":\"list_macros-index\",\"version\":1,\n");
+    CHECK_HAS(text, "\"files\":[\"tt/a.h\",\"tt/b.c\",\"tt/say \\\"hi\\\".h\"],\n");
+    CHECK_HAS(text, "{\"name\":\"QUOTED\",\"defines\":[[2,1,");
+    CHECK_HAS(text, "{\"name\":\"A_MAC\",\"defines\":[[0,1,");
+    CHECK_HAS(text, "\"uses\":[[1,2]]}");
+    CHECK_HAS(text, "{\"name\":\"NO_VALUE\",\"defines\":[[0,2,null]],\"uses\":[]}");
+    CHECK_HAS(text, "\n]}\n");
+
+    macro_scan_destroy(ctx);
+}
+
+static void test_stream(void)
+{
+    MACRO_STREAM_WRITER writer;
+    MACRO_SCAN_CALLBACKS cb;
+    MACRO_SCAN_CTX * ctx;
+    FILE * fd = tmpfile();
+    const char * text;
+
+    CHECK(fd != NULL);
+    if (fd == NULL) {
+        return;
+    }
+
+    macro_stream_init(&writer, fd, &cb);
+    if ((ctx = macro_scan_create(&cb, 0)) == NULL) {
+        CHECK(ctx != NULL);
+        fclose(fd);
+        return;
+    }
+
+    CHECK(macro_scan_buffer(ctx, "s/x.h", "#define A 1\n#ifdef B\n#endif\n#define C\n", 38) == 0);
+    CHECK(macro_scan_buffer(ctx, "s/tab\there.h", "#ifndef D\n#endif\n", 17) == 0);
+    CHECK(macro_stream_flush(&writer) == 0);
+    CHECK(writer.record_nums == 4);
+    text = captured(fd);
+
+    /* in scan order, a tab in a path is escaped */
+    CHECK(strcmp(text, "D\tA\ts/x.h\t1\t1\n"
+                       "F\tB\ts/x.h\t2\t\n"
+                       "D\tC\ts/x.h\t4\t\n"
+                       "F\tD\ts/tab\\there.h\t1\t\n") == 0);
+
+    macro_scan_destroy(ctx);
+}
+
+/* scan the (path, text) pairs of 'files', which ends with NULL. returns NULL if any failed */
+static MACRO_SCAN_CTX * scan_files(unsigned int flags, const char * const * files)
+{
+    MACRO_SCAN_CTX * ctx;
+    unsigned int k;
+
+    if ((ctx = macro_scan_create(NULL, flags)) == NULL) {
+        return NULL;
+    }
+
+    for (k = 0; files[k] != NULL; k += 2) {
+        if (macro_scan_buffer(ctx, files[k], files[k + 1], strlen(files[k + 1])) != 0) {
+            macro_scan_destroy(ctx);
+            return NULL;
+        }
+    }
+
+    return ctx;
+}
+
+/* the id of a macro that must have been scanned, UINT_MAX makes the callers' checks fail */
+static unsigned int macro_id(const MACRO_SCAN_CTX * ctx, const char * name)
+{
+    unsigned int id;
+
+    if (str_pool_lookup(&ctx->names, name, &id) != 0) {
+        fprintf(stderr, "  macro %s was not scanned\n", name);
+        _failures++;
+        return UINT_MAX;
+    }
+
+    return id;
+}
+
+/* the id of a scanned path, UINT_MAX if it was not scanned */
+static unsigned int file_id(const MACRO_SCAN_CTX * ctx, const char * path)
+{
+    unsigned int id;
+
+    return str_pool_lookup(&ctx->paths, path, &id) == 0 ? id : UINT_MAX;
+}
+
+/* read what was written to 'fd' back as one string and close it */
+static const char * captured(FILE * fd)
+{
+    size_t len;
+
+    rewind(fd);
+    len = fread(_captured, 1, sizeof(_captured) - 1, fd);
+    _captured[len] = '\0';
+    fclose(fd);
+
+    return _captured;
+}
+
+/* a ustar header block for a member of 'size' bytes */
+static void put_tar_header(FILE * fd, const char * name, unsigned long size, int type)
+{
+    unsigned char block[512];
+    unsigned long sum = 0;
+    unsigned int k;
+
+    memset(block, 0, sizeof(block));
+    strncpy((char *)block, name, 100);
+    memcpy(block + 100, "0000644", 7);
+    memcpy(block + 108, "0000000", 7);
+    memcpy(block + 116, "0000000", 7);
+    snprintf((char *)block + 124, 12, "%011o", (unsigned int)size);
+    memcpy(block + 136, "00000000000", 11);
+    memset(block + 148, ' ', 8);
+    block[156] = (unsigned char)type;
+    memcpy(block + 257, "ustar", 6);
+    memcpy(block + 263, "00", 2);
+
+    for (k = 0; k < sizeof(block); k++) {
+        sum += block[k];
+    }
+    snprintf((char *)block + 148, 8, "%06lo", sum);
+
+    fwrite(block, 1, sizeof(block), fd);
+}
+
+/* the member data padded to whole blocks */
+static void put_tar_data(FILE * fd, const char * data, size_t len)
+{
+    static const char zeros[512];
+
+    fwrite(data, 1, len, fd);
+    if (len % 512 != 0) {
+        fwrite(zeros, 1, 512 - len % 512, fd);
+    }
+}